@@ -0,0 +1,327 @@
+#include "ClusteredLights.h"
+#include "SnowSim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Texels per row of the index texture, four light indices to a texel
+// (indexSize in shaderSource)
+static const int INDEX_TEXELS = 1024;
+
+// Texture units the cluster textures are bound to; 0 is left alone
+static const int GRID_UNIT = 1;
+static const int INDEX_UNIT = 2;
+static const int LIGHT_UNIT = 3;
+
+const char* const ClusteredLights::shaderSource = R"(
+uniform sampler2D clusterGrid;      // Per cluster: first index, count
+uniform sampler2D clusterIndices;   // Light indices, four per texel
+uniform sampler2D clusterLightData; // Three texels per light
+uniform vec4 clusterGridSize;       // Tiles x, tiles y, slices, index rows
+uniform vec4 clusterDepth;          // Near plane, slices per ln(depth / near), viewport size
+uniform float clusterLightCount;
+uniform float clusterTime;
+uniform float clusterTransition;
+
+vec3 clusterLights(vec3 eyePos, vec3 eyeNormal, float useNormal) {
+    vec3 total = vec3(0.0);
+    if (clusterLightCount < 0.5) return total;
+
+    // Which cluster this fragment is in
+    vec2 tile = min(floor(gl_FragCoord.xy / clusterDepth.zw * clusterGridSize.xy), clusterGridSize.xy - 1.0);
+    float slice = floor(log(max(-eyePos.z / clusterDepth.x, 1.0)) * clusterDepth.y);
+    slice = min(slice, clusterGridSize.z - 1.0);
+    vec2 gridSize = vec2(clusterGridSize.x * clusterGridSize.y, clusterGridSize.z);
+    vec2 cell = texture2D(clusterGrid, (vec2(tile.y * clusterGridSize.x + tile.x, slice) + 0.5) / gridSize).xy;
+
+    vec2 indexSize = vec2(1024.0, clusterGridSize.w);
+    for (float i = 0.0; i < cell.y; i += 1.0) {
+        float k = cell.x + i;
+        float texel = floor(k / 4.0);
+        float row = floor(texel / indexSize.x);
+        vec4 four = texture2D(clusterIndices, (vec2(texel - row * indexSize.x, row) + 0.5) / indexSize);
+        float light = dot(four, vec4(equal(vec4(k - texel * 4.0), vec4(0.0, 1.0, 2.0, 3.0))));
+
+        float v = (light + 0.5) / clusterLightCount;
+        vec4 posRadius = texture2D(clusterLightData, vec2(0.5 / 3.0, v));
+        vec4 colorRate = texture2D(clusterLightData, vec2(1.5 / 3.0, v));
+        vec4 blink = texture2D(clusterLightData, vec2(2.5 / 3.0, v));
+
+        vec3 toLight = posRadius.xyz - eyePos;
+        float dist = length(toLight);
+        if (dist >= posRadius.w) continue;
+
+        // Inverse square, windowed to reach zero at the radius
+        float window = 1.0 - (dist * dist) / (posRadius.w * posRadius.w);
+        float falloff = window * window / (1.0 + 16.0 * dist * dist);
+        float facing = mix(1.0, max(dot(eyeNormal, toLight / max(dist, 0.0001)), 0.0), useNormal);
+
+        // Same blink as the bulbs: a minimum brightness, scaled by night
+        float pulse = 0.4 + 0.6 * (sin(clusterTime * colorRate.w + blink.y) + 1.0) * 0.5;
+        float intensity = mix(1.0, pulse, blink.x) * clusterTransition;
+
+        total += colorRate.rgb * (intensity * falloff * facing);
+    }
+    return total;
+}
+)";
+
+// Fixed-function lighting of LIGHT0 per vertex, with glColor as ambient
+// and diffuse (GL_COLOR_MATERIAL) and the material's emission and specular
+static const char* surfaceVertexShader = R"(
+#version 120
+varying vec3 eyePos;
+varying vec3 eyeNormal;
+varying vec4 baseColor;
+varying vec4 litColor;
+
+void main() {
+    vec4 eye = gl_ModelViewMatrix * gl_Vertex;
+    gl_Position = ftransform();
+    eyePos = eye.xyz;
+    baseColor = gl_Color;
+
+    // LIGHT0 as fixed function has it: GL_NORMALIZE is off, so scaled
+    // meshes light with their scaled normals
+    vec3 n = gl_NormalMatrix * gl_Normal;
+    eyeNormal = normalize(n);
+    vec3 l = normalize(gl_LightSource[0].position.xyz - eye.xyz * gl_LightSource[0].position.w);
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = 0.0;
+    if (diffuse > 0.0) {
+        specular = pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess);
+    }
+    vec3 lit = gl_FrontMaterial.emission.rgb +
+        gl_Color.rgb * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +
+            gl_LightSource[0].diffuse.rgb * diffuse) +
+        gl_FrontMaterial.specular.rgb * gl_LightSource[0].specular.rgb * specular;
+    litColor = vec4(clamp(lit, 0.0, 1.0), gl_Color.a);
+}
+)";
+
+static const char* surfaceFragmentShader = R"(
+varying vec3 eyePos;
+varying vec3 eyeNormal;
+varying vec4 baseColor;
+varying vec4 litColor;
+
+void main() {
+    vec3 extra = baseColor.rgb * clusterLights(eyePos, normalize(eyeNormal), 1.0);
+    gl_FragColor = vec4(min(litColor.rgb + extra, 1.0), litColor.a);
+}
+)";
+
+static const char* const surfaceAttribNames[] = { nullptr };
+
+static GLuint createTexture() {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+static void uploadTexture(GLuint texture, int width, int height, const float* data) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, data);
+}
+
+bool ClusteredLights::init() {
+    if (!gl.hasFloatTextures) return false;
+
+    std::string fragment = std::string("#version 120\n") + shaderSource + surfaceFragmentShader;
+    surfaceProgram = buildShaderProgram(surfaceVertexShader, fragment.c_str(), surfaceAttribNames);
+    if (!surfaceProgram) return false;
+    surfaceUniforms = locate(surfaceProgram);
+
+    gridTexture = createTexture();
+    indexTexture = createTexture();
+    lightTexture = createTexture();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void ClusteredLights::destroy() {
+    if (surfaceProgram) gl.DeleteProgram(surfaceProgram);
+    GLuint textures[] = { gridTexture, indexTexture, lightTexture };
+    if (gridTexture) glDeleteTextures(3, textures);
+    surfaceProgram = gridTexture = indexTexture = lightTexture = 0;
+}
+
+void ClusteredLights::clear() {
+    lights.clear();
+}
+
+void ClusteredLights::addLight(const HutLight& light, float radius) {
+    float m[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, m);
+    Light l;
+    l.x = m[0] * light.x + m[4] * light.y + m[8] * light.z + m[12];
+    l.y = m[1] * light.x + m[5] * light.y + m[9] * light.z + m[13];
+    l.z = m[2] * light.x + m[6] * light.y + m[10] * light.z + m[14];
+    l.radius = radius;
+    l.r = light.r;
+    l.g = light.g;
+    l.b = light.b;
+    l.blinkRate = light.blinkRate;
+    l.blinks = light.blinks ? 1.0f : 0.0f;
+    l.blinkPhase = light.blinkPhase;
+    l.unused0 = l.unused1 = 0.0f;
+    lights.push_back(l);
+}
+
+void ClusteredLights::build(int width, int height, float time, float transition) {
+    viewportWidth = std::max(width, 1);
+    viewportHeight = std::max(height, 1);
+    frameTime = time;
+    frameTransition = transition;
+    lastIndexCount = 0;
+    if (!isAvailable()) return;
+    if (!lights.empty()) bin();
+
+    // Uniforms stay with the program, so the surfaces need them once
+    gl.UseProgram(surfaceProgram);
+    apply(surfaceUniforms);
+    gl.UseProgram(0);
+}
+
+void ClusteredLights::bin() {
+    // Near and far planes back out of the perspective matrix
+    float p[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, p);
+    nearPlane = p[14] / (p[10] - 1.0f);
+    float farPlane = p[14] / (p[10] + 1.0f);
+    sliceScale = SLICES / std::log(farPlane / nearPlane);
+
+    auto sliceOf = [&](float depth) {
+        int slice = (int)std::floor(std::log(std::max(depth / nearPlane, 1.0f)) * sliceScale);
+        return std::min(std::max(slice, 0), SLICES - 1);
+    };
+    auto tileOf = [](float ndc, int tiles) {
+        int tile = (int)std::floor((ndc * 0.5f + 0.5f) * tiles);
+        return std::min(std::max(tile, 0), tiles - 1);
+    };
+
+    // Pass 1: the box of clusters each light's sphere touches, and a count
+    // per cluster
+    const int clusters = TILES_X * TILES_Y * SLICES;
+    clusterCount.assign(clusters, 0);
+    lightFirst.resize(lights.size() * 3);
+    lightLast.resize(lights.size() * 3);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const Light& l = lights[i];
+        int* first = &lightFirst[i * 3];
+        int* last = &lightLast[i * 3];
+        first[0] = 0;
+        last[0] = -1;
+
+        float nearDepth = std::max(-(l.z + l.radius), nearPlane);
+        float farDepth = -(l.z - l.radius);
+        if (farDepth < nearPlane || nearDepth > farPlane) continue;
+
+        // Screen rectangle of the sphere's bounding box; the whole screen
+        // if the box crosses the near plane
+        float minX = -1.0f, maxX = 1.0f, minY = -1.0f, maxY = 1.0f;
+        if (l.z + l.radius < -nearPlane) {
+            minX = minY = 1e30f;
+            maxX = maxY = -1e30f;
+            for (int corner = 0; corner < 8; ++corner) {
+                float x = l.x + (corner & 1 ? l.radius : -l.radius);
+                float y = l.y + (corner & 2 ? l.radius : -l.radius);
+                float z = l.z + (corner & 4 ? l.radius : -l.radius);
+                float w = p[3] * x + p[7] * y + p[11] * z + p[15];
+                float cx = (p[0] * x + p[4] * y + p[8] * z + p[12]) / w;
+                float cy = (p[1] * x + p[5] * y + p[9] * z + p[13]) / w;
+                minX = std::min(minX, cx);
+                maxX = std::max(maxX, cx);
+                minY = std::min(minY, cy);
+                maxY = std::max(maxY, cy);
+            }
+            if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f) continue;
+        }
+
+        first[0] = tileOf(minX, TILES_X);
+        last[0] = tileOf(maxX, TILES_X);
+        first[1] = tileOf(minY, TILES_Y);
+        last[1] = tileOf(maxY, TILES_Y);
+        first[2] = sliceOf(nearDepth);
+        last[2] = sliceOf(farDepth);
+        for (int z = first[2]; z <= last[2]; ++z) {
+            for (int y = first[1]; y <= last[1]; ++y) {
+                for (int x = first[0]; x <= last[0]; ++x) {
+                    ++clusterCount[(z * TILES_Y + y) * TILES_X + x];
+                }
+            }
+        }
+    }
+
+    // Pass 2: prefix sum into each cluster's first index
+    grid.assign(clusters * 4, 0.0f);
+    unsigned total = 0;
+    for (int c = 0; c < clusters; ++c) {
+        grid[c * 4] = (float)total;
+        grid[c * 4 + 1] = (float)clusterCount[c];
+        clusterCount[c] = total;
+        total += (unsigned)grid[c * 4 + 1];
+    }
+    lastIndexCount = total;
+
+    // Pass 3: scatter light indices into their clusters' ranges
+    indexRows = std::max(1, (int)((total + INDEX_TEXELS * 4 - 1) / (INDEX_TEXELS * 4)));
+    indices.assign((size_t)indexRows * INDEX_TEXELS * 4, 0.0f);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const int* first = &lightFirst[i * 3];
+        const int* last = &lightLast[i * 3];
+        for (int z = first[2]; z <= last[2]; ++z) {
+            for (int y = first[1]; y <= last[1]; ++y) {
+                for (int x = first[0]; x <= last[0]; ++x) {
+                    indices[clusterCount[(z * TILES_Y + y) * TILES_X + x]++] = (float)i;
+                }
+            }
+        }
+    }
+
+    uploadTexture(gridTexture, TILES_X * TILES_Y, SLICES, grid.data());
+    uploadTexture(indexTexture, INDEX_TEXELS, indexRows, indices.data());
+    uploadTexture(lightTexture, 3, (int)lights.size(), &lights[0].x);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+ClusteredLights::Uniforms ClusteredLights::locate(GLuint program) const {
+    Uniforms u;
+    u.grid = gl.GetUniformLocation(program, "clusterGrid");
+    u.indices = gl.GetUniformLocation(program, "clusterIndices");
+    u.lights = gl.GetUniformLocation(program, "clusterLightData");
+    u.gridSize = gl.GetUniformLocation(program, "clusterGridSize");
+    u.depth = gl.GetUniformLocation(program, "clusterDepth");
+    u.lightCount = gl.GetUniformLocation(program, "clusterLightCount");
+    u.time = gl.GetUniformLocation(program, "clusterTime");
+    u.transition = gl.GetUniformLocation(program, "clusterTransition");
+    return u;
+}
+
+void ClusteredLights::apply(const Uniforms& u) const {
+    bool on = isAvailable() && lastIndexCount > 0;
+    gl.Uniform1f(u.lightCount, on ? (float)lights.size() : 0.0f);
+    if (!on) return;
+
+    gl.ActiveTexture(GL_TEXTURE0 + GRID_UNIT);
+    glBindTexture(GL_TEXTURE_2D, gridTexture);
+    gl.ActiveTexture(GL_TEXTURE0 + INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_2D, indexTexture);
+    gl.ActiveTexture(GL_TEXTURE0 + LIGHT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, lightTexture);
+    gl.ActiveTexture(GL_TEXTURE0);
+
+    gl.Uniform1i(u.grid, GRID_UNIT);
+    gl.Uniform1i(u.indices, INDEX_UNIT);
+    gl.Uniform1i(u.lights, LIGHT_UNIT);
+    gl.Uniform4f(u.gridSize, (float)TILES_X, (float)TILES_Y, (float)SLICES, (float)indexRows);
+    gl.Uniform4f(u.depth, nearPlane, sliceScale, (float)viewportWidth, (float)viewportHeight);
+    gl.Uniform1f(u.time, frameTime);
+    gl.Uniform1f(u.transition, frameTransition);
+}
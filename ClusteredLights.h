@@ -0,0 +1,113 @@
+/*
+    Clustered forward lighting for point lights (the hut lights, and
+    however many more a scene adds).
+
+    Fixed function lights at most 8 lights, and only per vertex. Here the
+    view frustum is cut into TILES_X x TILES_Y screen tiles and SLICES
+    depth slices (exponentially spaced, so clusters near the camera are
+    thin), and each frame the CPU bins every light into the clusters its
+    sphere of influence touches: count per cluster, prefix-sum, scatter,
+    the same counting sort SpatialGrid uses. The cluster table, the light
+    index lists and the lights themselves go to the GPU as float
+    textures, and a fragment shader loops over the lights of its own
+    cluster only, so the cost per pixel follows how many lights actually
+    reach it, not how many there are.
+
+    Shaders that want the lights include shaderSource, which declares the
+    uniforms and clusterLights(), and call apply() with the locations from
+    locate() after binding their program. surfaces() is a program for the
+    scene's fixed-function meshes: LIGHT0, color material and emission per
+    vertex as before, plus the cluster lights per pixel; build() leaves it
+    ready to bind.
+
+    Lights blink in the shader from their rate and phase, like the bulbs
+    drawn by EffectsRenderer, so only positions change per frame.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "SnowGL.h"
+
+struct HutLight;
+
+class ClusteredLights {
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+
+    // GLSL 1.20 declarations and
+    //   vec3 clusterLights(vec3 eyePos, vec3 eyeNormal, float useNormal)
+    // returning the light arriving at eyePos (per unit albedo). With
+    // useNormal 0 the surface takes light from every side, like a flake.
+    static const char* const shaderSource;
+
+    struct Uniforms {
+        GLint grid = -1, indices = -1, lights = -1;
+        GLint gridSize = -1, depth = -1, lightCount = -1, time = -1, transition = -1;
+    };
+
+    // Build the textures and the surface program; needs a current context
+    // and loadGLFunctions() done. False without float textures.
+    bool init();
+    void destroy();
+
+    bool isAvailable() const { return surfaceProgram != 0; }
+
+    // Forget last frame's lights
+    void clear();
+
+    // Add a light at its position under the current modelview, reaching
+    // radius units
+    void addLight(const HutLight& light, float radius);
+
+    // Bin the lights with the current projection for a viewport of
+    // width x height, and upload them
+    void build(int width, int height, float time, float transition);
+
+    Uniforms locate(GLuint program) const;
+
+    // Point a program that includes shaderSource at this frame's lights;
+    // the program must be bound
+    void apply(const Uniforms& uniforms) const;
+
+    // Program to draw fixed-function meshes with cluster lighting; 0 when
+    // not available
+    GLuint surfaces() const { return surfaceProgram; }
+
+    size_t lightCount() const { return lights.size(); }
+
+    // Light indices stored over all clusters by the last build()
+    size_t lastIndexCount = 0;
+
+private:
+    void bin();
+
+    // Eye-space light, as uploaded: three RGBA texels
+    struct Light {
+        float x, y, z, radius;
+        float r, g, b, blinkRate;
+        float blinks, blinkPhase, unused0, unused1;
+    };
+
+    std::vector<Light> lights;
+    std::vector<int> lightFirst, lightLast;  // Cluster box per light: x, y, z ranges
+    std::vector<float> grid;                 // Per cluster: first index, count, 0, 0
+    std::vector<unsigned> clusterCount;
+    std::vector<float> indices;              // Light index per texel, 4 per texel
+    int indexRows = 1;
+    float nearPlane = 0.1f;
+    float sliceScale = 1.0f;
+    int viewportWidth = 1;
+    int viewportHeight = 1;
+    float frameTime = 0.0f;
+    float frameTransition = 0.0f;
+
+    GLuint gridTexture = 0;
+    GLuint indexTexture = 0;
+    GLuint lightTexture = 0;
+    GLuint surfaceProgram = 0;
+    Uniforms surfaceUniforms;
+};
@@ -0,0 +1,418 @@
+#include "EffectsRenderer.h"
+#include "MeshCache.h"
+#include "SnowSim.h"
+#include "RenderQueue.h"
+
+#include <cmath>
+#include <vector>
+
+// Attribute locations, bound before linking. Meshes feed the first two;
+// per-star, per-light and per-puff parameters start at ATTRIB_ITEM.
+enum {
+    ATTRIB_VERTEX = 0,
+    ATTRIB_NORMAL = 1,
+    ATTRIB_ITEM = 2
+};
+
+// Smoke puffs above the chimney
+static const int SMOKE_PUFFS = 5;
+
+// Slices and stacks of the spheres at each level of detail
+static const int SPHERE_SLICES[EffectsRenderer::SPHERE_LEVELS] = { 8, 6, 5, 4 };
+
+static int clampLevel(int lod) {
+    return lod < 0 ? 0 : lod >= EffectsRenderer::SPHERE_LEVELS ? EffectsRenderer::SPHERE_LEVELS - 1 : lod;
+}
+
+int EffectsRenderer::sphereSlices(int lod) {
+    return SPHERE_SLICES[clampLevel(lod)];
+}
+
+static const char* const starAttribNames[] = { "position", "twinkle", nullptr };
+
+static const char* starVertexShader = R"(
+#version 120
+attribute vec3 position;
+attribute vec3 twinkle; // brightness, rate, offset
+uniform float time;
+uniform float transition;
+varying vec4 color;
+
+void main() {
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 1.0);
+    float t = (sin(time * twinkle.y + twinkle.z) + 1.0) * 0.5;
+    color = vec4(vec3(twinkle.x * (0.7 + 0.3 * t) * transition), 1.0);
+}
+)";
+
+static const char* const lightAttribNames[] = { "vertex", "normal", "lightPos", "lightColor", "blink", nullptr };
+
+// Unit sphere scaled to radius at each light. Lit like fixed function
+// with GL_LIGHT0 and glColor as ambient and diffuse, glowing with the
+// light's color as emission.
+static const char* lightVertexShader = R"(
+#version 120
+attribute vec3 vertex;
+attribute vec3 normal;
+attribute vec3 lightPos;
+attribute vec3 lightColor;
+attribute vec3 blink; // blinks (0 or 1), rate, phase
+uniform float time;
+uniform float transition;
+uniform float radius;
+uniform float glow;
+varying vec4 color;
+
+void main() {
+    vec4 eye = gl_ModelViewMatrix * vec4(lightPos + vertex * radius, 1.0);
+    gl_Position = gl_ProjectionMatrix * eye;
+
+    // Blinking lights keep a minimum brightness
+    float pulse = 0.4 + 0.6 * (sin(time * blink.y + blink.z) + 1.0) * 0.5;
+    float intensity = mix(1.0, pulse, blink.x) * transition;
+
+    vec3 n = normalize(gl_NormalMatrix * normal);
+    vec3 l = normalize(gl_LightSource[0].position.xyz - eye.xyz * gl_LightSource[0].position.w);
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = 0.0;
+    if (diffuse > 0.0) {
+        specular = pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess);
+    }
+    vec3 lit = lightColor * intensity +
+        lightColor * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +
+            gl_LightSource[0].diffuse.rgb * diffuse) +
+        gl_FrontMaterial.specular.rgb * gl_LightSource[0].specular.rgb * specular;
+    color = vec4(lit, mix(1.0, 0.2 * intensity, glow));
+}
+)";
+
+static const char* const smokeAttribNames[] = { "vertex", "normal", "puff", nullptr };
+
+// Puffs stacked above the chimney top, swaying side to side
+static const char* smokeVertexShader = R"(
+#version 120
+attribute vec3 vertex;
+attribute vec2 puff; // index, height
+uniform float time;
+uniform float transition;
+varying vec4 color;
+
+void main() {
+    float wobble = sin(time * 1.5 + puff.x) * 0.05;
+    float width = 0.15 + puff.y * 0.1;
+    vec3 p = vec3(wobble, puff.y, 0.0) + vertex * vec3(width, 0.1, width);
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, 1.0);
+    color = vec4(0.8, 0.8, 0.8, 0.5 - 0.5 * transition);
+}
+)";
+
+static const char* effectFragmentShader = R"(
+#version 120
+varying vec4 color;
+
+void main() {
+    gl_FragColor = color;
+}
+)";
+
+void EffectsRenderer::init(MeshCache& meshCache) {
+    meshes = &meshCache;
+    for (int lod = 0; lod < SPHERE_LEVELS; ++lod) {
+        spheres[lod] = &meshCache.sphere(1.0f, SPHERE_SLICES[lod], SPHERE_SLICES[lod]);
+    }
+    if (!gl.hasInstancing || !spheres[0]->vertexBuffer) return;
+
+    starProgram = buildShaderProgram(starVertexShader, effectFragmentShader, starAttribNames);
+    lightProgram = buildShaderProgram(lightVertexShader, effectFragmentShader, lightAttribNames);
+    smokeProgram = buildShaderProgram(smokeVertexShader, effectFragmentShader, smokeAttribNames);
+    if (!starProgram || !lightProgram || !smokeProgram) {
+        destroy();
+        return;
+    }
+
+    uStarTime = gl.GetUniformLocation(starProgram, "time");
+    uStarTransition = gl.GetUniformLocation(starProgram, "transition");
+    uLightTime = gl.GetUniformLocation(lightProgram, "time");
+    uLightTransition = gl.GetUniformLocation(lightProgram, "transition");
+    uLightRadius = gl.GetUniformLocation(lightProgram, "radius");
+    uLightGlow = gl.GetUniformLocation(lightProgram, "glow");
+    uSmokeTime = gl.GetUniformLocation(smokeProgram, "time");
+    uSmokeTransition = gl.GetUniformLocation(smokeProgram, "transition");
+
+    gl.GenBuffers(1, &starBuffer);
+    gl.GenBuffers(1, &lightBuffer);
+
+    // The smoke never changes shape, only sways
+    float puffs[SMOKE_PUFFS * 2];
+    for (int i = 0; i < SMOKE_PUFFS; i++) {
+        puffs[i * 2] = (float)i;
+        puffs[i * 2 + 1] = 0.2f + (i * 0.1f);
+    }
+    gl.GenBuffers(1, &puffBuffer);
+    gl.BindBuffer(GL_ARRAY_BUFFER, puffBuffer);
+    gl.BufferData(GL_ARRAY_BUFFER, sizeof(puffs), puffs, GL_STATIC_DRAW);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void EffectsRenderer::destroy() {
+    if (starProgram) gl.DeleteProgram(starProgram);
+    if (lightProgram) gl.DeleteProgram(lightProgram);
+    if (smokeProgram) gl.DeleteProgram(smokeProgram);
+    if (starBuffer) gl.DeleteBuffers(1, &starBuffer);
+    if (lightBuffer) gl.DeleteBuffers(1, &lightBuffer);
+    if (puffBuffer) gl.DeleteBuffers(1, &puffBuffer);
+    starProgram = lightProgram = smokeProgram = 0;
+    starBuffer = lightBuffer = puffBuffer = 0;
+    starCount = lightCount = 0;
+}
+
+void EffectsRenderer::upload(const SnowSim& sim) {
+    if (!isAnimatedOnGpu()) return;
+
+    std::vector<float> data;
+    data.reserve(sim.stars.size() * 6);
+    for (const Star& star : sim.stars) {
+        data.insert(data.end(), { star.x, star.y, star.z, star.brightness, star.twinkleRate, star.twinkleOffset });
+    }
+    starCount = sim.stars.size();
+    gl.BindBuffer(GL_ARRAY_BUFFER, starBuffer);
+    gl.BufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+
+    data.clear();
+    for (const HutLight& light : sim.hutLights) {
+        data.insert(data.end(), { light.x, light.y, light.z, light.r, light.g, light.b,
+            light.blinks ? 1.0f : 0.0f, light.blinkRate, light.blinkPhase });
+    }
+    lightCount = sim.hutLights.size();
+    gl.BindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+    gl.BufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void EffectsRenderer::bindSphere(const StaticMesh& sphere) const {
+    const GLsizei stride = 6 * sizeof(float);
+    gl.BindBuffer(GL_ARRAY_BUFFER, sphere.vertexBuffer);
+    gl.VertexAttribPointer(ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+    gl.VertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (const void*)(3 * sizeof(float)));
+    gl.EnableVertexAttribArray(ATTRIB_VERTEX);
+    gl.EnableVertexAttribArray(ATTRIB_NORMAL);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere.indexBuffer);
+}
+
+void EffectsRenderer::unbindSphere() const {
+    gl.DisableVertexAttribArray(ATTRIB_VERTEX);
+    gl.DisableVertexAttribArray(ATTRIB_NORMAL);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void EffectsRenderer::drawStars(const SnowSim& sim, RenderQueue& queue) {
+    if (sim.dayNightTransition <= 0.0f) return; // Don't draw stars in day mode
+
+    RenderCommand stars;
+    stars.state.lit = false;
+    if (!isAnimatedOnGpu()) {
+        stars.drawBatch = [this, &sim]() { drawStarsImmediate(sim); };
+        queue.submit(stars);
+        return;
+    }
+
+    float time = sim.totalTime;
+    float transition = sim.dayNightTransition;
+    stars.state.program = starProgram;
+    stars.drawBatch = [this, time, transition]() { drawStarBatch(time, transition); };
+    queue.submit(stars);
+}
+
+void EffectsRenderer::drawStarBatch(float time, float transition) const {
+    // Position and twinkle, in the two slots meshes use
+    const GLsizei stride = 6 * sizeof(float);
+    gl.BindBuffer(GL_ARRAY_BUFFER, starBuffer);
+    gl.VertexAttribPointer(ATTRIB_VERTEX, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+    gl.VertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (const void*)(3 * sizeof(float)));
+    gl.EnableVertexAttribArray(ATTRIB_VERTEX);
+    gl.EnableVertexAttribArray(ATTRIB_NORMAL);
+
+    gl.Uniform1f(uStarTime, time);
+    gl.Uniform1f(uStarTransition, transition);
+    glPointSize(1.5f);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)starCount);
+
+    gl.DisableVertexAttribArray(ATTRIB_VERTEX);
+    gl.DisableVertexAttribArray(ATTRIB_NORMAL);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void EffectsRenderer::drawLightBatch(const StaticMesh& sphere, float radius, bool glow, float time,
+    float transition) const {
+    gl.Uniform1f(uLightTime, time);
+    gl.Uniform1f(uLightTransition, transition);
+    gl.Uniform1f(uLightRadius, radius);
+    gl.Uniform1f(uLightGlow, glow ? 1.0f : 0.0f);
+
+    bindSphere(sphere);
+    const GLsizei stride = 9 * sizeof(float);
+    gl.BindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+    for (GLuint a = 0; a < 3; ++a) {
+        gl.VertexAttribPointer(ATTRIB_ITEM + a, 3, GL_FLOAT, GL_FALSE, stride, (const void*)(a * 3 * sizeof(float)));
+        gl.EnableVertexAttribArray(ATTRIB_ITEM + a);
+        gl.VertexAttribDivisor(ATTRIB_ITEM + a, 1);
+    }
+
+    gl.DrawElementsInstanced(GL_TRIANGLES, sphere.indexCount, GL_UNSIGNED_INT, (const void*)0, (GLsizei)lightCount);
+
+    for (GLuint a = 0; a < 3; ++a) {
+        gl.DisableVertexAttribArray(ATTRIB_ITEM + a);
+        gl.VertexAttribDivisor(ATTRIB_ITEM + a, 0);
+    }
+    unbindSphere();
+}
+
+void EffectsRenderer::drawHutLights(const SnowSim& sim, RenderQueue& queue, int lod) {
+    if (sim.dayNightTransition <= 0.1f) return; // Only visible at night
+    lod = clampLevel(lod);
+    if (!isAnimatedOnGpu()) {
+        drawHutLightsImmediate(sim, queue, lod);
+        return;
+    }
+
+    // Bulbs with the opaque things, glow with the translucent ones
+    float time = sim.totalTime;
+    float transition = sim.dayNightTransition;
+    const StaticMesh& sphere = *spheres[lod];
+    RenderCommand bulbs;
+    bulbs.state.program = lightProgram;
+    bulbs.drawBatch = [this, &sphere, time, transition]() { drawLightBatch(sphere, 0.05f, false, time, transition); };
+    bulbs.triangles = lightCount * (sphere.indexCount / 3);
+    queue.submit(bulbs);
+
+    RenderCommand glow = bulbs;
+    glow.pass = PASS_TRANSPARENT;
+    glow.drawBatch = [this, &sphere, time, transition]() { drawLightBatch(sphere, 0.12f, true, time, transition); };
+    queue.submit(glow);
+}
+
+void EffectsRenderer::drawSmokeBatch(const StaticMesh& sphere, float time, float transition) const {
+    gl.Uniform1f(uSmokeTime, time);
+    gl.Uniform1f(uSmokeTransition, transition);
+
+    bindSphere(sphere);
+    gl.BindBuffer(GL_ARRAY_BUFFER, puffBuffer);
+    gl.VertexAttribPointer(ATTRIB_ITEM, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    gl.EnableVertexAttribArray(ATTRIB_ITEM);
+    gl.VertexAttribDivisor(ATTRIB_ITEM, 1);
+
+    gl.DrawElementsInstanced(GL_TRIANGLES, sphere.indexCount, GL_UNSIGNED_INT, (const void*)0, SMOKE_PUFFS);
+
+    gl.DisableVertexAttribArray(ATTRIB_ITEM);
+    gl.VertexAttribDivisor(ATTRIB_ITEM, 0);
+    unbindSphere();
+}
+
+void EffectsRenderer::drawSmoke(const SnowSim& sim, RenderQueue& queue, int lod) {
+    if (sim.isNightMode) return; // Only visible in day mode
+    lod = clampLevel(lod);
+    if (!isAnimatedOnGpu()) {
+        drawSmokeImmediate(sim, queue, lod);
+        return;
+    }
+
+    float time = sim.totalTime;
+    float transition = sim.dayNightTransition;
+    const StaticMesh& sphere = *spheres[lod];
+    RenderCommand smoke;
+    smoke.pass = PASS_TRANSPARENT;
+    smoke.state.program = smokeProgram;
+    smoke.state.lit = false;
+    smoke.drawBatch = [this, &sphere, time, transition]() { drawSmokeBatch(sphere, time, transition); };
+    smoke.triangles = SMOKE_PUFFS * (sphere.indexCount / 3);
+
+    // Sorted at the chimney top, where the puffs start
+    glPushMatrix();
+    glTranslatef(0.3f, 1.2f, 0.0f);
+    queue.submit(smoke);
+    glPopMatrix();
+}
+
+// Fallback: one point per star
+void EffectsRenderer::drawStarsImmediate(const SnowSim& sim) {
+    glPointSize(1.5f);
+    for (const auto& star : sim.stars) {
+        // Calculate star brightness with twinkling effect
+        float twinkle = sin(sim.totalTime * star.twinkleRate + star.twinkleOffset);
+        twinkle = (twinkle + 1.0f) * 0.5f; // Convert to [0,1] range
+        float brightness = star.brightness * (0.7f + 0.3f * twinkle) * sim.dayNightTransition;
+
+        glColor3f(brightness, brightness, brightness);
+
+        glPushMatrix();
+        glTranslatef(star.x, star.y, star.z);
+
+        // Simple point for stars
+        glBegin(GL_POINTS);
+        glVertex3f(0.0f, 0.0f, 0.0f);
+        glEnd();
+        glPopMatrix();
+    }
+}
+
+// Fallback: a bulb and a glow per light
+void EffectsRenderer::drawHutLightsImmediate(const SnowSim& sim, RenderQueue& queue, int lod) {
+    int slices = SPHERE_SLICES[lod];
+    for (const auto& light : sim.hutLights) {
+        float intensity = 1.0f;
+
+        // Apply blinking effect if this light blinks
+        if (light.blinks) {
+            float blink = sin(sim.totalTime * light.blinkRate + light.blinkPhase);
+            intensity = (blink + 1.0f) * 0.5f; // Convert to [0,1] range
+            intensity = 0.4f + (0.6f * intensity); // Keep a minimum brightness
+        }
+
+        // Scale intensity by day/night transition
+        intensity *= sim.dayNightTransition;
+
+        // A small sphere for the light, glowing in its color
+        RenderCommand bulb;
+        bulb.mesh = &meshes->sphere(0.05f, slices, slices);
+        bulb.color[0] = light.r;
+        bulb.color[1] = light.g;
+        bulb.color[2] = light.b;
+        bulb.emission[0] = light.r * intensity;
+        bulb.emission[1] = light.g * intensity;
+        bulb.emission[2] = light.b * intensity;
+
+        glPushMatrix();
+        glTranslatef(light.x, light.y, light.z);
+        queue.submit(bulb);
+
+        // A larger, dimmer sphere for glow effect
+        RenderCommand glow = bulb;
+        glow.pass = PASS_TRANSPARENT;
+        glow.mesh = &meshes->sphere(0.12f, slices, slices);
+        glow.color[3] = 0.2f * intensity;
+        queue.submit(glow);
+        glPopMatrix();
+    }
+}
+
+// Fallback: each puff queued on its own
+void EffectsRenderer::drawSmokeImmediate(const SnowSim& sim, RenderQueue& queue, int lod) {
+    RenderCommand puff;
+    puff.pass = PASS_TRANSPARENT;
+    puff.mesh = spheres[lod];
+    puff.state.lit = false;
+    puff.color[0] = puff.color[1] = puff.color[2] = 0.8f;
+    puff.color[3] = 0.5f - (0.5f * sim.dayNightTransition);
+
+    for (int i = 0; i < SMOKE_PUFFS; i++) {
+        float height = 0.2f + (i * 0.1f);
+        float wobble = sin(sim.totalTime * 1.5f + i) * 0.05f;
+
+        glPushMatrix();
+        glTranslatef(0.3f + wobble, 1.2f + height, 0.0f);
+        glScalef(0.15f + (height * 0.1f), 0.1f, 0.15f + (height * 0.1f));
+        queue.submit(puff);
+        glPopMatrix();
+    }
+}
@@ -0,0 +1,87 @@
+/*
+    Draws the time-animated parts of the scene: twinkling stars, blinking
+    hut lights with their glow, and the chimney smoke.
+
+    With instancing available, the per-item parameters (where each star,
+    light or smoke puff is, its brightness or color, its rate and phase)
+    go into static buffers once, at upload(), and the shaders work every
+    twinkle, blink and wobble out from the sim's time and day/night
+    transition, the only values sent per frame. All stars are one command
+    in the render queue, the light bulbs another, and the glows and the
+    smoke one transparent command each; the queue binds their programs.
+    Light bulbs and glows are lit in the shader the way fixed function
+    lights them.
+
+    Without instancing, the sines are evaluated and the items queued one
+    at a time on the CPU as before.
+
+    Bulbs, glows and puffs are spheres tessellated at SPHERE_LEVELS levels
+    of detail, from 8x8 down to 4x4; the caller picks one per globe.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include "SnowGL.h"
+
+class MeshCache;
+class SnowSim;
+class RenderQueue;
+struct StaticMesh;
+
+class EffectsRenderer {
+public:
+    static const int SPHERE_LEVELS = 4;
+
+    // Slices and stacks of the spheres at a level, so their meshes can be
+    // built up front
+    static int sphereSlices(int lod);
+
+    // Build the shaders and the smoke buffer; needs a current context and
+    // loadGLFunctions() done. Falls back to the CPU without instancing.
+    void init(MeshCache& meshes);
+    void destroy();
+
+    // Copy sim's star and hut light parameters to the GPU. Call again
+    // whenever they are replaced (SnowSim::init(), a snapshot load).
+    void upload(const SnowSim& sim);
+
+    // Queue the stars around the globe, in world space
+    void drawStars(const SnowSim& sim, RenderQueue& queue);
+
+    // With the hut's transform current: queue the light bulbs and their
+    // glow, with spheres at level of detail lod (0 is the finest)
+    void drawHutLights(const SnowSim& sim, RenderQueue& queue, int lod = 0);
+
+    // With the hut's transform current: queue the chimney smoke
+    void drawSmoke(const SnowSim& sim, RenderQueue& queue, int lod = 0);
+
+    bool isAnimatedOnGpu() const { return starProgram != 0; }
+
+private:
+    void drawStarBatch(float time, float transition) const;
+    void drawLightBatch(const StaticMesh& sphere, float radius, bool glow, float time, float transition) const;
+    void drawSmokeBatch(const StaticMesh& sphere, float time, float transition) const;
+    void bindSphere(const StaticMesh& sphere) const;
+    void unbindSphere() const;
+
+    void drawStarsImmediate(const SnowSim& sim);
+    void drawHutLightsImmediate(const SnowSim& sim, RenderQueue& queue, int lod);
+    void drawSmokeImmediate(const SnowSim& sim, RenderQueue& queue, int lod);
+
+    MeshCache* meshes = nullptr;
+    const StaticMesh* spheres[SPHERE_LEVELS] = {}; // Unit spheres shared by bulbs, glows and smoke
+
+    GLuint starProgram = 0;
+    GLuint lightProgram = 0;
+    GLuint smokeProgram = 0;
+    GLint uStarTime = -1, uStarTransition = -1;
+    GLint uLightTime = -1, uLightTransition = -1, uLightRadius = -1, uLightGlow = -1;
+    GLint uSmokeTime = -1, uSmokeTransition = -1;
+
+    GLuint starBuffer = 0;
+    GLuint lightBuffer = 0;
+    GLuint puffBuffer = 0;
+    size_t starCount = 0;
+    size_t lightCount = 0;
+};
@@ -0,0 +1,121 @@
+#include "FrameCapture.h"
+
+#include <cstring>
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+
+bool FrameCapture::open(const char* path, Format fmt, int w, int h) {
+    finish();
+
+    if (strcmp(path, "-") == 0) {
+        file = stdout;
+        ownsFile = false;
+    }
+    else {
+        file = fopen(path, "wb");
+        ownsFile = true;
+        if (!file) {
+            fprintf(stderr, "Could not open %s for writing\n", path);
+            return false;
+        }
+    }
+
+    format = fmt;
+    width = w;
+    height = h;
+    framesWritten = 0;
+    writeFailed = false;
+    next = 0;
+    queued = false;
+    row.resize((size_t)width * 4);
+
+    size_t frameBytes = (size_t)width * height * 4;
+    if (gl.hasPixelBuffers) {
+        gl.GenBuffers(2, pbo);
+        for (int i = 0; i < 2; ++i) {
+            gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            gl.BufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+        }
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    else {
+        pixels.resize(frameBytes);
+    }
+    return true;
+}
+
+void FrameCapture::capture() {
+    if (!file) return;
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    if (!pbo[0]) {
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        writeFrame(pixels.data());
+        return;
+    }
+
+    // Start this frame's copy, then write last frame's, which has had a
+    // whole frame to finish
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo[next]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    int previous = next ^ 1;
+    if (queued) {
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo[previous]);
+        const unsigned char* mapped = (const unsigned char*)gl.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (mapped) writeFrame(mapped);
+        gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    queued = true;
+    next = previous;
+}
+
+bool FrameCapture::finish() {
+    if (!file) return !writeFailed;
+
+    if (queued) {
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo[next ^ 1]);
+        const unsigned char* mapped = (const unsigned char*)gl.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (mapped) writeFrame(mapped);
+        gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        queued = false;
+    }
+    if (pbo[0]) {
+        gl.DeleteBuffers(2, pbo);
+        pbo[0] = pbo[1] = 0;
+    }
+    pixels.clear();
+
+    if (fflush(file) != 0) writeFailed = true;
+    if (ownsFile && fclose(file) != 0) writeFailed = true;
+    file = nullptr;
+    return !writeFailed;
+}
+
+// GL rows run bottom to top; files want the top row first
+void FrameCapture::writeFrame(const unsigned char* rgba) {
+    size_t rowBytes = (size_t)width * 4;
+    if (format == PPM) {
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        rowBytes = (size_t)width * 3;
+    }
+
+    for (int y = height - 1; y >= 0; --y) {
+        const unsigned char* src = rgba + (size_t)y * width * 4;
+        if (format == PPM) {
+            for (int x = 0; x < width; ++x) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            src = row.data();
+        }
+        if (fwrite(src, 1, rowBytes, file) != rowBytes) writeFailed = true;
+    }
+    ++framesWritten;
+}
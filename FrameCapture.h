@@ -0,0 +1,58 @@
+/*
+    Streams rendered frames to a file or a pipe, for golden images and
+    video encoding.
+
+    Readback goes through two pixel buffer objects: capture() queues a
+    glReadPixels of the current frame into one while the frame queued the
+    call before is mapped from the other and written out, so the CPU
+    never waits on the frame it has just drawn. Frames therefore come out
+    one call late, and finish() writes the last one. Without pixel buffer
+    support it falls back to a plain glReadPixels per frame.
+
+    Frames are written top row first, either as raw RGBA (e.g. ffmpeg
+    -f rawvideo -pix_fmt rgba -s WxH) or as a stream of binary PPMs
+    (ffmpeg -f image2pipe -c:v ppm); a single-frame PPM stream is an
+    ordinary .ppm image.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "SnowGL.h"
+
+class FrameCapture {
+public:
+    enum Format { RAW_RGBA, PPM };
+
+    ~FrameCapture() { finish(); }
+
+    // Start a stream of width x height frames; path "-" is stdout. Needs
+    // a current context and loadGLFunctions() done.
+    bool open(const char* path, Format format, int width, int height);
+
+    // Queue the current framebuffer for writing
+    void capture();
+
+    // Write any queued frame and close the stream; false if a write failed
+    bool finish();
+
+    uint64_t framesWritten = 0;
+
+private:
+    void writeFrame(const unsigned char* rgba);
+
+    FILE* file = nullptr;
+    bool ownsFile = false;
+    bool writeFailed = false;
+    Format format = RAW_RGBA;
+    int width = 0;
+    int height = 0;
+
+    GLuint pbo[2] = { 0, 0 };
+    int next = 0;           // Buffer the next capture() reads into
+    bool queued = false;    // The other buffer holds a frame not yet written
+    std::vector<unsigned char> pixels; // Readback without pixel buffers
+    std::vector<unsigned char> row;    // One converted output row
+};
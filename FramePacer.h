@@ -0,0 +1,64 @@
+/*
+    Decides when the window draws its next frame, so an idle globe does
+    not redraw at full rate for hours.
+
+    Frames are due on a grid of 1 / fps seconds: each deadline is the last
+    one plus the interval, so the time a frame takes comes out of the wait
+    before the next rather than adding to it. A frame that starts past its
+    deadline restarts the grid from now instead of rushing to catch up.
+
+    The rate follows the scene. While something moves, and for wakeSeconds
+    after any input, frames come at activeFps. With only the time-based
+    effects left (twinkle, blink, sparkle, smoke) they drop to idleFps,
+    and with idleFps 0 they stop until the next wake(). Times are seconds
+    on any clock that only goes forward.
+*/
+
+#pragma once
+
+class FramePacer {
+public:
+    float activeFps = 60.0f;    // While moving or just after input
+    float idleFps = 10.0f;      // Once still; 0 stops drawing
+    double wakeSeconds = 1.0;   // Full rate this long after input
+
+    // A frame starts at now; moving says whether the scene changes beyond
+    // its time-based effects. Returns the seconds to wait before the next
+    // frame, or a negative number when there is none until wake().
+    double next(double now, bool moving) {
+        idle = !moving && now - lastInput >= wakeSeconds;
+        float fps = idle ? idleFps : activeFps;
+        if (fps <= 0.0f) {
+            stopped = true;
+            return -1.0;
+        }
+
+        double interval = 1.0 / fps;
+        deadline += interval;
+        if (deadline <= now) deadline = now + interval;
+        return deadline - now;
+    }
+
+    // Input arrived at now. True when the next frame is due later than a
+    // full-rate one would be, or not at all, so the caller should draw one
+    // now; the grid then restarts from now.
+    bool wake(double now) {
+        lastInput = now;
+        if (!stopped && deadline - now <= 1.0 / activeFps) return false;
+        stopped = false;
+        deadline = now;
+        return true;
+    }
+
+    bool isIdle() const { return idle; }
+    bool isStopped() const { return stopped; }
+
+    // Frames per second the last next() picked
+    float fps() const { return idle ? idleFps : activeFps; }
+
+private:
+    double deadline = 0.0;      // When the pending frame is due
+    double lastInput = 0.0;
+    bool idle = false;
+    bool stopped = false;
+};
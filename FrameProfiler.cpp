@@ -0,0 +1,148 @@
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+FrameProfiler::FrameProfiler()
+    : origin(std::chrono::steady_clock::now()),
+      cpuHistory((size_t)HISTORY * MAX_PHASES, -1.0f),
+      gpuHistory((size_t)HISTORY * MAX_PHASES, -1.0f) {
+    events.reserve(MAX_EVENTS);
+    framePhase = phase("frame");
+}
+
+int FrameProfiler::findPhase(const char* name) const {
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+int FrameProfiler::phase(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    int id = findPhase(name);
+    if (id >= 0) return id;
+    if ((int)names.size() == MAX_PHASES) return -1;
+    names.push_back(name);
+    return (int)names.size() - 1;
+}
+
+int FrameProfiler::phaseCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)names.size();
+}
+
+std::string FrameProfiler::phaseName(int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return id >= 0 && id < (int)names.size() ? names[id] : std::string();
+}
+
+int64_t FrameProfiler::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void FrameProfiler::nextFrame() {
+    int64_t t = now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (enabled && frame > 0) {
+        cpuHistory[(frame % HISTORY) * MAX_PHASES + framePhase] = (t - frameStart) / 1000.0f;
+        addEvent({ framePhase, 0, frameStart, t - frameStart });
+    }
+    ++frame;
+    frameStart = t;
+
+    // Clear the row the new frame reuses
+    size_t row = (frame % HISTORY) * MAX_PHASES;
+    std::fill(cpuHistory.begin() + row, cpuHistory.begin() + row + MAX_PHASES, -1.0f);
+    std::fill(gpuHistory.begin() + row, gpuHistory.begin() + row + MAX_PHASES, -1.0f);
+}
+
+uint64_t FrameProfiler::currentFrame() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frame;
+}
+
+void FrameProfiler::record(int id, int64_t startUs, int64_t endUs) {
+    if (id < 0) return;
+    uint32_t thread = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    std::lock_guard<std::mutex> lock(mutex);
+    float& total = cpuHistory[(frame % HISTORY) * MAX_PHASES + id];
+    total = (total < 0.0f ? 0.0f : total) + (endUs - startUs) / 1000.0f;
+    addEvent({ id, thread & 0x7fffffffu, startUs, endUs - startUs });
+}
+
+void FrameProfiler::recordGpu(int id, uint64_t issuedFrame, int64_t cpuStartUs, double ms) {
+    if (id < 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (issuedFrame + HISTORY > frame) {
+        float& total = gpuHistory[(issuedFrame % HISTORY) * MAX_PHASES + id];
+        total = (total < 0.0f ? 0.0f : total) + (float)ms;
+    }
+    addEvent({ id, GPU_THREAD, cpuStartUs, (int64_t)(ms * 1000.0) });
+}
+
+void FrameProfiler::addEvent(const Event& event) {
+    if (events.size() < MAX_EVENTS) {
+        events.push_back(event);
+    }
+    else {
+        events[eventHead] = event;
+        eventHead = (eventHead + 1) % MAX_EVENTS;
+    }
+}
+
+FrameProfiler::Percentiles FrameProfiler::percentiles(const std::vector<float>& history, int id) const {
+    Percentiles result = { 0.0, 0.0, 0.0, 0 };
+    if (id < 0) return result;
+
+    // Completed frames only; the current one is still being recorded
+    std::vector<float> samples;
+    uint64_t first = frame > (uint64_t)HISTORY ? frame - HISTORY + 1 : 1;
+    for (uint64_t f = first; f < frame; ++f) {
+        float ms = history[(f % HISTORY) * MAX_PHASES + id];
+        if (ms >= 0.0f) samples.push_back(ms);
+    }
+    if (samples.empty()) return result;
+
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double q) { return (double)samples[(size_t)(q * (samples.size() - 1) + 0.5)]; };
+    result.p50 = at(0.50);
+    result.p95 = at(0.95);
+    result.p99 = at(0.99);
+    result.samples = (int)samples.size();
+    return result;
+}
+
+FrameProfiler::Percentiles FrameProfiler::cpuPercentiles(int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return percentiles(cpuHistory, id);
+}
+
+FrameProfiler::Percentiles FrameProfiler::gpuPercentiles(int id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return percentiles(gpuHistory, id);
+}
+
+bool FrameProfiler::writeChromeTrace(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+        GPU_THREAD & 0x7fffffffu);
+
+    // Oldest first
+    for (size_t n = 0; n < events.size(); ++n) {
+        const Event& e = events[(eventHead + n) % events.size()];
+        bool gpu = e.thread == GPU_THREAD;
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%u}",
+            names[e.phase].c_str(), gpu ? "gpu" : "cpu", (long long)e.start, (long long)e.duration,
+            e.thread & 0x7fffffffu);
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
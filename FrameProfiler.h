@@ -0,0 +1,117 @@
+/*
+    Per-phase frame profiler, with no GL dependency.
+
+    Code is timed with ProfileScope, which records one CPU interval for a
+    named phase of the current frame. Phase totals for the last HISTORY
+    frames are kept in a ring so the HUD can show p50/p95/p99 per phase,
+    and the individual intervals are kept in a second ring for export as
+    Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev). GPU
+    times arrive a few frames late from GpuProfiler and are filed under
+    the frame that issued them.
+
+    Recording takes a mutex, so phases may be timed from several threads;
+    it is meant for a few dozen intervals per frame, not per flake.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class FrameProfiler {
+public:
+    static const int MAX_PHASES = 16;
+    static const int HISTORY = 256;           // Frames kept for percentiles
+    static const size_t MAX_EVENTS = 16384;   // Intervals kept for the trace
+
+    bool enabled = true;
+
+    FrameProfiler();
+
+    // Id of a named phase, registered on first use; -1 once MAX_PHASES
+    // are taken
+    int phase(const char* name);
+    int phaseCount() const;
+    std::string phaseName(int id) const;
+
+    // Microseconds since the profiler was created
+    int64_t now() const;
+
+    // Close the current frame and start the next. The frame's length is
+    // recorded as the "frame" phase.
+    void nextFrame();
+    uint64_t currentFrame() const;
+
+    // CPU interval of a phase in the current frame
+    void record(int id, int64_t startUs, int64_t endUs);
+
+    // GPU time of a phase in an earlier frame; cpuStartUs places it in the trace
+    void recordGpu(int id, uint64_t frame, int64_t cpuStartUs, double ms);
+
+    struct Percentiles {
+        double p50, p95, p99;
+        int samples;
+    };
+
+    // Over the completed frames still in the history; samples == 0 when
+    // the phase has not run in any of them
+    Percentiles cpuPercentiles(int id) const;
+    Percentiles gpuPercentiles(int id) const;
+
+    // Write the kept intervals as Chrome trace-event JSON
+    bool writeChromeTrace(const char* path) const;
+
+private:
+    struct Event {
+        int phase;
+        uint32_t thread;   // GPU_THREAD for GPU intervals
+        int64_t start;     // Microseconds
+        int64_t duration;
+    };
+    static const uint32_t GPU_THREAD = 0xffffffffu;
+
+    int findPhase(const char* name) const;
+    void addEvent(const Event& event);
+    Percentiles percentiles(const std::vector<float>& history, int id) const;
+
+    std::chrono::steady_clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<std::string> names;
+
+    // Milliseconds per (frame % HISTORY, phase); negative when not run
+    std::vector<float> cpuHistory, gpuHistory;
+    uint64_t frame = 0;
+    int64_t frameStart = 0;
+    int framePhase = -1;
+
+    std::vector<Event> events; // Ring of the last MAX_EVENTS intervals
+    size_t eventHead = 0;
+};
+
+// Times the enclosing block as one interval of a phase. A null profiler
+// makes it a no-op, so library code can be timed only when asked.
+class ProfileScope {
+public:
+    ProfileScope(FrameProfiler* profiler, int phase)
+        : profiler(profiler && profiler->enabled && phase >= 0 ? profiler : nullptr), id(phase),
+          start(this->profiler ? this->profiler->now() : 0) {}
+
+    ProfileScope(FrameProfiler* profiler, const char* name)
+        : ProfileScope(profiler, profiler ? profiler->phase(name) : -1) {}
+
+    ~ProfileScope() {
+        if (profiler) profiler->record(id, start, profiler->now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    FrameProfiler* profiler;
+    int id;
+    int64_t start;
+};
@@ -0,0 +1,149 @@
+#include "GlobeScene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "SnowSim.h"
+#include "ThreadPool.h"
+
+// Smallest projected glass radius, in pixels, for each level but the last
+static const float LOD_MIN_RADIUS[GlobeScene::LOD_LEVELS - 1] = { 120.0f, 50.0f, 20.0f };
+
+void GlobeScene::init(SnowSim& primary, int count) {
+    count = std::max(count, 1);
+    columns = (int)std::ceil(std::sqrt((double)count));
+    rows = (count + columns - 1) / columns;
+
+    globes.assign(count, Globe());
+    ownSims.clear();
+    onScreen = std::vector<std::atomic<bool>>(count);
+    for (std::atomic<bool>& shown : onScreen) shown.store(true);
+    onScreenLod = std::vector<std::atomic<int>>(count);
+    for (std::atomic<int>& lod : onScreenLod) lod.store(0);
+    for (int i = 0; i < count; ++i) {
+        Globe& globe = globes[i];
+        globe.x = (i % columns - (columns - 1) * 0.5f) * SPACING_X;
+        globe.y = ((rows - 1) * 0.5f - i / columns) * SPACING_Y;
+        if (i == 0) {
+            globe.sim = &primary;
+            continue;
+        }
+
+        std::unique_ptr<SnowSim> sim(new SnowSim());
+        sim->seed = primary.seed + i;
+        sim->numSnowflakes = primary.numSnowflakes;
+        sim->fluidFlow = false; // A water grid each would cost more than the whole wall
+        sim->numStars = 0; // The sky belongs to the scene, not to each globe
+        sim->init();
+        globe.sim = sim.get();
+        ownSims.push_back(std::move(sim));
+    }
+
+    // Parallel over globes instead of within one
+    if (count > 1) {
+        primary.threadPool = nullptr;
+        primary.profiler = nullptr;
+    }
+}
+
+float GlobeScene::extent() const {
+    return std::max((columns - 1) * SPACING_X, (rows - 1) * SPACING_Y) * 0.5f;
+}
+
+void GlobeScene::step(float dt, ThreadPool* pool) {
+    auto stepRange = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Globe& globe = globes[i];
+            if (i > 0) {
+                bool visible = onScreen[i].load(std::memory_order_relaxed);
+                if (!visible && ++globe.offscreenSteps % OFFSCREEN_STEP_INTERVAL != 0) continue;
+                int lod = onScreenLod[i].load(std::memory_order_relaxed);
+                globe.sim->stepLimit = lod > 0 ? flakeLimit(globe.sim->numSnowflakes, lod) : SIZE_MAX;
+            }
+            globe.sim->step(dt);
+        }
+    };
+    if (pool && globes.size() > 1) {
+        pool->parallelFor(globes.size(), 1, stepRange);
+    }
+    else {
+        stepRange(0, globes.size());
+    }
+}
+
+void GlobeScene::updateVisibility(const float* projection, const float* modelview, int height) {
+    // Clip matrix, and from its rows the six frustum planes (Gribb and
+    // Hartmann), normalized so plane distances are in world units
+    float clip[16];
+    for (int c = 0; c < 4; ++c) {
+        for (int r = 0; r < 4; ++r) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) sum += projection[k * 4 + r] * modelview[c * 4 + k];
+            clip[c * 4 + r] = sum;
+        }
+    }
+    float planes[6][4];
+    for (int p = 0; p < 6; ++p) {
+        int row = p / 2;
+        float sign = p % 2 ? -1.0f : 1.0f;
+        for (int c = 0; c < 4; ++c) planes[p][c] = clip[c * 4 + 3] + sign * clip[c * 4 + row];
+        float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] +
+            planes[p][2] * planes[p][2]);
+        for (int c = 0; c < 4; ++c) planes[p][c] /= length;
+    }
+
+    for (size_t i = 0; i < globes.size(); ++i) {
+        Globe& globe = globes[i];
+        float x = globe.x, y = globe.y - BOUNDS_DROP, z = 0.0f;
+        globe.visible = true;
+        for (int p = 0; p < 6 && globe.visible; ++p) {
+            if (planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3] < -BOUNDS_RADIUS) {
+                globe.visible = false;
+            }
+        }
+        onScreen[i].store(globe.visible, std::memory_order_relaxed);
+        if (!globe.visible) continue;
+
+        // Radius of the glass on screen from its distance in front of the eye
+        float depth = -(modelview[2] * globe.x + modelview[6] * globe.y + modelview[14]);
+        float scale = projection[5] * height * 0.5f;
+        globe.screenRadius = depth > 0.1f ? GLOBE_RADIUS * scale / depth : 1e9f;
+        // Coarser once clearly under a threshold, finer once clearly over
+        while (globe.lod < LOD_LEVELS - 1 &&
+            globe.screenRadius < LOD_MIN_RADIUS[globe.lod] * (1.0f - LOD_HYSTERESIS)) {
+            ++globe.lod;
+        }
+        while (globe.lod > 0 && globe.screenRadius > LOD_MIN_RADIUS[globe.lod - 1] * (1.0f + LOD_HYSTERESIS)) {
+            --globe.lod;
+        }
+        onScreenLod[i].store(globe.lod, std::memory_order_relaxed);
+    }
+}
+
+size_t GlobeScene::visibleCount() const {
+    return std::count_if(globes.begin(), globes.end(), [](const Globe& g) { return g.visible; });
+}
+
+size_t GlobeScene::lodCount(int lod) const {
+    return std::count_if(globes.begin(), globes.end(), [lod](const Globe& g) { return g.visible && g.lod == lod; });
+}
+
+size_t GlobeScene::flakeLimit(size_t flakes, int lod) {
+    return (flakes + (1 << (2 * lod)) - 1) >> (2 * lod); // A quarter per level, rounded up
+}
+
+int GlobeScene::tessellation(int full, int lod) {
+    return std::max(full >> lod, std::min(full, 6));
+}
+
+void GlobeScene::shake() {
+    for (Globe& globe : globes) globe.sim->shake();
+}
+
+void GlobeScene::toggleNightMode() {
+    for (Globe& globe : globes) globe.sim->toggleNightMode();
+}
+
+void GlobeScene::spinGlobe(float speed) {
+    for (Globe& globe : globes) globe.sim->spinGlobe(speed);
+}
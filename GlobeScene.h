@@ -0,0 +1,109 @@
+/*
+    A display of many snow globes at once: a wall of them, rows by
+    columns, facing the camera.
+
+    Each globe is a SnowSim of its own with a seed of its own. The first
+    is the program's primary simulation, the one snapshots, replays and
+    the GPU backend work on; the scene creates the others with its
+    settings. Input goes to every globe alike.
+
+    step() runs the globes side by side on the thread pool, one globe per
+    job, each globe's flakes serially. A globe culled by the last
+    updateVisibility() only steps on every OFFSCREEN_STEP_INTERVAL-th call,
+    so its snow slows down while nobody can see it. updateVisibility()
+    also gives each visible globe a level of detail from how big it
+    appears: flakeLimit() says how many of its flakes to step and draw at
+    that level, and tessellation() how finely to draw its meshes. The
+    primary always steps every flake on every call, so what snapshots
+    and replays see does not depend on the view. A globe only moves
+    to another level once its size is LOD_HYSTERESIS past the threshold
+    between them, so one sitting on a threshold does not flip every frame
+    as the camera drifts.
+
+    Nothing here touches GL; the matrices come in as float arrays. step()
+    and the input calls may run on a simulation thread while
+    updateVisibility() runs on the render thread: step() only sees the
+    visibility through atomic flags, and the render side only reads the
+    layout and its own fields of Globe.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class SnowSim;
+class ThreadPool;
+
+class GlobeScene {
+public:
+    static const int LOD_LEVELS = 4;
+    static const unsigned OFFSCREEN_STEP_INTERVAL = 4;
+
+    // Share of a level threshold a globe's screen radius must cross it by
+    static constexpr float LOD_HYSTERESIS = 0.15f;
+
+    // Distance between neighbouring globe centres
+    static constexpr float SPACING_X = 12.0f;
+    static constexpr float SPACING_Y = 13.0f;
+
+    // Radius of a sphere around the globe centre holding the glass and the
+    // base, and how far below the centre it is
+    static constexpr float BOUNDS_RADIUS = 7.5f;
+    static constexpr float BOUNDS_DROP = 0.6f;
+
+    struct Globe {
+        SnowSim* sim = nullptr;
+        float x = 0.0f, y = 0.0f;   // Centre on the wall
+        bool visible = true;        // Render side; step() reads a copy
+        int lod = 0;
+        float screenRadius = 0.0f;  // Projected glass radius in pixels
+        unsigned offscreenSteps = 0;
+    };
+
+    // Lay count globes out around primary, which must be initialized.
+    // The rest get primary's settings and seeds following its own. With
+    // more than one globe the sims run serially and unprofiled, since
+    // they step in parallel with each other.
+    void init(SnowSim& primary, int count);
+
+    size_t size() const { return globes.size(); }
+    Globe& operator[](size_t i) { return globes[i]; }
+    const Globe& operator[](size_t i) const { return globes[i]; }
+
+    // Half the width or height of the wall, whichever is larger
+    float extent() const;
+
+    // Advance every globe by dt seconds, on pool if there is one
+    void step(float dt, ThreadPool* pool);
+
+    // Cull the globes against the frustum of projection * modelview
+    // (column major) and pick each one's level of detail for a viewport
+    // height pixels tall
+    void updateVisibility(const float* projection, const float* modelview, int height);
+
+    // Globes drawn by the last updateVisibility(), and how many at each level
+    size_t visibleCount() const;
+    size_t lodCount(int lod) const;
+
+    // Flakes stepped and drawn at lod, out of flakes
+    static size_t flakeLimit(size_t flakes, int lod);
+
+    // Slices or stacks for a mesh built with full of them at level 0
+    static int tessellation(int full, int lod);
+
+    // Input, applied to every globe
+    void shake();
+    void toggleNightMode();
+    void spinGlobe(float speed);
+
+private:
+    std::vector<Globe> globes;
+    std::vector<std::unique_ptr<SnowSim>> ownSims; // Every globe past the first
+    std::vector<std::atomic<bool>> onScreen;        // Globe::visible, for step()
+    std::vector<std::atomic<int>> onScreenLod;      // Globe::lod, for step()
+    int columns = 1;
+    int rows = 1;
+};
@@ -0,0 +1,70 @@
+#include "GpuProfiler.h"
+
+void GpuProfiler::init() {
+    available = gl.hasTimerQuery;
+    running = false;
+}
+
+void GpuProfiler::destroy() {
+    if (available) {
+        for (size_t i = 0; i < pending.size(); ++i) gl.DeleteQueries(1, &pending[i].query);
+        if (!spare.empty()) gl.DeleteQueries((GLsizei)spare.size(), spare.data());
+    }
+    pending.clear();
+    spare.clear();
+    available = false;
+    running = false;
+}
+
+bool GpuProfiler::begin(FrameProfiler& profiler, int phase) {
+    if (!available || running || !profiler.enabled || phase < 0) return false;
+
+    GLuint query = 0;
+    if (!spare.empty()) {
+        query = spare.back();
+        spare.pop_back();
+    }
+    else {
+        gl.GenQueries(1, &query);
+    }
+
+    active = { query, phase, profiler.currentFrame(), profiler.now() };
+    gl.BeginQuery(GL_TIME_ELAPSED, query);
+    running = true;
+    return true;
+}
+
+void GpuProfiler::end() {
+    if (!running) return;
+    gl.EndQuery(GL_TIME_ELAPSED);
+    pending.push_back(active);
+    running = false;
+}
+
+void GpuProfiler::collect(FrameProfiler& profiler) {
+    if (!available) return;
+
+    // Queries finish in order, so stop at the first one still in flight
+    size_t done = 0;
+    for (; done < pending.size(); ++done) {
+        const Query& q = pending[done];
+        GLint ready = 0;
+        gl.GetQueryObjectiv(q.query, GL_QUERY_RESULT_AVAILABLE, &ready);
+        if (!ready) break;
+
+        GLuint64 ns = 0;
+        gl.GetQueryObjectui64v(q.query, GL_QUERY_RESULT, &ns);
+        profiler.recordGpu(q.phase, q.frame, q.cpuStart, ns / 1.0e6);
+        spare.push_back(q.query);
+    }
+    pending.erase(pending.begin(), pending.begin() + done);
+}
+
+GpuProfileScope::GpuProfileScope(FrameProfiler& profiler, GpuProfiler& gpu, int phase)
+    : gpu(gpu), cpu(&profiler, phase) {
+    started = gpu.begin(profiler, phase);
+}
+
+GpuProfileScope::~GpuProfileScope() {
+    if (started) gpu.end();
+}
@@ -0,0 +1,61 @@
+/*
+    GPU side of the frame profiler: GL_TIME_ELAPSED queries around the
+    drawing phases.
+
+    Results are not read back until the GPU has them (a frame or two
+    later), so timing never stalls the pipeline; collect() hands finished
+    ones to FrameProfiler under the frame that issued them. Only one
+    elapsed-time query can run at a time, so nested begin() calls are
+    ignored and report it, and only the outer scope's end() stops the
+    query. Does nothing without timer query support.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "FrameProfiler.h"
+#include "SnowGL.h"
+
+class GpuProfiler {
+public:
+    // Needs a current context and loadGLFunctions() done
+    void init();
+    void destroy();
+
+    bool isAvailable() const { return available; }
+
+    // True if this started a query, which end() then stops; false when
+    // unavailable, disabled or nested in another query
+    bool begin(FrameProfiler& profiler, int phase);
+    void end();
+
+    // Pass finished queries to the profiler; call once per frame
+    void collect(FrameProfiler& profiler);
+
+private:
+    struct Query {
+        GLuint query;
+        int phase;
+        uint64_t frame;
+        int64_t cpuStart;
+    };
+
+    bool available = false;
+    bool running = false;
+    Query active;
+    std::vector<Query> pending;
+    std::vector<GLuint> spare;
+};
+
+// Times a block on the CPU and, where supported, on the GPU
+class GpuProfileScope {
+public:
+    GpuProfileScope(FrameProfiler& profiler, GpuProfiler& gpu, int phase);
+    ~GpuProfileScope();
+
+private:
+    GpuProfiler& gpu;
+    ProfileScope cpu;
+    bool started; // Whether this scope's begin() started the query
+};
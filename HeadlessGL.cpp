@@ -0,0 +1,87 @@
+#include "HeadlessGL.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Mesa's surfaceless platform needs no window system at all; fall back
+// to the default display when the library lacks it
+static EGLDisplay openDisplay() {
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    bool noWindowSystem = !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY");
+    if (noWindowSystem && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) return display;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool HeadlessGL::create(int w, int h) {
+    destroy();
+
+    EGLDisplay eglDisplay = openDisplay();
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr)) {
+        fprintf(stderr, "Headless: no EGL display\n");
+        return false;
+    }
+    display = eglDisplay;
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        fprintf(stderr, "Headless: no EGL config with an RGBA8 + depth pbuffer\n");
+        destroy();
+        return false;
+    }
+
+    const EGLint surfaceAttribs[] = { EGL_WIDTH, w, EGL_HEIGHT, h, EGL_NONE };
+    EGLSurface eglSurface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttribs);
+    if (eglSurface == EGL_NO_SURFACE) {
+        fprintf(stderr, "Headless: could not create a %dx%d pbuffer\n", w, h);
+        destroy();
+        return false;
+    }
+    surface = eglSurface;
+
+    // The renderers use fixed-function GL, so ask for desktop GL rather than ES
+    eglBindAPI(EGL_OPENGL_API);
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, nullptr);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+        fprintf(stderr, "Headless: could not create a GL context\n");
+        if (eglContext != EGL_NO_CONTEXT) eglDestroyContext(eglDisplay, eglContext);
+        destroy();
+        return false;
+    }
+    context = eglContext;
+
+    width = w;
+    height = h;
+    return true;
+}
+
+void HeadlessGL::destroy() {
+    if (!display) return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context) eglDestroyContext(display, context);
+    if (surface) eglDestroySurface(display, surface);
+    eglTerminate(display);
+    display = surface = context = nullptr;
+    width = height = 0;
+}
+
+SnowGLGetProcAddress HeadlessGL::procAddress() {
+    return (SnowGLGetProcAddress)eglGetProcAddress;
+}
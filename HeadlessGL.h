@@ -0,0 +1,35 @@
+/*
+    Offscreen GL context for rendering with no display, e.g. under Mesa's
+    llvmpipe on a build server.
+
+    The context is a desktop (compatibility) GL context on an EGL pbuffer
+    surface of a fixed size; the default framebuffer is the pbuffer, so
+    the globe draws into it exactly as it would into a window. With no X
+    or Wayland display, Mesa's surfaceless platform is used when the EGL
+    library offers it.
+*/
+
+#pragma once
+
+#include "SnowGL.h"
+
+class HeadlessGL {
+public:
+    ~HeadlessGL() { destroy(); }
+
+    // Create the context and make it current; prints why and returns
+    // false when no suitable EGL display or config exists
+    bool create(int width, int height);
+    void destroy();
+
+    // For loadGLFunctions()
+    static SnowGLGetProcAddress procAddress();
+
+    int width = 0;
+    int height = 0;
+
+private:
+    void* display = nullptr;
+    void* surface = nullptr;
+    void* context = nullptr;
+};
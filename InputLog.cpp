@@ -0,0 +1,181 @@
+#include "InputLog.h"
+
+#include <cstring>
+
+static const char MAGIC[8] = { 'S', 'N', 'O', 'W', 'L', 'O', 'G', '3' };
+
+int InputEvent::argCount(Type type) {
+    switch (type) {
+    case KEY:
+    case SPECIAL_KEY:
+        return 3;
+    case MOUSE_BUTTON:
+        return 4;
+    case MOUSE_MOTION:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+// Fixed-width fields are written byte by byte so the file reads the same
+// on any host
+static void putU64(std::vector<unsigned char>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+static uint64_t zigzag(int32_t value) {
+    return ((uint64_t)(uint32_t)value << 1) ^ (uint64_t)(int64_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint64_t value) {
+    return (int32_t)((uint32_t)(value >> 1) ^ (uint32_t)-(int64_t)(value & 1));
+}
+
+bool InputRecorder::open(const char* path, const InputLogHeader& header) {
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+
+    std::vector<unsigned char> bytes(MAGIC, MAGIC + sizeof(MAGIC));
+    putU64(bytes, header.seed);
+    putU64(bytes, header.flakes);
+    putU64(bytes, header.stars);
+    uint32_t rate;
+    memcpy(&rate, &header.stepRate, sizeof(rate));
+    for (int i = 0; i < 4; ++i) bytes.push_back((unsigned char)(rate >> (8 * i)));
+    for (int i = 0; i < 4; ++i) bytes.push_back((unsigned char)(header.fluidCells >> (8 * i)));
+    bytes.push_back(header.fromSnapshot ? 1 : 0);
+    bytes.push_back(header.onGpu ? 1 : 0);
+    failed = fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size();
+    lastStep = 0;
+    return !failed;
+}
+
+void InputRecorder::writeVarint(uint64_t value) {
+    unsigned char bytes[10];
+    int n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        ++n;
+    } while (value);
+    if (fwrite(bytes, 1, n, file) != (size_t)n) failed = true;
+}
+
+void InputRecorder::record(uint64_t step, InputEvent::Type type, int32_t a, int32_t b, int32_t c, int32_t d) {
+    if (!file) return;
+    writeVarint(step - lastStep);
+    lastStep = step;
+    if (fputc(type, file) == EOF) failed = true;
+
+    int32_t args[4] = { a, b, c, d };
+    for (int i = 0; i < InputEvent::argCount(type); ++i) {
+        writeVarint(zigzag(args[i]));
+    }
+}
+
+bool InputRecorder::close(uint64_t step, uint64_t checksum) {
+    if (!file) return false;
+    writeVarint(step - lastStep);
+    if (fputc(InputEvent::END, file) == EOF) failed = true;
+
+    std::vector<unsigned char> bytes;
+    putU64(bytes, checksum);
+    if (fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) failed = true;
+    if (fclose(file) != 0) failed = true;
+    file = nullptr;
+    return !failed;
+}
+
+// Bounds-checked cursor over the loaded file
+struct LogReader {
+    const unsigned char* pos;
+    const unsigned char* end;
+    bool ok = true;
+
+    uint64_t fixed(int bytes) {
+        if (end - pos < bytes) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) value |= (uint64_t)pos[i] << (8 * i);
+        pos += bytes;
+        return value;
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == end) break;
+            unsigned char byte = *pos++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+};
+
+bool InputLog::load(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    fclose(file);
+
+    if (bytes.size() < sizeof(MAGIC) || memcmp(bytes.data(), MAGIC, sizeof(MAGIC) - 1) != 0) {
+        fprintf(stderr, "%s is not a snow globe input log\n", path);
+        return false;
+    }
+    if (bytes[sizeof(MAGIC) - 1] != (unsigned char)MAGIC[sizeof(MAGIC) - 1]) {
+        fprintf(stderr, "%s is a version %c input log (this build reads version %c)\n",
+            path, bytes[sizeof(MAGIC) - 1], MAGIC[sizeof(MAGIC) - 1]);
+        return false;
+    }
+
+    LogReader in = { bytes.data() + sizeof(MAGIC), bytes.data() + bytes.size() };
+    header.seed = in.fixed(8);
+    header.flakes = in.fixed(8);
+    header.stars = in.fixed(8);
+    uint32_t rate = (uint32_t)in.fixed(4);
+    memcpy(&header.stepRate, &rate, sizeof(rate));
+    header.fluidCells = (uint32_t)in.fixed(4);
+    header.fromSnapshot = in.fixed(1) != 0;
+    header.onGpu = in.fixed(1) != 0;
+
+    events.clear();
+    uint64_t step = 0;
+    while (in.ok) {
+        step += in.varint();
+        uint64_t type = in.fixed(1);
+        if (!in.ok || type > InputEvent::END) break;
+
+        if (type == InputEvent::END) {
+            endStep = step;
+            checksum = in.fixed(8);
+            if (in.ok) return true;
+            break;
+        }
+
+        InputEvent event = { step, (InputEvent::Type)type, { 0, 0, 0, 0 } };
+        for (int i = 0; i < InputEvent::argCount(event.type); ++i) {
+            event.args[i] = unzigzag(in.varint());
+        }
+        events.push_back(event);
+    }
+
+    fprintf(stderr, "%s is cut off or damaged after %zu events\n", path, events.size());
+    return false;
+}
@@ -0,0 +1,90 @@
+/*
+    Compact binary log of a session's input, for replaying it exactly.
+
+    The frontend's handlers get the raw GLUT events (key, special key,
+    mouse button, mouse motion) stamped with the simulation step they
+    arrived before. Since the simulation is a pure function of its seed,
+    its settings and the input at each step, replaying the log through
+    the same handlers reproduces the same flake state on every run and
+    every machine, at whatever speed the replay runs.
+
+    File layout, all integers little-endian:
+        "SNOWLOG3"                              magic and version
+        u64 seed, u64 flakes, u64 stars         SnowSim settings
+        f32 physics steps per second
+        u32 water grid cells per side, 0 with the water off
+        u8 started from a snapshot, u8 started on the GPU (0 or 1)
+        events:  varint step delta, u8 type, zigzag varint per argument
+        end:     varint step delta, u8 END, u64 position checksum
+
+    The end record holds the step the session stopped at and
+    SnowSim::positionChecksum() there, so a replay can check it arrived
+    at the same state.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct InputEvent {
+    enum Type : uint8_t {
+        KEY,            // key, x, y
+        SPECIAL_KEY,    // key, x, y
+        MOUSE_BUTTON,   // button, state, x, y
+        MOUSE_MOTION,   // x, y
+        END
+    };
+
+    uint64_t step;  // Simulation steps taken before the event
+    Type type;
+    int32_t args[4];
+
+    static int argCount(Type type);
+};
+
+struct InputLogHeader {
+    uint64_t seed = 1;
+    uint64_t flakes = 0;
+    uint64_t stars = 0;
+    float stepRate = 60.0f;
+    uint32_t fluidCells = 0;
+    // A session that starts either way depends on more than the log
+    bool fromSnapshot = false;
+    bool onGpu = false;
+};
+
+// Writes a log as the session runs
+class InputRecorder {
+public:
+    ~InputRecorder() { if (file) fclose(file); }
+
+    bool open(const char* path, const InputLogHeader& header);
+    bool isOpen() const { return file != nullptr; }
+
+    void record(uint64_t step, InputEvent::Type type, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0);
+
+    // Write the end record and close; false if any write failed
+    bool close(uint64_t step, uint64_t checksum);
+
+private:
+    void writeVarint(uint64_t value);
+
+    FILE* file = nullptr;
+    uint64_t lastStep = 0;
+    bool failed = false;
+};
+
+// A whole log read back into memory
+class InputLog {
+public:
+    // Prints why and returns false for a missing, foreign or cut-off file
+    bool load(const char* path);
+
+    InputLogHeader header;
+    std::vector<InputEvent> events; // In order, END excluded
+    uint64_t endStep = 0;
+    uint64_t checksum = 0;
+};
@@ -0,0 +1,215 @@
+#include "MeshCache.h"
+
+#include <cmath>
+
+static const float TWO_PI = 6.28318530718f;
+
+void StaticMesh::draw() const {
+    if (displayList) {
+        glCallList(displayList);
+        return;
+    }
+    if (!vertexBuffer) return;
+
+    gl.BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), (const void*)0);
+    glNormalPointer(GL_FLOAT, 6 * sizeof(float), (const void*)(3 * sizeof(float)));
+
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const void*)0);
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Two triangles for the quad a-b-c-d (counter-clockwise)
+static void addQuad(std::vector<GLuint>& indices, GLuint a, GLuint b, GLuint c, GLuint d) {
+    indices.insert(indices.end(), { a, b, c, a, c, d });
+}
+
+const StaticMesh& MeshCache::sphere(float radius, int slices, int stacks) {
+    Key key(SPHERE, radius, 0.0f, slices, stacks);
+    auto it = meshes.find(key);
+    if (it != meshes.end()) return it->second;
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Latitude rings from the +z pole to the -z pole
+    for (int j = 0; j <= stacks; ++j) {
+        float phi = (float)M_PI * j / stacks;
+        for (int i = 0; i <= slices; ++i) {
+            float theta = TWO_PI * i / slices;
+            float nx = std::cos(theta) * std::sin(phi);
+            float ny = std::sin(theta) * std::sin(phi);
+            float nz = std::cos(phi);
+            vertices.push_back({ nx * radius, ny * radius, nz * radius, nx, ny, nz });
+        }
+    }
+    GLuint row = slices + 1;
+    for (int j = 0; j < stacks; ++j) {
+        for (int i = 0; i < slices; ++i) {
+            GLuint a = j * row + i;
+            addQuad(indices, a, a + row, a + row + 1, a + 1);
+        }
+    }
+    return upload(key, vertices, indices);
+}
+
+const StaticMesh& MeshCache::cylinder(float radius, float height, int slices) {
+    Key key(CYLINDER, radius, height, slices, 1);
+    auto it = meshes.find(key);
+    if (it != meshes.end()) return it->second;
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    for (int i = 0; i <= slices; ++i) {
+        float theta = TWO_PI * i / slices;
+        float nx = std::cos(theta);
+        float ny = std::sin(theta);
+        vertices.push_back({ nx * radius, ny * radius, 0.0f, nx, ny, 0.0f });
+        vertices.push_back({ nx * radius, ny * radius, height, nx, ny, 0.0f });
+    }
+    for (int i = 0; i < slices; ++i) {
+        GLuint a = i * 2;
+        addQuad(indices, a, a + 2, a + 3, a + 1);
+    }
+    return upload(key, vertices, indices);
+}
+
+const StaticMesh& MeshCache::disk(float radius, int slices) {
+    Key key(DISK, radius, 0.0f, slices, 1);
+    auto it = meshes.find(key);
+    if (it != meshes.end()) return it->second;
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    vertices.push_back({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f });
+    for (int i = 0; i <= slices; ++i) {
+        float theta = TWO_PI * i / slices;
+        vertices.push_back({ std::cos(theta) * radius, std::sin(theta) * radius, 0.0f, 0.0f, 0.0f, 1.0f });
+    }
+    for (int i = 0; i < slices; ++i) {
+        indices.insert(indices.end(), { 0, (GLuint)i + 1, (GLuint)i + 2 });
+    }
+    return upload(key, vertices, indices);
+}
+
+const StaticMesh& MeshCache::cone(float radius, float height, int slices, int stacks) {
+    Key key(CONE, radius, height, slices, stacks);
+    auto it = meshes.find(key);
+    if (it != meshes.end()) return it->second;
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Side normals lean up by the slope of the cone
+    float slant = std::sqrt(height * height + radius * radius);
+    float nr = height / slant;
+    float nz = radius / slant;
+
+    for (int j = 0; j <= stacks; ++j) {
+        float t = (float)j / stacks;
+        float r = radius * (1.0f - t);
+        for (int i = 0; i <= slices; ++i) {
+            float theta = TWO_PI * i / slices;
+            float c = std::cos(theta), s = std::sin(theta);
+            vertices.push_back({ c * r, s * r, t * height, c * nr, s * nr, nz });
+        }
+    }
+    GLuint row = slices + 1;
+    for (int j = 0; j < stacks; ++j) {
+        for (int i = 0; i < slices; ++i) {
+            GLuint a = j * row + i;
+            addQuad(indices, a, a + 1, a + row + 1, a + row);
+        }
+    }
+
+    // Base cap facing -z
+    GLuint center = (GLuint)vertices.size();
+    vertices.push_back({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f });
+    for (int i = 0; i <= slices; ++i) {
+        float theta = TWO_PI * i / slices;
+        vertices.push_back({ std::cos(theta) * radius, std::sin(theta) * radius, 0.0f, 0.0f, 0.0f, -1.0f });
+    }
+    for (int i = 0; i < slices; ++i) {
+        indices.insert(indices.end(), { center, center + i + 2, center + i + 1 });
+    }
+    return upload(key, vertices, indices);
+}
+
+const StaticMesh& MeshCache::cube(float size) {
+    Key key(CUBE, size, 0.0f, 0, 0);
+    auto it = meshes.find(key);
+    if (it != meshes.end()) return it->second;
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Four vertices per face for flat normals, counter-clockwise from outside
+    static const float faces[6][5][3] = {
+        { { 1, 0, 0 }, { 1, -1, -1 }, { 1, 1, -1 }, { 1, 1, 1 }, { 1, -1, 1 } },
+        { { -1, 0, 0 }, { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, 1 }, { -1, 1, -1 } },
+        { { 0, 1, 0 }, { -1, 1, -1 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } },
+        { { 0, -1, 0 }, { -1, -1, -1 }, { 1, -1, -1 }, { 1, -1, 1 }, { -1, -1, 1 } },
+        { { 0, 0, 1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } },
+        { { 0, 0, -1 }, { -1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 }, { 1, -1, -1 } },
+    };
+    float h = size * 0.5f;
+    for (const auto& face : faces) {
+        const float* n = face[0];
+        GLuint base = (GLuint)vertices.size();
+        for (int c = 1; c <= 4; ++c) {
+            vertices.push_back({ face[c][0] * h, face[c][1] * h, face[c][2] * h, n[0], n[1], n[2] });
+        }
+        addQuad(indices, base, base + 1, base + 2, base + 3);
+    }
+    return upload(key, vertices, indices);
+}
+
+const StaticMesh& MeshCache::upload(const Key& key, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) {
+    StaticMesh& mesh = meshes[key];
+    mesh.indexCount = (GLsizei)indices.size();
+
+    if (gl.hasBuffers) {
+        gl.GenBuffers(1, &mesh.vertexBuffer);
+        gl.BindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+        gl.BufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+        gl.GenBuffers(1, &mesh.indexBuffer);
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+        gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    else {
+        // GL 1.1 fallback: record the triangles once into a display list
+        mesh.displayList = glGenLists(1);
+        glNewList(mesh.displayList, GL_COMPILE);
+        glBegin(GL_TRIANGLES);
+        for (GLuint index : indices) {
+            const Vertex& v = vertices[index];
+            glNormal3f(v.nx, v.ny, v.nz);
+            glVertex3f(v.px, v.py, v.pz);
+        }
+        glEnd();
+        glEndList();
+    }
+    return mesh;
+}
+
+void MeshCache::clear() {
+    for (auto& entry : meshes) {
+        StaticMesh& mesh = entry.second;
+        if (mesh.vertexBuffer) gl.DeleteBuffers(1, &mesh.vertexBuffer);
+        if (mesh.indexBuffer) gl.DeleteBuffers(1, &mesh.indexBuffer);
+        if (mesh.displayList) glDeleteLists(mesh.displayList, 1);
+    }
+    meshes.clear();
+}
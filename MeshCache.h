@@ -0,0 +1,57 @@
+/*
+    Cache of static, pre-tessellated meshes for the scene primitives.
+
+    Each primitive (sphere, cylinder, disk, cone, cube) is tessellated once
+    per distinct set of parameters, the first time it is asked for, into a
+    vertex and index buffer (or a display list when buffer objects are not
+    available). Drawing it again is one glDrawElements with the current
+    transform and color, instead of regenerating every vertex on the CPU
+    the way gluCylinder/glutSolidSphere do.
+
+    Shapes match the GLU/GLUT ones they replace: spheres and cones are built
+    around the z axis, cylinders and cones extend along +z from z = 0, and
+    disks lie in the z = 0 plane facing +z.
+*/
+
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include "SnowGL.h"
+
+struct StaticMesh {
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint displayList = 0;
+    GLsizei indexCount = 0;
+
+    // Draw with the current matrix, color and material
+    void draw() const;
+};
+
+class MeshCache {
+public:
+    const StaticMesh& sphere(float radius, int slices, int stacks);
+    const StaticMesh& cylinder(float radius, float height, int slices);
+    const StaticMesh& disk(float radius, int slices);
+    const StaticMesh& cone(float radius, float height, int slices, int stacks);
+    const StaticMesh& cube(float size);
+
+    // Release every cached mesh; needs the context they were built in
+    void clear();
+
+private:
+    // Interleaved position + normal
+    struct Vertex {
+        float px, py, pz;
+        float nx, ny, nz;
+    };
+
+    enum Shape { SPHERE, CYLINDER, DISK, CONE, CUBE };
+    typedef std::tuple<int, float, float, int, int> Key;
+
+    const StaticMesh& upload(const Key& key, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+
+    std::map<Key, StaticMesh> meshes;
+};
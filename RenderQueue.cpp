@@ -0,0 +1,269 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include "ThreadPool.h"
+
+static const int RADIX_BITS = 8;
+static const int RADIX = 1 << RADIX_BITS;
+static const int DEPTH_BITS = 16;
+static const int PROGRAM_SLOTS = 63;
+
+// Run fn over [0, count) in blocks of grain, on the pool if there is one
+static void forBlocks(ThreadPool* pool, size_t count, size_t grain, const ThreadPool::RangeFunc& fn) {
+    if (pool && grain < count) {
+        pool->parallelFor(count, grain, fn);
+    }
+    else if (count > 0) {
+        fn(0, count);
+    }
+}
+
+// 16 bits of FNV-1a over the color and emission, so equal materials get
+// equal keys
+static uint16_t materialBits(const RenderCommand& command) {
+    float material[7];
+    std::memcpy(material, command.color, sizeof(command.color));
+    std::memcpy(material + 4, command.emission, sizeof(command.emission));
+    const unsigned char* bytes = (const unsigned char*)material;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(material); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+// Program slot in the top 6 bits, then the fixed-function switches
+uint64_t RenderQueue::stateBits(const RenderState& state) {
+    uint64_t slot = 0;
+    if (state.program) {
+        auto found = std::find(programs.begin(), programs.end(), state.program);
+        if (found == programs.end()) {
+            programs.push_back(state.program);
+            found = programs.end() - 1;
+        }
+        slot = std::min<uint64_t>(found - programs.begin() + 1, PROGRAM_SLOTS);
+    }
+    uint64_t cull = state.cullFace == GL_FRONT ? 1 : state.cullFace == GL_BACK ? 2 : 0;
+    return slot << 10 | (uint64_t)state.lit << 9 | (uint64_t)state.depthTest << 8 |
+        (uint64_t)state.depthWrite << 7 | (uint64_t)state.twoSided << 6 | cull << 4;
+}
+
+void RenderQueue::submit(const RenderCommand& command) {
+    float m[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, m);
+    commands.push_back(command);
+    matrices.insert(matrices.end(), m, m + 16);
+
+    // Translucent things never hide each other
+    RenderCommand& queued = commands.back();
+    if (queued.pass == PASS_TRANSPARENT) {
+        queued.state.depthWrite = false;
+        queued.state.twoSided = true;
+    }
+
+    // The camera looks down -z, so the origin's distance is -z
+    depths.push_back(-m[14] + command.depthOffset);
+    states.push_back((uint16_t)stateBits(queued.state));
+    materials.push_back(materialBits(queued));
+}
+
+void RenderQueue::sort(ThreadPool* pool) {
+    size_t count = commands.size();
+    order.resize(count);
+    scratch.resize(count);
+
+    // One block per call on small queues
+    size_t grain = count;
+    if (pool && count >= PARALLEL_ITEMS) {
+        grain = std::max(PARALLEL_ITEMS / 2, count / (pool->size() * 4) + 1);
+    }
+    size_t blocks = (count + grain - 1) / grain;
+    blockCounts.resize(blocks * RADIX);
+
+    // Quantize over this frame's range: opaque nearest first, transparent
+    // farthest first
+    float nearest = *std::min_element(depths.begin(), depths.end());
+    float farthest = *std::max_element(depths.begin(), depths.end());
+    float scale = farthest > nearest ? ((1 << DEPTH_BITS) - 1) / (farthest - nearest) : 0.0f;
+    forBlocks(pool, count, grain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t key;
+            if (commands[i].pass == PASS_TRANSPARENT) {
+                uint64_t depth = (uint64_t)((farthest - depths[i]) * scale);
+                key = (uint64_t)PASS_TRANSPARENT << 62 | depth << 46 | (uint64_t)states[i] << 30 |
+                    (uint64_t)materials[i] << 14;
+            }
+            else {
+                uint64_t depth = (uint64_t)((depths[i] - nearest) * scale);
+                key = (uint64_t)PASS_OPAQUE << 62 | (uint64_t)states[i] << 46 | (uint64_t)materials[i] << 30 |
+                    depth << 14;
+            }
+            order[i] = { key, (uint32_t)i };
+        }
+    });
+
+    // Digits that are the same in every key leave the order as it is
+    uint64_t varying = 0;
+    for (size_t i = 1; i < count; ++i) varying |= order[i].key ^ order[0].key;
+
+    for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+        if (((varying >> shift) & (RADIX - 1)) == 0) continue;
+
+        // Count digits per block
+        forBlocks(pool, count, grain, [&](size_t begin, size_t end) {
+            uint32_t* counts = &blockCounts[begin / grain * RADIX];
+            std::fill(counts, counts + RADIX, 0);
+            for (size_t i = begin; i < end; ++i) ++counts[(order[i].key >> shift) & (RADIX - 1)];
+        });
+
+        // Exclusive prefix sum, digit-major so each block writes after
+        // the blocks before it within every digit
+        uint32_t total = 0;
+        for (int digit = 0; digit < RADIX; ++digit) {
+            for (size_t block = 0; block < blocks; ++block) {
+                uint32_t n = blockCounts[block * RADIX + digit];
+                blockCounts[block * RADIX + digit] = total;
+                total += n;
+            }
+        }
+
+        // Scatter, each block from its own offsets
+        forBlocks(pool, count, grain, [&](size_t begin, size_t end) {
+            uint32_t* offsets = &blockCounts[begin / grain * RADIX];
+            for (size_t i = begin; i < end; ++i) {
+                scratch[offsets[(order[i].key >> shift) & (RADIX - 1)]++] = order[i];
+            }
+        });
+        order.swap(scratch);
+    }
+}
+
+// GL state as flush() last set it, so unchanged values cost nothing
+struct RenderStateCache {
+    RenderState state;
+    bool cullEnabled = false;
+    GLenum cullFace = GL_BACK;
+    float color[4];
+    float emission[3] = { 0.0f, 0.0f, 0.0f };
+    bool colorKnown = false;
+    RenderStats* stats;
+
+    explicit RenderStateCache(RenderStats* stats) : stats(stats) {}
+
+    void enable(GLenum cap, bool& current, bool wanted) {
+        if (current == wanted) {
+            ++stats->redundant;
+            return;
+        }
+        if (wanted) {
+            glEnable(cap);
+        }
+        else {
+            glDisable(cap);
+        }
+        current = wanted;
+        ++stats->stateChanges;
+    }
+
+    void apply(const RenderState& wanted) {
+        if (state.program != wanted.program) {
+            gl.UseProgram(wanted.program);
+            state.program = wanted.program;
+            ++stats->stateChanges;
+        }
+        else {
+            ++stats->redundant;
+        }
+        enable(GL_LIGHTING, state.lit, wanted.lit);
+        enable(GL_DEPTH_TEST, state.depthTest, wanted.depthTest);
+        if (state.depthWrite != wanted.depthWrite) {
+            glDepthMask(wanted.depthWrite ? GL_TRUE : GL_FALSE);
+            state.depthWrite = wanted.depthWrite;
+            ++stats->stateChanges;
+        }
+        else {
+            ++stats->redundant;
+        }
+        if (state.twoSided != wanted.twoSided) {
+            glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, wanted.twoSided ? GL_TRUE : GL_FALSE);
+            state.twoSided = wanted.twoSided;
+            ++stats->stateChanges;
+        }
+        else {
+            ++stats->redundant;
+        }
+        enable(GL_CULL_FACE, cullEnabled, wanted.cullFace != 0);
+        if (wanted.cullFace && cullFace != wanted.cullFace) {
+            glCullFace(wanted.cullFace);
+            cullFace = wanted.cullFace;
+            ++stats->stateChanges;
+        }
+        state.cullFace = wanted.cullFace;
+    }
+
+    void material(const RenderCommand& command) {
+        if (colorKnown && std::equal(command.color, command.color + 4, color)) {
+            ++stats->redundant;
+        }
+        else {
+            glColor4fv(command.color);
+            std::copy(command.color, command.color + 4, color);
+            colorKnown = true;
+            ++stats->stateChanges;
+        }
+        if (std::equal(command.emission, command.emission + 3, emission)) {
+            ++stats->redundant;
+        }
+        else {
+            GLfloat value[] = { command.emission[0], command.emission[1], command.emission[2], 1.0f };
+            glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, value);
+            std::copy(command.emission, command.emission + 3, emission);
+            ++stats->stateChanges;
+        }
+    }
+};
+
+void RenderQueue::flush(ThreadPool* pool) {
+    lastStats = RenderStats();
+    if (commands.empty()) return;
+    sort(pool);
+    lastStats.commands = commands.size();
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    RenderStateCache cache(&lastStats);
+    for (const Entry& entry : order) {
+        const RenderCommand& command = commands[entry.index];
+        glLoadMatrixf(&matrices[entry.index * 16]);
+        cache.apply(command.state);
+        cache.material(command);
+        if (command.drawBatch) {
+            command.drawBatch();
+            lastStats.triangles += command.triangles;
+
+            // The batch may have left any color or emission behind
+            cache.colorKnown = false;
+            cache.emission[0] = -1.0f;
+        }
+        else {
+            command.mesh->draw();
+            lastStats.triangles += command.mesh->indexCount / 3;
+        }
+    }
+
+    // Back to the resting state; not counted, it is the same every frame
+    RenderStats counted = lastStats;
+    RenderCommand rest;
+    cache.apply(rest.state);
+    cache.material(rest);
+    lastStats = counted;
+    glPopMatrix();
+
+    commands.clear();
+    matrices.clear();
+    depths.clear();
+    states.clear();
+    materials.clear();
+}
@@ -0,0 +1,129 @@
+/*
+    Every draw of the scene, recorded as a command during the scene walk
+    and submitted in one go at the end of the frame.
+
+    submit() takes a mesh (or a batch callback with its own buffers), the
+    state and material to draw it with, and the modelview matrix current
+    at the time, and draws nothing. flush() gives every command a 64-bit
+    sort key, sorts, and draws in key order through a cache of the GL
+    state, so a state change costs a GL call only when it actually
+    changes something. The key is, most significant first:
+
+        pass (2) | state (16) | material (16) | depth (16)   opaque
+        pass (2) | depth (16) | state (16) | material (16)   transparent
+
+    Opaque commands are grouped by program and fixed-function state, then
+    by color and emission, then drawn front to back so the depth test
+    rejects what is hidden early. Transparent ones must go back to front
+    whatever their state, so there depth comes first: they are drawn with
+    depth testing on and depth writes off, so translucent things are
+    hidden behind solid ones but never hide each other. A closed shell
+    around other transparent things (the glass) goes in twice: its inside
+    faces at its far side and its outside faces at its near side, so
+    whatever is inside lands between the two.
+
+    Depths are quantized to 16 bits over the frame's own near-far range.
+    The key only decides the order; the cache compares the real state, so
+    two programs or materials sharing a key slot still draw correctly.
+
+    The sort is an LSD radix sort, 8 bits per pass, skipping the digits
+    that are the same in every key. It is stable, so commands with equal
+    keys keep their submission order. Past PARALLEL_ITEMS each pass runs
+    in blocks across the thread pool: every block histograms its keys,
+    one prefix sum over (digit, block) gives every block its own output
+    offsets, and the blocks scatter in parallel. The order still comes out
+    the same on any thread count.
+
+    Between flushes GL is left in the resting state the frontend sets up:
+    no program, lighting, depth test and depth writes on, one-sided
+    lighting, no culling, no emission.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "MeshCache.h"
+
+class ThreadPool;
+
+enum RenderPass {
+    PASS_OPAQUE,
+    PASS_TRANSPARENT
+};
+
+// Program and fixed-function state a command draws with
+struct RenderState {
+    GLuint program = 0;         // 0 for fixed function
+    bool lit = true;
+    bool depthTest = true;
+    bool depthWrite = true;     // Always off for transparent commands
+    bool twoSided = false;      // Two-sided lighting; always on for transparent commands
+    GLenum cullFace = 0;        // GL_FRONT or GL_BACK to draw one side only
+
+    bool operator==(const RenderState& o) const {
+        return program == o.program && lit == o.lit && depthTest == o.depthTest &&
+            depthWrite == o.depthWrite && twoSided == o.twoSided && cullFace == o.cullFace;
+    }
+};
+
+// One draw. Color alpha is the blend weight.
+struct RenderCommand {
+    RenderPass pass = PASS_OPAQUE;
+    RenderState state;
+    const StaticMesh* mesh = nullptr;
+    float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float emission[3] = { 0.0f, 0.0f, 0.0f };
+    float depthOffset = 0.0f;   // Added to the view depth of the origin; + is farther
+
+    // Drawn instead of mesh when set, for batches with their own buffers
+    // or shader. Runs with the command's matrix, state and material set,
+    // and may change the current color and material but nothing else.
+    std::function<void()> drawBatch;
+    size_t triangles = 0;       // Drawn by drawBatch, for the stats; meshes count their own
+};
+
+// What the last flush() did
+struct RenderStats {
+    size_t commands = 0;
+    size_t stateChanges = 0;    // GL calls made to change state, program or material
+    size_t redundant = 0;       // Changes skipped because GL already had that value
+    size_t triangles = 0;
+};
+
+class RenderQueue {
+public:
+    // Below this many commands a pass runs on the calling thread alone
+    static const size_t PARALLEL_ITEMS = 8192;
+
+    // Queue command with the current modelview matrix
+    void submit(const RenderCommand& command);
+
+    // Sort, draw and empty the queue. pool may be null.
+    void flush(ThreadPool* pool);
+
+    size_t size() const { return commands.size(); }
+
+    RenderStats lastStats;
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    void sort(ThreadPool* pool);
+    uint64_t stateBits(const RenderState& state);
+
+    std::vector<RenderCommand> commands;
+    std::vector<float> matrices;    // 16 per command
+    std::vector<float> depths;
+    std::vector<uint16_t> states;
+    std::vector<uint16_t> materials;
+    std::vector<Entry> order;
+    std::vector<Entry> scratch;
+    std::vector<uint32_t> blockCounts;
+    std::vector<GLuint> programs;   // Seen so far; a program's key slot is its index + 1
+};
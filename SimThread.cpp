@@ -0,0 +1,78 @@
+#include "SimThread.h"
+
+#include "GlobeScene.h"
+#include "SnowClock.h"
+
+void SimThread::start(GlobeScene& scene, SnowClock& clock, StepFunc step, InputFunc input) {
+    stop();
+    this->scene = &scene;
+    this->clock = &clock;
+    this->step = step;
+    this->input = input;
+
+    // Every slot starts as the current state, so latest() always has one
+    auto now = std::chrono::steady_clock::now();
+    for (int i = 0; i < 3; ++i) publish(frames.slot(i), now);
+
+    running.store(true);
+    thread = std::thread(&SimThread::run, this);
+}
+
+void SimThread::stop() {
+    if (!thread.joinable()) return;
+    running.store(false);
+    thread.join();
+
+    InputEvent event;
+    while (inputs.pop(event)) input(event);
+}
+
+void SimThread::post(const InputEvent& event) {
+    while (!inputs.push(event)) std::this_thread::yield();
+}
+
+SimThread::Frame& SimThread::latest() {
+    frames.acquire();
+    return frames.front();
+}
+
+void SimThread::run() {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point last = Clock::now();
+    while (running.load(std::memory_order_relaxed)) {
+        // Whole steps since the last pass, each after the input that
+        // arrived before it
+        Clock::time_point now = Clock::now();
+        int steps = clock->advance(std::chrono::duration<float>(now - last).count());
+        last = now;
+        for (int i = 0; i < steps; ++i) {
+            InputEvent event;
+            while (inputs.pop(event)) input(event);
+            step();
+        }
+
+        float stepSeconds = clock->stepSeconds();
+        if (steps > 0) {
+            auto sinceStep = std::chrono::duration<float>(clock->alpha() * stepSeconds);
+            publish(frames.back(), now - std::chrono::duration_cast<Clock::duration>(sinceStep));
+            frames.publish();
+        }
+
+        // Sleep until the next step is due
+        std::this_thread::sleep_for(std::chrono::duration<float>((1.0f - clock->alpha()) * stepSeconds));
+    }
+}
+
+// Copy the scene into frame. The live fields' dirty marks are cleared
+// here since nobody else consumes them; the renderer finds what changed
+// with SnowGroundRenderer::markStale().
+void SimThread::publish(Frame& frame, std::chrono::steady_clock::time_point stepTime) {
+    GlobeScene& globes = *scene;
+    frame.globes.resize(globes.size());
+    for (size_t i = 0; i < globes.size(); ++i) {
+        frame.globes[i].copyState(*globes[i].sim);
+        frame.globes[i].snowField.clearDirty();
+        globes[i].sim->snowField.clearDirty();
+    }
+    frame.stepTime = stepTime;
+}
@@ -0,0 +1,90 @@
+/*
+    Runs the simulation of a GlobeScene on a thread of its own, so physics
+    and drawing overlap instead of taking turns: a frame costs the longer
+    of the two rather than their sum.
+
+    The thread steps the scene on its SnowClock's fixed steps, sleeping in
+    between, and after each batch of steps publishes a Frame, a copy of
+    every globe's state, through a TripleBuffer. The render thread takes
+    the newest complete Frame with latest() and draws from it for as long
+    as it likes; the sim thread meanwhile fills another. Neither waits on
+    the other.
+
+    Input goes the other way through an SpscQueue: the window thread
+    post()s events, and the sim thread hands each to the input function
+    right before the step it arrived before, the same place the
+    single-threaded loop applies it. Recording and anything else that
+    reads the simulation belongs in that function.
+
+    While running, the scene, its sims and the clock belong to the sim
+    thread, and so does the thread pool the scene steps on. Work that
+    needs both the sims and GL (a snapshot load, moving flakes to the GPU)
+    stops the thread, does it on the render thread and starts it again.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "InputLog.h"
+#include "SnowSim.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+class GlobeScene;
+class SnowClock;
+
+class SimThread {
+public:
+    static const size_t INPUT_CAPACITY = 1024;
+
+    // One published state of the whole scene
+    struct Frame {
+        std::vector<SnowSim> globes;    // Copies of the scene's sims (SnowSim::copyState)
+        std::chrono::steady_clock::time_point stepTime; // When the newest step was due
+    };
+
+    typedef std::function<void()> StepFunc;
+    typedef std::function<void(const InputEvent& event)> InputFunc;
+
+    SimThread() = default;
+    ~SimThread() { stop(); }
+
+    SimThread(const SimThread&) = delete;
+    SimThread& operator=(const SimThread&) = delete;
+
+    // Publish the scene as it stands and start stepping it: step() runs
+    // once per fixed step of clock, and input() once per posted event
+    void start(GlobeScene& scene, SnowClock& clock, StepFunc step, InputFunc input);
+
+    // Stop and join the thread. Events still queued are then passed to
+    // input() on the calling thread.
+    void stop();
+
+    bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+    // Window thread: queue an event for the sim thread. Only waits if the
+    // queue is full, which takes INPUT_CAPACITY events within one step.
+    void post(const InputEvent& event);
+
+    // Render thread: the newest published frame; never blocks
+    Frame& latest();
+
+private:
+    void run();
+    void publish(Frame& frame, std::chrono::steady_clock::time_point stepTime);
+
+    GlobeScene* scene = nullptr;
+    SnowClock* clock = nullptr;
+    StepFunc step;
+    InputFunc input;
+
+    std::thread thread;
+    std::atomic<bool> running { false };
+    TripleBuffer<Frame> frames;
+    SpscQueue<InputEvent, INPUT_CAPACITY> inputs;
+};
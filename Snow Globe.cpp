@@ -6,22 +6,135 @@
     Zoom in/out -> +/-
     Rotate View -> Left Click
     Rotate Globe -> Right Click   :)
+    Profiler HUD -> P
+    Save Chrome Trace -> T (snowglobe-trace.json)
+    Save / Load Snapshot -> K / L (snowglobe.snap)
+    Flake Physics on GPU / CPU -> G
+
+    Command line:
+    --seed N -> Random seed, for a reproducible snowfall
+    --flakes N -> Number of snowflakes (default 800)
+    --stars N -> Number of stars (default 200)
+    --fluid-cells N -> Cells per side of the water's velocity grid
+                       (default 32, 4 to 256); 0 turns the water off
+    --physics-hz N -> Physics steps per second (default 60)
+    --fps N -> Target frames per second (default 60)
+    --idle-fps N -> Frames per second once nothing but the twinkling,
+                    blinking and smoke moves (default 10); 0 stops
+                    drawing until the next key or mouse input
+    --string-lights N -> Hang a garland of N more lights around the hut
+    --globes N -> Show a wall of N globes, each with a snowfall of its own
+    --lockstep -> Step the simulation between frames on the GLUT thread
+                  instead of on a thread of its own
+    --gpu-sim -> Simulate flakes on the GPU (transform feedback) if the
+                 context can; G switches back and forth
+    --gpu-check N -> Run N steps on the CPU and on the GPU from the same
+                     start, with no window, and compare where the flakes
+                     end up (exit code 1 if the distributions differ)
+
+    Headless (no window or display; EGL pbuffer, e.g. Mesa llvmpipe):
+    --headless -> Render offscreen and stream the frames out
+    --frames N -> Frames to render (default 300)
+    --output PATH -> Where to write them, - for stdout (default -)
+    --format ppm|raw -> PPM stream or raw RGBA (default ppm)
+    --size WxH -> Frame size (default 800x600)
+    --shake -> Shake the globe on the first frame
+
+    Input logs (see InputLog.h):
+    --snapshot FILE -> Start from a saved snapshot, and save to and load
+                       from FILE with K and L
+    --record FILE -> Save this session's input, seed and settings
+    --replay FILE -> Rerun a saved session as fast as possible, with no
+                     window, and check it ends in the same state. With
+                     --headless the replay is rendered too.
 */
 
 #include <GL/glut.h>
+#include <GL/freeglut_ext.h>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <random>
-#include <ctime>
+#include <string>
+#include <vector>
+#include "ClusteredLights.h"
+#include "EffectsRenderer.h"
+#include "FrameCapture.h"
+#include "FramePacer.h"
+#include "FrameProfiler.h"
+#include "GlobeScene.h"
+#include "GpuProfiler.h"
+#include "HeadlessGL.h"
+#include "InputLog.h"
+#include "MeshCache.h"
+#include "RenderQueue.h"
+#include "SnowClock.h"
+#include "SnowGL.h"
+#include "SnowGpuSim.h"
+#include "SnowGroundRenderer.h"
+#include "SnowSim.h"
+#include "SnowSnapshot.h"
+#include "SimThread.h"
+#include "SnowflakeRenderer.h"
+#include "ThreadPool.h"
 
 // Window dimensions
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
 
-// Snow parameters
-const int NUM_SNOWFLAKES = 800;
-const float GLOBE_RADIUS = 5.0f;
+// Current framebuffer size, kept by reshape()
+int windowWidth = WINDOW_WIDTH;
+int windowHeight = WINDOW_HEIGHT;
+
+// Globe drawing parameters
 const float BASE_HEIGHT = 1.2f;
+const float HUT_Y = -GLOBE_RADIUS + 1.2f;
+
+// How far a hut light reaches onto the scene around it
+const float HUT_LIGHT_REACH = 1.5f;
+
+// The simulation being displayed, and the threads it updates flakes on
+SnowSim sim;
+ThreadPool threadPool;
+
+// Batched snowflake drawing
+SnowflakeRenderer snowRenderer;
+
+// Flake physics on the GPU, used instead of the CPU's when sim.cpuFlakes is off
+SnowGpuSim gpuSim;
+bool startOnGpu = false;
+
+// Twinkling stars, blinking hut lights and chimney smoke
+EffectsRenderer effectsRenderer;
+
+// Hut lights shading the snow, ground and hut, binned per view cluster
+ClusteredLights clusteredLights;
+int stringLights = 0;
+
+// Settled snow layer, updated tile by tile
+SnowGroundRenderer groundRenderer;
+
+// Every globe on display; the first one is sim
+GlobeScene scene;
+
+// The simulation's own thread, and the state of it being drawn (null
+// while the simulation steps on this thread)
+SimThread simThread;
+SimThread::Frame* simFrame = nullptr;
+bool lockstep = false;
+int globeCount = 1;
+std::vector<std::unique_ptr<SnowGroundRenderer>> extraGroundRenderers; // For globes past the first
+
+// Pre-tessellated scene geometry
+MeshCache meshes;
+
+// Every draw of the frame, sorted by state and depth before drawing
+RenderQueue renderQueue;
+RenderStats renderTotals; // Summed over headless frames
 
 // Camera variables
 float cameraDistance = 10.0f;
@@ -32,175 +145,158 @@ float cameraAngleY = 30.0f;
 int lastMouseX = 0;
 int lastMouseY = 0;
 bool mouseLeftDown = false;
-bool mouseRightDown = false;
-float rotationSpeed = 0.0f;
-float globeRotationY = 0.0f;
-bool isRotating = false;
-
-// Shaking variables
-bool isShaking = false;
-float shakeMagnitude = 0.0f;
-float shakeDecay = 0.95f;
-float maxShakeMagnitude = 1.0f;
-
-// Night mode variables
-bool isNightMode = false;
-float dayNightTransition = 0.0f; // 0.0 = day, 1.0 = night
-float transitionSpeed = 0.02f; // Speed of day/night transition
-
-// Star variables for night sky
-const int NUM_STARS = 200;
-struct Star {
-    float x, y, z;
-    float brightness;
-    float twinkleRate;
-    float twinkleOffset;
-};
-std::vector<Star> stars;
 
-// Time tracking
-int lastTime = 0;
-float deltaTime = 0.0f;
-float totalTime = 0.0f; // Total elapsed time for animations
-
-// Snowflake struct
-struct Snowflake {
-    float x, y, z;
-    float size;
-    float speed;
-    float angle; // Angle for particle rotation
-    float vx, vy, vz; // Velocity components
-    float sparkleRate; // Rate at which snowflake sparkles in night mode
-    float sparklePhase; // Phase offset for sparkling effect
-};
+// The mouse as the simulation has seen it, for spinning the globe
+int simMouseX = 0;
+bool simMouseLeftDown = false;
+bool simMouseRightDown = false;
 
-std::vector<Snowflake> snowflakes;
+// Time tracking: physics runs in fixed steps from simClock, frames are
+// drawn between them when framePacer says
+int lastTime = 0;
+float targetFps = 60.0f;
+SnowClock simClock;
+FramePacer framePacer;
+int frameTimerId = 0; // Only the newest update() timer draws; see scheduleUpdate()
+const float IDLE_DRIFTING_FRACTION = 0.01f; // Share of flakes in flight a still scene may have
+float renderAlpha = 1.0f; // How far the drawn frame is past the last step
+
+// Per-phase timing, shown on the HUD and saved as a Chrome trace
+FrameProfiler profiler;
+GpuProfiler gpuProfiler;
+bool showHud = false;
+int phaseSim, phaseLights, phaseScene, phaseDraw;
+
+// Input log being written, or being fed back through the handlers
+InputRecorder recorder;
+InputLog replayLog;
+bool replaying = false;
+size_t replayNext = 0;  // Next event of replayLog to apply
+bool haveWindow = false;
+bool haveGL = false;
+
+// Whole-globe snapshots, saved in the background
+std::string snapshotPath = "snowglobe.snap";
+bool startFromSnapshot = false;
+SnowSnapshotSaver snapshotSaver;
+
+void runSimSteps(int steps);
+void update(int timerId);
+void startSimThread();
+void stopSimThread();
+
+// Move flake physics to the GPU or back, carrying the flakes across
+bool setGpuSim(bool on) {
+    if (on == !sim.cpuFlakes) return true;
+    if (on) {
+        if (!gpuSim.isAvailable()) {
+            fprintf(stderr, "GPU flake physics needs transform feedback (GL 3.0)\n");
+            return false;
+        }
+        gpuSim.upload(sim);
+        sim.cpuFlakes = false;
+    }
+    else {
+        gpuSim.download(sim);
+        sim.cpuFlakes = true;
+    }
+    return true;
+}
 
-// Hut light struct
-struct HutLight {
-    float x, y, z; // Position
-    float r, g, b; // Color
-    float blinkRate; // How fast the light blinks (if it does)
-    float blinkPhase; // Phase offset for blinking
-    bool blinks; // Whether this light blinks or stays steady
-};
+// Hang count more lights in a rising spiral around the hut, just above
+// the snow, in a repeating red, green, blue, warm white string
+void addStringLights(SnowSim& target, int count) {
+    const float colors[4][3] = { { 1.0f, 0.1f, 0.1f }, { 0.1f, 1.0f, 0.2f }, { 0.2f, 0.4f, 1.0f }, { 1.0f, 0.8f, 0.5f } };
+    for (int i = 0; i < count; i++) {
+        float t = (i + 0.5f) / count;
+        float angle = t * 6.0f * (float)M_PI;
+        float radius = 1.2f + 2.0f * t;
+
+        // Follow the snow mound, which falls away from the hut
+        float ground = 0.6f * std::sqrt(std::max(0.0f, 1.0f - radius * radius / 16.0f)) - 0.7f;
+
+        HutLight light;
+        light.x = radius * cos(angle);
+        light.y = ground + 0.15f;
+        light.z = radius * sin(angle);
+        light.r = colors[i % 4][0];
+        light.g = colors[i % 4][1];
+        light.b = colors[i % 4][2];
+        light.blinkRate = 1.0f + (i % 7) * 0.3f;
+        light.blinkPhase = i * 0.7f;
+        light.blinks = (i % 3) != 0;
+        target.hutLights.push_back(light);
+    }
+}
 
-std::vector<HutLight> hutLights;
+// Settled snow renderer of globe i
+SnowGroundRenderer& groundRendererFor(size_t i) {
+    return i == 0 ? groundRenderer : *extraGroundRenderers[i - 1];
+}
 
-// Initialize stars for night sky
-void initStars() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> posDist(-20.0f, 20.0f);
-    std::uniform_real_distribution<float> heightDist(5.0f, 20.0f);
-    std::uniform_real_distribution<float> brightDist(0.5f, 1.0f);
-    std::uniform_real_distribution<float> rateDist(0.5f, 3.0f);
-    std::uniform_real_distribution<float> offsetDist(0.0f, 2.0f * M_PI);
-
-    stars.clear();
-    for (int i = 0; i < NUM_STARS; ++i) {
-        Star star;
-        star.x = posDist(gen);
-        star.y = heightDist(gen);
-        star.z = posDist(gen);
-        star.brightness = brightDist(gen);
-        star.twinkleRate = rateDist(gen);
-        star.twinkleOffset = offsetDist(gen);
-        stars.push_back(star);
-    }
-}
-
-// Initialize hut lights
-void initHutLights() {
-    hutLights.clear();
-
-    // Lights around the door
-    HutLight doorLight1 = { 0.2f, -0.1f, 0.55f, 1.0f, 0.8f, 0.0f, 1.5f, 0.0f, false }; // Steady yellow
-    HutLight doorLight2 = { -0.2f, -0.1f, 0.55f, 1.0f, 0.8f, 0.0f, 1.5f, 0.0f, false }; // Steady yellow
-    hutLights.push_back(doorLight1);
-    hutLights.push_back(doorLight2);
-
-    // Window lights
-    HutLight windowLight1 = { 0.4f, 0.1f, 0.55f, 0.9f, 0.9f, 0.7f, 0.0f, 0.0f, false }; // Steady warm white
-    HutLight windowLight2 = { -0.4f, 0.1f, 0.55f, 0.9f, 0.9f, 0.7f, 0.0f, 0.0f, false }; // Steady warm white
-    hutLights.push_back(windowLight1);
-    hutLights.push_back(windowLight2);
-
-    // Roof decoration lights
-    for (int i = 0; i < 8; i++) {
-        float angle = i * (2.0f * M_PI / 8.0f);
-        HutLight roofLight;
-        roofLight.x = 0.7f * cos(angle);
-        roofLight.y = 0.3f;
-        roofLight.z = 0.7f * sin(angle);
-
-        // Alternating colors
-        if (i % 3 == 0) {
-            roofLight.r = 1.0f;
-            roofLight.g = 0.0f;
-            roofLight.b = 0.0f; // Red
-        }
-        else if (i % 3 == 1) {
-            roofLight.r = 0.0f;
-            roofLight.g = 1.0f;
-            roofLight.b = 0.0f; // Green
-        }
-        else {
-            roofLight.r = 0.0f;
-            roofLight.g = 0.5f;
-            roofLight.b = 1.0f; // Blue
-        }
+// State of globe i to draw
+SnowSim& drawnSim(size_t i) {
+    return simFrame ? simFrame->globes[i] : *scene[i].sim;
+}
 
-        roofLight.blinkRate = 0.5f + (i * 0.2f); // Different blink rates
-        roofLight.blinkPhase = i * 0.7f; // Different phases
-        roofLight.blinks = true; // These lights blink
+// Camera distance that takes in the whole wall of globes
+float defaultCameraDistance() {
+    return 10.0f + 2.2f * scene.extent();
+}
 
-        hutLights.push_back(roofLight);
+// Tessellate every static primitive once, up front, at every level of detail
+void initMeshes() {
+    for (int lod = 0; lod < GlobeScene::LOD_LEVELS; ++lod) {
+        int base = GlobeScene::tessellation(32, lod);
+        int glass = GlobeScene::tessellation(50, lod);
+        int ground = GlobeScene::tessellation(30, lod);
+        int roof = GlobeScene::tessellation(12, lod);
+        meshes.cylinder(GLOBE_RADIUS * 0.9f, BASE_HEIGHT, base);    // Base
+        meshes.disk(GLOBE_RADIUS * 0.9f, base);                     // Base caps
+        meshes.sphere(GLOBE_RADIUS, glass, glass);                  // Glass globe
+        meshes.sphere(GLOBE_RADIUS * 0.8f, ground, ground);         // Snow ground
+        meshes.cone(1.0f, 0.8f, roof, roof);                        // Roof
+    }
+    meshes.cube(1.0f);                                          // Hut, door, windows, chimney
+    meshes.sphere(1.0f, 8, 8);                                  // Smoke puffs
+    for (int lod = 0; lod < EffectsRenderer::SPHERE_LEVELS; ++lod) {
+        int slices = EffectsRenderer::sphereSlices(lod);
+        meshes.sphere(0.05f, slices, slices);                   // Hut lights
+        meshes.sphere(0.12f, slices, slices);                   // Hut light glow
     }
+}
 
-    // Chimney light 
-    HutLight chimneyLight = { 0.3f, 1.1f, 0.0f, 1.0f, 0.6f, 0.2f, 2.0f, 0.0f, true }; // Blinking orange
-    hutLights.push_back(chimneyLight);
+// Save the globe and camera to snapshotPath without holding up drawing
+void saveSnapshot() {
+    if (!sim.cpuFlakes) gpuSim.download(sim);
+    SnowCamera camera = { cameraDistance, cameraAngleX, cameraAngleY };
+
+    // The sim thread's newest frame is a consistent copy to save from
+    snapshotSaver.save(simThread.isRunning() ? simThread.latest().globes[0] : sim, camera, snapshotPath);
 }
 
-// Initialize snowflakes randomly within the globe
-void initSnowflakes() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> radiusDist(0.0f, GLOBE_RADIUS * 0.9f);
-    std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * M_PI);
-    std::uniform_real_distribution<float> heightDist(-GLOBE_RADIUS * 0.8f, GLOBE_RADIUS * 0.9f);
-    std::uniform_real_distribution<float> sizeDist(0.02f, 0.08f);
-    std::uniform_real_distribution<float> speedDist(0.3f, 1.0f);
-    std::uniform_real_distribution<float> velDist(-0.01f, 0.01f);
-    std::uniform_real_distribution<float> sparkleRateDist(2.0f, 6.0f);
-    std::uniform_real_distribution<float> sparkleOffsetDist(0.0f, 2.0f * M_PI);
-
-    snowflakes.clear();
-    for (int i = 0; i < NUM_SNOWFLAKES; ++i) {
-        float radius = radiusDist(gen);
-        float angle = angleDist(gen);
-        float height = heightDist(gen);
-
-        Snowflake flake;
-        flake.x = radius * cos(angle);
-        flake.y = height;
-        flake.z = radius * sin(angle);
-        flake.size = sizeDist(gen);
-        flake.speed = speedDist(gen);
-        flake.angle = angleDist(gen);
-        flake.vx = velDist(gen);
-        flake.vy = -flake.speed * 0.01f; // Initial downward velocity
-        flake.vz = velDist(gen);
-        flake.sparkleRate = sparkleRateDist(gen);
-        flake.sparklePhase = sparkleOffsetDist(gen);
-
-        snowflakes.push_back(flake);
-    }
-}
-
-// Initialize OpenGL settings
-void init() {
+// Swap the running globe for the one in snapshotPath
+bool loadSnapshot() {
+    snapshotSaver.wait();
+    SnowSnapshot snapshot;
+    if (!snapshot.read(snapshotPath.c_str())) return false;
+
+    SnowCamera camera;
+    snapshot.restore(sim, camera);
+    cameraDistance = camera.distance;
+    cameraAngleX = camera.angleX;
+    cameraAngleY = camera.angleY;
+    simClock.reset();
+    if (haveGL) {
+        groundRenderer.init(sim.snowField);
+        effectsRenderer.upload(sim);
+    }
+    if (!sim.cpuFlakes) gpuSim.upload(sim);
+    return true;
+}
+
+// Initialize OpenGL settings, with GL entry points from getProcAddress
+void init(SnowGLGetProcAddress getProcAddress) {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_LIGHTING);
     glEnable(GL_LIGHT0);
@@ -229,15 +325,56 @@ void init() {
     // Set day background
     glClearColor(0.5f, 0.8f, 0.98f, 1.0f);
 
-    initSnowflakes();
-    initStars();
-    initHutLights();
+    // Load GL entry points beyond 1.1 and set up instanced snow
+    loadGLFunctions(getProcAddress);
+    clusteredLights.init();
+    snowRenderer.lighting = &clusteredLights;
+    snowRenderer.init();
+    gpuSim.init();
+    initMeshes();
+    effectsRenderer.init(meshes);
+
+    sim.threadPool = &threadPool;
+    sim.profiler = &profiler;
+    sim.init();
+    scene.init(sim, globeCount);
+    for (size_t i = 0; i < scene.size(); ++i) {
+        addStringLights(*scene[i].sim, stringLights);
+    }
+    if (startFromSnapshot && !loadSnapshot()) startFromSnapshot = false; // A fresh snowfall after all
+    groundRenderer.init(sim.snowField);
+    extraGroundRenderers.clear();
+    for (size_t i = 1; i < scene.size(); ++i) {
+        extraGroundRenderers.emplace_back(new SnowGroundRenderer());
+        extraGroundRenderers.back()->init(scene[i].sim->snowField);
+    }
+    if (scene.size() > 1) cameraDistance = defaultCameraDistance();
+    effectsRenderer.upload(sim);
+    if (startOnGpu) setGpuSim(true);
+    haveGL = true;
+
+    // Register phases up front so the HUD lists them in drawing order
+    gpuProfiler.init();
+    phaseSim = profiler.phase("sim");
+    phaseLights = profiler.phase("lights");
+    phaseScene = profiler.phase("scene");
+    phaseDraw = profiler.phase("draw");
+}
 
-    lastTime = glutGet(GLUT_ELAPSED_TIME);
+// Queue mesh with the current matrix, lit by LIGHT0 and the hut lights
+void drawMesh(const StaticMesh& mesh, float r, float g, float b, const float* emission = nullptr) {
+    RenderCommand command;
+    command.state.program = clusteredLights.surfaces();
+    command.mesh = &mesh;
+    command.color[0] = r;
+    command.color[1] = g;
+    command.color[2] = b;
+    if (emission) std::copy(emission, emission + 3, command.emission);
+    renderQueue.submit(command);
 }
 
 // Draw the snow globe base
-void drawBase() {
+void drawBase(int lod) {
     glPushMatrix();
 
     // Move base below the globe
@@ -246,511 +383,299 @@ void drawBase() {
     // Rotate base around X-axis (adjust angle as needed)
     glRotatef(90.0f, 1.0f, 0.0f, 0.0f);  // Rotate 90 degrees around X-axis
 
-    // Wood-like color
-    glColor3f(0.3f, 0.2f, 0.1f);
-
-    // Draw cylinder
-    GLUquadricObj* base = gluNewQuadric();
-    gluQuadricDrawStyle(base, GLU_FILL);
-    gluQuadricNormals(base, GLU_SMOOTH);
-    gluCylinder(base, GLOBE_RADIUS * 0.9f, GLOBE_RADIUS * 0.9f, BASE_HEIGHT, 32, 1);
+    // Draw cylinder, in a wood-like color
+    int slices = GlobeScene::tessellation(32, lod);
+    drawMesh(meshes.cylinder(GLOBE_RADIUS * 0.9f, BASE_HEIGHT, slices), 0.3f, 0.2f, 0.1f);
 
     // Top disk
     glPushMatrix();
     glTranslatef(0.0f, 0.0f, BASE_HEIGHT);  // Since we've rotated, z is "up"
-    GLUquadricObj* topDisk = gluNewQuadric();
-    gluQuadricDrawStyle(topDisk, GLU_FILL);
-    gluQuadricNormals(topDisk, GLU_SMOOTH);
-    gluDisk(topDisk, 0.0f, GLOBE_RADIUS * 0.9f, 32, 1);
-    gluDeleteQuadric(topDisk);
+    drawMesh(meshes.disk(GLOBE_RADIUS * 0.9f, slices), 0.3f, 0.2f, 0.1f);
     glPopMatrix();
 
     // Bottom disk (optional)
-    GLUquadricObj* bottomDisk = gluNewQuadric();
-    gluQuadricDrawStyle(bottomDisk, GLU_FILL);
-    gluQuadricNormals(bottomDisk, GLU_SMOOTH);
-    gluDisk(bottomDisk, 0.0f, GLOBE_RADIUS * 0.9f, 32, 1);
-    gluDeleteQuadric(bottomDisk);
-
-    // Cleanup
-    gluDeleteQuadric(base);
-    glPopMatrix();
-}
+    drawMesh(meshes.disk(GLOBE_RADIUS * 0.9f, slices), 0.3f, 0.2f, 0.1f);
 
-// Draw the glass globe
-void drawGlobe() {
-    glPushMatrix();
-    // Draw transparent glass globe
-    glColor4f(0.8f, 0.8f, 0.9f, 0.3f);
-    glutSolidSphere(GLOBE_RADIUS, 50, 50);
     glPopMatrix();
 }
 
-// Draw snow inside the globe with optional sparkle effect
-void drawSnow() {
-    glDisable(GL_LIGHTING);
-
-    // Draw active snowflakes
-    for (const auto& flake : snowflakes) {
-        glPushMatrix();
-        glTranslatef(flake.x, flake.y, flake.z);
-        glRotatef(flake.angle, 0.0f, 1.0f, 0.0f);
-
-        // Determine snowflake color based on night mode
-        if (isNightMode) {
-            // In night mode, add sparkle effect
-            float sparkle = sin(totalTime * flake.sparkleRate + flake.sparklePhase);
-            sparkle = (sparkle + 1.0f) * 0.5f; // Convert to [0,1] range
+// Queue the glass globe: the far side of the glass behind everything in
+// the globe, the near side in front of it
+void drawGlobe(int lod) {
+    int slices = GlobeScene::tessellation(50, lod);
+    RenderCommand glass;
+    glass.pass = PASS_TRANSPARENT;
+    glass.mesh = &meshes.sphere(GLOBE_RADIUS, slices, slices);
+    glass.color[0] = 0.8f;
+    glass.color[1] = 0.8f;
+    glass.color[2] = 0.9f;
+    glass.color[3] = 0.3f;
+
+    glass.state.cullFace = GL_FRONT;
+    glass.depthOffset = GLOBE_RADIUS;
+    renderQueue.submit(glass);
+
+    glass.state.cullFace = GL_BACK;
+    glass.depthOffset = -GLOBE_RADIUS;
+    renderQueue.submit(glass);
+}
 
-            // Create a sparkling effect with slight color variation
-            float brightness = 0.5f + 0.5f * sparkle;
-            float blueHint = 0.6f + 0.4f * sparkle;
-            glColor3f(brightness, brightness, blueHint);
-        }
-        else {
-            // Normal white snow in day mode with slight transition
-            float brightness = 1.0f - (dayNightTransition * 0.3f);
-            glColor3f(brightness, brightness, brightness);
-        }
-
-        // Draw a small quad for each snowflake
-        glBegin(GL_QUADS);
-        glVertex3f(-flake.size, -flake.size, 0.0f);
-        glVertex3f(flake.size, -flake.size, 0.0f);
-        glVertex3f(flake.size, flake.size, 0.0f);
-        glVertex3f(-flake.size, flake.size, 0.0f);
-        glEnd();
-
-        // Draw a perpendicular quad for 3D effect
-        glBegin(GL_QUADS);
-        glVertex3f(0.0f, -flake.size, -flake.size);
-        glVertex3f(0.0f, flake.size, -flake.size);
-        glVertex3f(0.0f, flake.size, flake.size);
-        glVertex3f(0.0f, -flake.size, flake.size);
-        glEnd();
-        glPopMatrix();
+// Draw snow inside the globe with optional sparkle effect; fewer flakes
+// the smaller the globe is on screen, the same ones GlobeScene steps
+void drawSnow(const SnowSim& globeSim, int lod) {
+    size_t limit = SIZE_MAX;
+    if (lod > 0) limit = GlobeScene::flakeLimit(globeSim.numSnowflakes, lod);
+    if (globeSim.cpuFlakes) {
+        snowRenderer.draw(globeSim, renderQueue, renderAlpha, limit);
+    }
+    else {
+        snowRenderer.draw(globeSim, gpuSim, renderQueue, renderAlpha, limit);
     }
-
-    glEnable(GL_LIGHTING);
 }
 
 // Draw stars in night mode
 void drawStars() {
-    if (dayNightTransition <= 0.0f) return; // Don't draw stars in day mode
-
-    glDisable(GL_LIGHTING);
-
-    for (const auto& star : stars) {
-        // Calculate star brightness with twinkling effect
-        float twinkle = sin(totalTime * star.twinkleRate + star.twinkleOffset);
-        twinkle = (twinkle + 1.0f) * 0.5f; // Convert to [0,1] range
-        float brightness = star.brightness * (0.7f + 0.3f * twinkle) * dayNightTransition;
-
-        glColor3f(brightness, brightness, brightness);
-
-        glPushMatrix();
-        glTranslatef(star.x, star.y, star.z);
-
-        // Simple point for stars
-        glPointSize(1.5f);
-        glBegin(GL_POINTS);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glEnd();
-        glPopMatrix();
-    }
-
-    glEnable(GL_LIGHTING);
+    effectsRenderer.drawStars(drawnSim(0), renderQueue);
 }
 
-// Draw decorative lights on the hut
-void drawHutLights(float x, float y, float z) {
-    if (dayNightTransition <= 0.1f) return; // Only visible at night
-
-    // Enable lighting for glow effects
-    glEnable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST); // Draw lights on top
-
-    for (const auto& light : hutLights) {
-        float intensity = 1.0f;
-
-        // Apply blinking effect if this light blinks
-        if (light.blinks) {
-            float blink = sin(totalTime * light.blinkRate + light.blinkPhase);
-            intensity = (blink + 1.0f) * 0.5f; // Convert to [0,1] range
-            intensity = 0.4f + (0.6f * intensity); // Keep a minimum brightness
-        }
-
-        // Scale intensity by day/night transition
-        intensity *= dayNightTransition;
-
-        // Set light color with current intensity
-        GLfloat emission[] = { light.r * intensity, light.g * intensity, light.b * intensity, 1.0f };
-        glMaterialfv(GL_FRONT, GL_EMISSION, emission);
-
+// Hand this frame's hut lights, in eye space, to the clustered lighting
+void collectLights() {
+    clusteredLights.clear();
+    for (size_t i = 0; i < scene.size(); ++i) {
+        const GlobeScene::Globe& globe = scene[i];
+        const SnowSim& globeSim = drawnSim(i);
+        if (!globe.visible || globeSim.dayNightTransition <= 0.1f) continue; // Only lit at night
         glPushMatrix();
-        // Position relative to input position (which is hut's position)
-        glTranslatef(x + light.x, y + light.y, z + light.z);
-
-        // Draw a small sphere for the light
-        glutSolidSphere(0.05f, 8, 8);
-
-        // Optional: Draw a larger, dimmer sphere for glow effect
-        glColor4f(light.r, light.g, light.b, 0.2f * intensity);
-        glutSolidSphere(0.12f, 8, 8);
+        glTranslatef(globe.x, globe.y, 0.0f);
+        glRotatef(globeSim.interpolatedRotationY(renderAlpha), 0.0f, 1.0f, 0.0f);
+        glTranslatef(0.0f, HUT_Y, 0.0f);
+        for (const auto& light : globeSim.hutLights) {
+            clusteredLights.addLight(light, HUT_LIGHT_REACH);
+        }
         glPopMatrix();
     }
-
-    // Reset emission
-    GLfloat noEmission[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    glMaterialfv(GL_FRONT, GL_EMISSION, noEmission);
-
-    glEnable(GL_DEPTH_TEST);
+    const SnowSim& primary = drawnSim(0);
+    clusteredLights.build(windowWidth, windowHeight, primary.totalTime, primary.dayNightTransition);
 }
 
 // Draw the hut inside the globe
-void drawHut() {
+void drawHut(SnowSim& globeSim, SnowGroundRenderer& ground, int lod) {
     glPushMatrix();
-    glRotatef(globeRotationY, 0.0f, 1.0f, 0.0f);
+    glRotatef(globeSim.interpolatedRotationY(renderAlpha), 0.0f, 1.0f, 0.0f);
 
     // Ground/snow layer - Adjusted for night mode
-    if (isNightMode) {
+    float groundR = 1.0f, groundG = 1.0f, groundB = 1.0f; // White snow in day
+    if (globeSim.isNightMode) {
         // Bluish snow at night
-        glColor3f(0.7f - (0.2f * dayNightTransition),
-            0.7f - (0.0f * dayNightTransition),
-            0.8f + (0.1f * dayNightTransition));
-    }
-    else {
-        // White snow in day
-        glColor3f(1.0f, 1.0f, 1.0f);
+        groundR = 0.7f - (0.2f * globeSim.dayNightTransition);
+        groundG = 0.7f - (0.0f * globeSim.dayNightTransition);
+        groundB = 0.8f + (0.1f * globeSim.dayNightTransition);
     }
 
     glPushMatrix();
     glTranslatef(0.0f, -GLOBE_RADIUS + 0.5f, 0.0f);
     glScalef(1.0f, 0.15f, 1.0f);
-    glutSolidSphere(GLOBE_RADIUS * 0.8f, 30, 30);
+    int groundSlices = GlobeScene::tessellation(30, lod);
+    drawMesh(meshes.sphere(GLOBE_RADIUS * 0.8f, groundSlices, groundSlices), groundR, groundG, groundB);
     glPopMatrix();
 
+    // Settled snow on top of the ground
+    RenderCommand settled;
+    settled.state.program = clusteredLights.surfaces();
+    settled.color[0] = groundR;
+    settled.color[1] = groundG;
+    settled.color[2] = groundB;
+    settled.drawBatch = [&ground, &globeSim]() { ground.draw(globeSim.snowField); };
+    settled.triangles = ground.triangleCount();
+    renderQueue.submit(settled);
+
     // Draw the hut
     glPushMatrix();
     float hutX = 0.0f;
-    float hutY = -GLOBE_RADIUS + 1.2f;
+    float hutY = HUT_Y;
     float hutZ = 0.0f;
     glTranslatef(hutX, hutY, hutZ);
 
     // Hut body - adjust color based on day/night
-    float woodDarkening = 0.2f * dayNightTransition; // Darken wood at night
-    glColor3f(0.6f - woodDarkening, 0.4f - woodDarkening, 0.2f - woodDarkening);
+    float woodDarkening = 0.2f * globeSim.dayNightTransition; // Darken wood at night
     glPushMatrix();
     glScalef(1.2f, 1.0f, 1.0f);
-    glutSolidCube(1.0f);
+    drawMesh(meshes.cube(1.0f), 0.6f - woodDarkening, 0.4f - woodDarkening, 0.2f - woodDarkening);
     glPopMatrix();
 
     // Roof - adjust color based on day/night
-    glColor3f(0.3f - (0.1f * dayNightTransition),
-        0.1f - (0.05f * dayNightTransition),
-        0.1f - (0.05f * dayNightTransition)); // Darker red roof at night
     glPushMatrix();
     glTranslatef(0.0f, 0.5f, 0.0f);
     glRotatef(-90.0f, 1.0f, 0.0f, 0.0f);
-    glutSolidCone(1.0f, 0.8f, 12, 12);
+    int roofSlices = GlobeScene::tessellation(12, lod);
+    drawMesh(meshes.cone(1.0f, 0.8f, roofSlices, roofSlices), 0.3f - (0.1f * globeSim.dayNightTransition),
+        0.1f - (0.05f * globeSim.dayNightTransition),
+        0.1f - (0.05f * globeSim.dayNightTransition)); // Darker red roof at night
     glPopMatrix();
 
     // Door with glow effect at night
-    if (isNightMode) {
+    float doorR = 0.3f, doorG = 0.2f, doorB = 0.1f; // Normal door
+    if (globeSim.isNightMode) {
         // Door border (darker)
-        glColor3f(0.2f - (0.1f * dayNightTransition),
-            0.1f - (0.05f * dayNightTransition),
-            0.05f - (0.03f * dayNightTransition));
-    }
-    else {
-        // Normal door
-        glColor3f(0.3f, 0.2f, 0.1f);
+        doorR = 0.2f - (0.1f * globeSim.dayNightTransition);
+        doorG = 0.1f - (0.05f * globeSim.dayNightTransition);
+        doorB = 0.05f - (0.03f * globeSim.dayNightTransition);
     }
 
     glPushMatrix();
     glTranslatef(0.0f, -0.25f, 0.51f);
     glScalef(0.4f, 0.5f, 0.1f);
-    glutSolidCube(1.0f);
+    drawMesh(meshes.cube(1.0f), doorR, doorG, doorB);
     glPopMatrix();
 
     // Windows with glow at night
-    if (isNightMode) {
+    float windowR = 0.9f, windowG = 0.9f, windowB = 1.0f; // Normal windows during day
+    float windowEmission[3] = { 0.0f, 0.0f, 0.0f };
+    if (globeSim.isNightMode) {
         // Glowing warm light from windows at night
-        glColor3f(0.9f * dayNightTransition,
-            0.8f * dayNightTransition,
-            0.2f * dayNightTransition);
+        windowR = 0.9f * globeSim.dayNightTransition;
+        windowG = 0.8f * globeSim.dayNightTransition;
+        windowB = 0.2f * globeSim.dayNightTransition;
 
         // Optional: Add emission for stronger glow
-        GLfloat windowEmission[] = { 0.5f * dayNightTransition, 0.4f * dayNightTransition, 0.1f * dayNightTransition, 1.0f };
-        glMaterialfv(GL_FRONT, GL_EMISSION, windowEmission);
-    }
-    else {
-        // Normal windows during day
-        glColor3f(0.9f, 0.9f, 1.0f);
-        GLfloat noEmission[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-        glMaterialfv(GL_FRONT, GL_EMISSION, noEmission);
+        windowEmission[0] = 0.5f * globeSim.dayNightTransition;
+        windowEmission[1] = 0.4f * globeSim.dayNightTransition;
+        windowEmission[2] = 0.1f * globeSim.dayNightTransition;
     }
 
     // Left window
     glPushMatrix();
     glTranslatef(-0.4f, 0.1f, 0.51f);
     glScalef(0.3f, 0.3f, 0.1f);
-    glutSolidCube(1.0f);
+    drawMesh(meshes.cube(1.0f), windowR, windowG, windowB, windowEmission);
     glPopMatrix();
 
     // Right window
     glPushMatrix();
     glTranslatef(0.4f, 0.1f, 0.51f);
     glScalef(0.3f, 0.3f, 0.1f);
-    glutSolidCube(1.0f);
+    drawMesh(meshes.cube(1.0f), windowR, windowG, windowB, windowEmission);
     glPopMatrix();
 
-    // Reset emission
-    GLfloat noEmission[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    glMaterialfv(GL_FRONT, GL_EMISSION, noEmission);
-
     // Chimney with smoke
-    glColor3f(0.2f - (0.1f * dayNightTransition),
-        0.2f - (0.1f * dayNightTransition),
-        0.2f - (0.1f * dayNightTransition)); // Darker at night
     glPushMatrix();
     glTranslatef(0.3f, 0.9f, 0.0f);
     glScalef(0.2f, 0.5f, 0.2f);
-    glutSolidCube(1.0f);
+    drawMesh(meshes.cube(1.0f), 0.2f - (0.1f * globeSim.dayNightTransition),
+        0.2f - (0.1f * globeSim.dayNightTransition),
+        0.2f - (0.1f * globeSim.dayNightTransition)); // Darker at night
     glPopMatrix();
 
     // Add chimney smoke (only visible in day mode)
-    if (!isNightMode) {
-        glDisable(GL_LIGHTING);
-        glColor4f(0.8f, 0.8f, 0.8f, 0.5f - (0.5f * dayNightTransition));
-
-        for (int i = 0; i < 5; i++) {
-            float height = 0.2f + (i * 0.1f);
-            float wobble = sin(totalTime * 1.5f + i) * 0.05f;
-
-            glPushMatrix();
-            glTranslatef(0.3f + wobble, 1.2f + height, 0.0f);
-            glScalef(0.15f + (height * 0.1f), 0.1f, 0.15f + (height * 0.1f));
-            glutSolidSphere(1.0f, 8, 8);
-            glPopMatrix();
-        }
-
-        glEnable(GL_LIGHTING);
-    }
+    effectsRenderer.drawSmoke(globeSim, renderQueue, lod);
 
     // Add hut lights in night mode
-    drawHutLights(0.0f, 0.0f, 0.0f);
+    effectsRenderer.drawHutLights(globeSim, renderQueue, lod);
 
     glPopMatrix();
     glPopMatrix();
 }
 
-// Function to rotate a point around the y-axis
-void rotatePointY(float& x, float& z, float angle) {
-    float radAngle = angle * M_PI / 180.0f;
-    float newX = x * cos(radAngle) - z * sin(radAngle);
-    float newZ = x * sin(radAngle) + z * cos(radAngle);
-    x = newX;
-    z = newZ;
-}
-
-// Update background color based on day/night transition
-void updateBackgroundColor() {
-    if (isNightMode) {
-        // Transition to night (dark blue)
-        if (dayNightTransition < 1.0f) {
-            dayNightTransition += transitionSpeed;
-            if (dayNightTransition > 1.0f) dayNightTransition = 1.0f;
-        }
-    }
-    else {
-        // Transition to day (light blue)
-        if (dayNightTransition > 0.0f) {
-            dayNightTransition -= transitionSpeed;
-            if (dayNightTransition < 0.0f) dayNightTransition = 0.0f;
-        }
-    }
-
-    // Calculate background color based on transition value
-    float r = 0.5f - (0.45f * dayNightTransition); // 0.5 (day) to 0.05 (night)
-    float g = 0.8f - (0.75f * dayNightTransition); // 0.8 (day) to 0.05 (night)
-    float b = 0.98f - (0.8f * dayNightTransition); // 0.98 (day) to 0.18 (night)
+// Draw per-phase timings over the scene: CPU and GPU p50/p95/p99 in ms
+void drawHud() {
+    int width = windowWidth;
+    int height = windowHeight;
 
-    glClearColor(r, g, b, 1.0f);
-}
-
-// Update snow positions and handle shaking and rotation effects
-void updateSnow() {
-    int currentTime = glutGet(GLUT_ELAPSED_TIME);
-    deltaTime = (currentTime - lastTime) / 1000.0f; // Convert to seconds
-    lastTime = currentTime;
-    totalTime += deltaTime;
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
 
-    // Update background based on day/night mode
-    updateBackgroundColor();
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, width, 0, height, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
 
-    // Apply shake decay
-    if (isShaking) {
-        shakeMagnitude *= shakeDecay;
-        if (shakeMagnitude < 0.01f) {
-            isShaking = false;
-            shakeMagnitude = 0.0f;
+    // Backdrop so the text reads over snow and sky alike
+    int rows = profiler.phaseCount() + 5;
+    glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+    glRecti(4, height - 8 - rows * 15, 520, height - 4);
+
+    char line[128];
+    int y = height - 18;
+    glColor3f(1.0f, 1.0f, 0.6f);
+    snprintf(line, sizeof(line), "%-16s %22s %22s", "phase (ms)", "cpu p50/p95/p99",
+        gpuProfiler.isAvailable() ? "gpu p50/p95/p99" : "gpu n/a");
+    glRasterPos2i(10, y);
+    glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+
+    glColor3f(1.0f, 1.0f, 1.0f);
+    for (int id = 0; id < profiler.phaseCount(); ++id) {
+        FrameProfiler::Percentiles cpu = profiler.cpuPercentiles(id);
+        FrameProfiler::Percentiles gpu = profiler.gpuPercentiles(id);
+        char gpuText[32] = "-";
+        if (gpu.samples > 0) {
+            snprintf(gpuText, sizeof(gpuText), "%6.2f %6.2f %6.2f", gpu.p50, gpu.p95, gpu.p99);
         }
+        snprintf(line, sizeof(line), "%-16s   %6.2f %6.2f %6.2f %22s", profiler.phaseName(id).c_str(),
+            cpu.p50, cpu.p95, cpu.p99, gpuText);
+        y -= 15;
+        glRasterPos2i(10, y);
+        glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
     }
 
-    // Calculate rotation effect on particles
-    float rotationEffect = 0.0f;
-    if (isRotating) {
-        rotationEffect = rotationSpeed * 2.0f;
-        rotationSpeed *= 0.98f;  // Damping
+    // Globes drawn, by level of detail
+    snprintf(line, sizeof(line), "%zu globes, %zu drawn, by detail %zu/%zu/%zu/%zu", scene.size(),
+        scene.visibleCount(), scene.lodCount(0), scene.lodCount(1), scene.lodCount(2), scene.lodCount(3));
+    y -= 15;
+    glRasterPos2i(10, y);
+    glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+
+    // Where the simulation runs, and which step is on screen
+    snprintf(line, sizeof(line), "%s, drawing step %llu at %.0f fps%s", simThread.isRunning() ? "Sim thread" : "Sim in lockstep",
+        (unsigned long long)drawnSim(0).frame, framePacer.fps(), framePacer.isIdle() ? " (idle)" : "");
+    y -= 15;
+    glRasterPos2i(10, y);
+    glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+
+    // What the render queue sent to GL
+    const RenderStats& stats = renderQueue.lastStats;
+    snprintf(line, sizeof(line), "%zu draws, %zu triangles, %zu state changes, %zu redundant skipped",
+        stats.commands, stats.triangles, stats.stateChanges, stats.redundant);
+    y -= 15;
+    glRasterPos2i(10, y);
+    glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+
+    // How much work the clustered lights are doing
+    snprintf(line, sizeof(line), "%zu point lights, %zu cluster entries%s", clusteredLights.lightCount(),
+        clusteredLights.lastIndexCount, clusteredLights.isAvailable() ? "" : " (no float textures)");
+    y -= 15;
+    glRasterPos2i(10, y);
+    glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
 
-        if (fabs(rotationSpeed) < 0.05f) {
-            isRotating = false;
-            rotationSpeed = 0.0f;
-        }
-    }
-
-    // Update globe rotation
-    if (isRotating) {
-        globeRotationY += rotationSpeed;
-        // Keep angle between 0-360
-        if (globeRotationY > 360.0f) globeRotationY -= 360.0f;
-        if (globeRotationY < 0.0f) globeRotationY += 360.0f;
-    }
-
-    // Random generator for turbulence
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> turbDist(-0.01f, 0.01f);
-
-    // Update falling snowflakes 
-    for (auto& flake : snowflakes) {
-        // Apply gravity
-        flake.vy -= 0.0005f * flake.speed;
-
-        // Apply random turbulence (subtle air movement)
-        if (!isShaking) {
-            flake.vx += turbDist(gen) * 0.01f;
-            flake.vz += turbDist(gen) * 0.01f;
-        }
-
-        // Apply shaking effect
-        if (isShaking) {
-            std::uniform_real_distribution<float> shakeDist(-1.0f, 1.0f);
-
-            flake.vx += shakeMagnitude * shakeDist(gen) * 0.05f;
-            flake.vy += shakeMagnitude * shakeDist(gen) * 0.05f;
-            flake.vz += shakeMagnitude * shakeDist(gen) * 0.05f;
-
-            // Spin the snowflakes faster during shaking
-            flake.angle += shakeMagnitude * 10.0f;
-        }
-        else {
-            // Apply rotation effect
-            if (isRotating) {
-                // Apply opposite force to simulate inertia
-                float forceZ = rotationEffect * flake.x * 0.01f;
-                float forceX = -rotationEffect * flake.z * 0.01f;
-
-                flake.vx += forceX;
-                flake.vz += forceZ;
-
-                flake.angle += rotationEffect * 0.5f;
-            }
-            else {
-                // Gentle rotation even when not shaking or rotating
-                flake.angle += 0.2f * flake.speed;
-            }
-        }
-
-        // Apply velocity damping (air resistance)
-        flake.vx *= 0.99f;
-        flake.vy *= 0.99f;
-        flake.vz *= 0.99f;
-
-        // Update positions
-        flake.x += flake.vx * deltaTime * 60.0f;
-        flake.y += flake.vy * deltaTime * 60.0f;
-        flake.z += flake.vz * deltaTime * 60.0f;
-
-        // Check if snowflake hits the ground
-        float minY = -GLOBE_RADIUS + 0.5f;
-        if (flake.y < minY) {
-            flake.y = minY;
-            flake.vy = -flake.vy * 0.3f; // Bounce with energy loss
-
-            // Some chance of the snowflake getting back up when shaking
-            if (isShaking && shakeMagnitude > 0.5f) {
-                std::uniform_real_distribution<float> heightDist(-GLOBE_RADIUS * 0.5f, GLOBE_RADIUS * 0.9f);
-                std::uniform_real_distribution<float> chance(0.0f, 1.0f);
-
-                if (chance(gen) < shakeMagnitude * 0.2f) {
-                    flake.y = heightDist(gen);
-                    // Reset velocity for particles that get picked back up
-                    flake.vx = turbDist(gen) * 0.05f;
-                    flake.vy = turbDist(gen) * 0.02f;
-                    flake.vz = turbDist(gen) * 0.05f;
-                }
-            }
-        }
-
-        // Check for collision with the hut
-        float hutX = 0.0f;
-        float hutZ = 0.0f;
-        float hutSize = 0.8f;
-
-        // Rotate hut position according to globe rotation
-        float hutXRot = hutX;
-        float hutZRot = hutZ;
-        rotatePointY(hutXRot, hutZRot, globeRotationY);
-
-        // Simple box collision with the hut
-        if (flake.y < -GLOBE_RADIUS + 2.0f && flake.y > -GLOBE_RADIUS + 0.5f) {
-            float dx = fabs(flake.x - hutXRot);
-            float dz = fabs(flake.z - hutZRot);
-
-            if (dx < hutSize && dz < hutSize) {
-                // Collision response
-                if (dx > dz) {
-                    flake.x = hutXRot + (flake.x > hutXRot ? 1 : -1) * hutSize;
-                    flake.vx = -flake.vx * 0.5f;
-                }
-                else {
-                    flake.z = hutZRot + (flake.z > hutZRot ? 1 : -1) * hutSize;
-                    flake.vz = -flake.vz * 0.5f;
-                }
-            }
-        }
-
-        // Check for collision with the globe boundary
-        float distFromCenter = sqrt(flake.x * flake.x + flake.y * flake.y + flake.z * flake.z);
-        if (distFromCenter > GLOBE_RADIUS * 0.95f) {
-            // Calculate normal vector for reflection
-            float nx = flake.x / distFromCenter;
-            float ny = flake.y / distFromCenter;
-            float nz = flake.z / distFromCenter;
-
-            // Reflect velocity vector
-            float dotProduct = flake.vx * nx + flake.vy * ny + flake.vz * nz;
-            flake.vx = flake.vx - 2 * dotProduct * nx;
-            flake.vy = flake.vy - 2 * dotProduct * ny;
-            flake.vz = flake.vz - 2 * dotProduct * nz;
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
 
-            // Reduce energy (damping)
-            flake.vx *= 0.8f;
-            flake.vy *= 0.8f;
-            flake.vz *= 0.8f;
+// Update background color based on day/night transition
+void updateBackgroundColor() {
+    float r, g, b;
+    drawnSim(0).backgroundColor(r, g, b);
+    glClearColor(r, g, b, 1.0f);
+}
 
-            // Place slightly inside the boundary
-            flake.x = nx * GLOBE_RADIUS * 0.94f;
-            flake.y = ny * GLOBE_RADIUS * 0.94f;
-            flake.z = nz * GLOBE_RADIUS * 0.94f;
-        }
+// Draw the whole scene into the current framebuffer
+void renderScene() {
+    // Draw the sim thread's newest state, as far past its last step as
+    // the clock is now
+    if (simThread.isRunning()) {
+        simFrame = &simThread.latest();
+        float sinceStep = std::chrono::duration<float>(std::chrono::steady_clock::now() - simFrame->stepTime).count();
+        renderAlpha = std::min(1.0f, std::max(0.0f, sinceStep * simClock.stepRate));
+        updateBackgroundColor();
     }
-}
+    const SnowSim& primary = drawnSim(0);
 
-// Function to render the scene
-void display() {
     // Clear the screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -759,9 +684,9 @@ void display() {
     glLoadIdentity();
 
     // Apply camera transformations with shake effect
-    if (isShaking) {
-        float shakeX = sin(totalTime * 20.0f) * shakeMagnitude * 0.1f;
-        float shakeY = cos(totalTime * 15.0f) * shakeMagnitude * 0.1f;
+    if (primary.isShaking) {
+        float shakeX = sin(primary.totalTime * 20.0f) * primary.shakeMagnitude * 0.1f;
+        float shakeY = cos(primary.totalTime * 15.0f) * primary.shakeMagnitude * 0.1f;
         gluLookAt(
             0.0f, 0.0f, cameraDistance + shakeX,  // Eye position with shake
             0.0f, 0.0f, 0.0f,                    // Look at center
@@ -781,7 +706,7 @@ void display() {
     glRotatef(cameraAngleY, 0.0f, 1.0f, 0.0f);
 
     // Adjust light position for night mode
-    if (isNightMode) {
+    if (primary.isNightMode) {
         GLfloat lightPos[] = { 10.0f, 10.0f, 10.0f, 1.0f };
         GLfloat nightAmbient[] = { 0.05f, 0.05f, 0.1f, 1.0f };
         GLfloat nightDiffuse[] = { 0.5f, 0.5f, 0.6f, 1.0f };
@@ -800,68 +725,240 @@ void display() {
         glLightfv(GL_LIGHT0, GL_DIFFUSE, dayDiffuse);
     }
 
-    // Draw stars in night mode
-    drawStars();
+    // Cull the globes and pick their detail for this view
+    float projection[16], modelview[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    scene.updateVisibility(projection, modelview, windowHeight);
 
-    // Draw the base
-    drawBase();
+    // Bin the hut lights into view clusters
+    {
+        GpuProfileScope scope(profiler, gpuProfiler, phaseLights);
+        collectLights();
+    }
 
-    // Draw the hut
-    drawHut();
+    // Walk the scene into the render queue
+    {
+        GpuProfileScope scope(profiler, gpuProfiler, phaseScene);
+        if (scene.size() == 1) drawStars(); // A wall of globes is its own backdrop
+        for (size_t i = 0; i < scene.size(); ++i) {
+            const GlobeScene::Globe& globe = scene[i];
+            if (!globe.visible) continue;
+            SnowSim& globeSim = drawnSim(i);
+            if (simFrame) groundRendererFor(i).markStale(globeSim.snowField);
+            glPushMatrix();
+            glTranslatef(globe.x, globe.y, 0.0f);
+            drawBase(globe.lod);
+            drawHut(globeSim, groundRendererFor(i), globe.lod);
+            drawSnow(globeSim, globe.lod);
+            drawGlobe(globe.lod);
+            glPopMatrix();
+        }
+    }
 
-    // Draw snow
-    drawSnow();
+    // Draw it all, sorted by state and depth
+    {
+        GpuProfileScope scope(profiler, gpuProfiler, phaseDraw);
+        renderQueue.flush(simThread.isRunning() ? nullptr : &threadPool); // The pool is the sim thread's while it runs
+    }
+    const RenderStats& stats = renderQueue.lastStats;
+    renderTotals.commands += stats.commands;
+    renderTotals.stateChanges += stats.stateChanges;
+    renderTotals.redundant += stats.redundant;
+    renderTotals.triangles += stats.triangles;
+
+    // Draw the profiler overlay
+    if (showHud) drawHud();
+}
 
-    // Draw the globe
-    drawGlobe();
+// Function to render the scene
+void display() {
+    renderScene();
 
     // Swap buffers
     glutSwapBuffers();
 }
 
+// Whether anything in view changes from step to step beyond the
+// time-based effects
+bool sceneMoving() {
+    for (size_t i = 0; i < scene.size(); ++i) {
+        if (scene[i].visible && drawnSim(i).isMoving(IDLE_DRIFTING_FRACTION)) return true;
+    }
+    return false;
+}
+
+// Run update() in seconds. GLUT timers cannot be cancelled, so each gets
+// a new id and update() ignores any that an earlier one replaced.
+void scheduleUpdate(double seconds) {
+    glutTimerFunc((unsigned int)(seconds * 1000.0 + 0.5), update, ++frameTimerId);
+}
+
+// Input: back to full rate now rather than when the idle frame is due,
+// restarting the simulation if it stopped with the frames
+void wakeFrames() {
+    if (!haveWindow) return;
+    int currentTime = glutGet(GLUT_ELAPSED_TIME);
+    bool wasStopped = framePacer.isStopped();
+    if (!framePacer.wake(currentTime / 1000.0)) return;
+    if (wasStopped) {
+        lastTime = currentTime;
+        startSimThread();
+    }
+    scheduleUpdate(0.0);
+}
+
 // Function to update animations and physics
-void update(int value) {
-    // Update snow positions and physics
-    updateSnow();
+void update(int timerId) {
+    if (timerId != frameTimerId) return;
+
+    // Each timer tick starts a profiler frame; pick up GPU times that are ready
+    profiler.nextFrame();
+    gpuProfiler.collect(profiler);
+
+    int currentTime = glutGet(GLUT_ELAPSED_TIME);
+    float deltaTime = (currentTime - lastTime) / 1000.0f; // Convert to seconds
+    lastTime = currentTime;
+
+    // Run the physics steps this frame's time covers, unless the sim
+    // thread is on it
+    if (!simThread.isRunning()) {
+        runSimSteps(simClock.advance(deltaTime));
+        renderAlpha = simClock.alpha();
+
+        // Update background based on day/night mode
+        updateBackgroundColor();
+    }
 
     // Request redisplay
     glutPostRedisplay();
 
-    // Set up the next timer callback
-    glutTimerFunc(16, update, 0); // ~60 FPS
+    // Set up the next frame, counted from when this one was due so the
+    // time it takes to draw comes out of the wait. None at all while idle
+    // with no idle rate: the simulation then waits for input too.
+    double wait = framePacer.next(currentTime / 1000.0, sceneMoving());
+    if (wait >= 0.0) {
+        scheduleUpdate(wait);
+    }
+    else {
+        stopSimThread();
+    }
 }
 
 // Function to handle window resizing
 void reshape(int width, int height) {
+    windowWidth = width;
+    windowHeight = height;
+
     // Set the viewport to the full window
     glViewport(0, 0, width, height);
 
     // Set up the projection matrix
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(45.0f, (float)width / (float)height, 0.1f, 100.0f);
+    gluPerspective(45.0f, (float)width / (float)height, 0.1f, 100.0f + 4.0f * scene.extent());
 
     // Switch back to modelview matrix
     glMatrixMode(GL_MODELVIEW);
 }
 
+// Apply the simulation's side of an input event and record it at the
+// step it lands before. Runs wherever the simulation steps: on the sim
+// thread while it runs, straight from the handlers otherwise.
+void applySimInput(const InputEvent& e) {
+    recorder.record(sim.frame, e.type, e.args[0], e.args[1], e.args[2], e.args[3]);
+
+    switch (e.type) {
+    case InputEvent::KEY:
+        switch (e.args[0]) {
+        case 's': // Shake the globe
+        case 'S':
+            scene.shake();
+            break;
+        case 'n': // Toggle night mode
+        case 'N':
+            scene.toggleNightMode();
+            break;
+        case 'l': // Replace the globe with the saved snapshot
+        case 'L':
+            loadSnapshot();
+            break;
+        }
+        break;
+
+    case InputEvent::MOUSE_BUTTON:
+        if (e.args[0] != GLUT_LEFT_BUTTON && e.args[0] != GLUT_RIGHT_BUTTON) break;
+        if (e.args[0] == GLUT_LEFT_BUTTON) {
+            simMouseLeftDown = e.args[1] == GLUT_DOWN;
+        }
+        else {
+            simMouseRightDown = e.args[1] == GLUT_DOWN;
+        }
+        if (e.args[1] == GLUT_DOWN) simMouseX = e.args[2];
+        break;
+
+    case InputEvent::MOUSE_MOTION:
+        if (simMouseLeftDown) {
+            simMouseX = e.args[0];
+        }
+        else if (simMouseRightDown) {
+            // Globe rotation
+            scene.spinGlobe((e.args[0] - simMouseX) * 0.5f);
+            simMouseX = e.args[0];
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Hand an input event to the simulation: through the sim thread's queue
+// while it runs, straight away otherwise
+void submitInput(InputEvent::Type type, int32_t a, int32_t b = 0, int32_t c = 0, int32_t d = 0) {
+    InputEvent e = { 0, type, { a, b, c, d } };
+    if (simThread.isRunning()) {
+        simThread.post(e);
+    }
+    else {
+        applySimInput(e);
+    }
+}
+
+// Step the simulation on its own thread, unless it has to stay on this one
+void startSimThread() {
+    if (!haveWindow || lockstep || !sim.cpuFlakes || simThread.isRunning()) return;
+    simThread.start(scene, simClock, []() { runSimSteps(1); }, applySimInput);
+}
+
+// Bring the simulation back to this thread, with every queued event applied
+void stopSimThread() {
+    if (!simThread.isRunning()) return;
+    simThread.stop();
+    simFrame = nullptr;
+
+    // Nobody kept the live fields' dirty marks meanwhile
+    if (haveGL) {
+        for (size_t i = 0; i < scene.size(); ++i) groundRendererFor(i).markStale(scene[i].sim->snowField);
+    }
+}
+
 // Function to handle keyboard input
 void keyboard(unsigned char key, int x, int y) {
+    wakeFrames();
+
+    // Loading a snapshot and moving flakes to the GPU need the simulation
+    // and GL together, so they happen with the sim thread stopped
+    bool onThisThread = key == 'l' || key == 'L' || key == 'g' || key == 'G';
+    if (onThisThread) stopSimThread();
+
+    // ESC ends a recording rather than being part of it
+    if (key != 27) submitInput(InputEvent::KEY, key, x, y);
+
     switch (key) {
     case 27: // ESC key
         exit(0);
         break;
-
-    case 's': // Shake the globe
-    case 'S':
-        isShaking = true;
-        shakeMagnitude = maxShakeMagnitude;
-        break;
-
-    case 'n': // Toggle night mode
-    case 'N':
-        isNightMode = !isNightMode;
-        break;
     case '+': // Zoom in
     case '=':
         cameraDistance -= 0.5f;
@@ -870,21 +967,46 @@ void keyboard(unsigned char key, int x, int y) {
     case '-': // Zoom out
     case '_':
         cameraDistance += 0.5f;
-        if (cameraDistance > 20.0f) cameraDistance = 20.0f;
+        if (cameraDistance > 20.0f + 3.0f * scene.extent()) cameraDistance = 20.0f + 3.0f * scene.extent();
         break;
     case 'r': // Reset camera
     case 'R':
-        cameraDistance = 10.0f;
+        cameraDistance = defaultCameraDistance();
         cameraAngleX = 15.0f;
         cameraAngleY = 30.0f;
         break;
+    case 'p': // Toggle the profiler HUD
+    case 'P':
+        showHud = !showHud;
+        break;
+    case 't': // Save the recent frames as a Chrome trace
+    case 'T':
+        if (profiler.writeChromeTrace("snowglobe-trace.json")) {
+            printf("Saved snowglobe-trace.json\n");
+        }
+        else {
+            fprintf(stderr, "Could not write snowglobe-trace.json\n");
+        }
+        break;
+    case 'k': // Save a snapshot of the whole globe
+    case 'K':
+        saveSnapshot();
+        break;
+    case 'g': // Switch flake physics between CPU and GPU
+    case 'G':
+        if (haveGL) setGpuSim(sim.cpuFlakes);
+        break;
     }
 
-    glutPostRedisplay();
+    if (onThisThread) startSimThread();
+    if (haveWindow) glutPostRedisplay();
 }
 
 // Function to handle mouse movement
 void mouseMotion(int x, int y) {
+    wakeFrames();
+    submitInput(InputEvent::MOUSE_MOTION, x, y);
+
     if (mouseLeftDown) {
         // Camera rotation (view control)
         cameraAngleY += (x - lastMouseX) * 0.2f;
@@ -894,18 +1016,6 @@ void mouseMotion(int x, int y) {
         if (cameraAngleX > 89.0f) cameraAngleX = 89.0f;
         if (cameraAngleX < -89.0f) cameraAngleX = -89.0f;
 
-        lastMouseX = x;
-        lastMouseY = y;
-    }
-    else if (mouseRightDown) {
-        // Globe rotation
-        float currentRotation = (x - lastMouseX) * 0.5f;
-        rotationSpeed = currentRotation;
-
-        if (fabs(rotationSpeed) > 0.1f) {
-            isRotating = true;
-        }
-
         lastMouseX = x;
         lastMouseY = y;
     }
@@ -913,6 +1023,10 @@ void mouseMotion(int x, int y) {
 
 // Handle mouse clicks
 void mouseButton(int button, int state, int x, int y) {
+    wakeFrames();
+    submitInput(InputEvent::MOUSE_BUTTON, button, state, x, y);
+
+    // Right drags spin the globe, which is the simulation's side
     if (button == GLUT_LEFT_BUTTON) {
         if (state == GLUT_DOWN) {
             mouseLeftDown = true;
@@ -923,20 +1037,13 @@ void mouseButton(int button, int state, int x, int y) {
             mouseLeftDown = false;
         }
     }
-    else if (button == GLUT_RIGHT_BUTTON) {
-        if (state == GLUT_DOWN) {
-            mouseRightDown = true;
-            lastMouseX = x;
-            lastMouseY = y;
-        }
-        else {
-            mouseRightDown = false;
-        }
-    }
 }
 
 // Function to handle special key presses
 void specialKeyboard(int key, int x, int y) {
+    wakeFrames();
+    submitInput(InputEvent::SPECIAL_KEY, key, x, y);
+
     switch (key) {
     case GLUT_KEY_UP:
         cameraAngleX += 5.0f;
@@ -957,16 +1064,377 @@ void specialKeyboard(int key, int x, int y) {
         break;
     }
 
-    glutPostRedisplay();
+    if (haveWindow) glutPostRedisplay();
+}
+
+// Feed the logged events due before the next step through the handlers
+void applyReplayEvents() {
+    while (replayNext < replayLog.events.size() && replayLog.events[replayNext].step <= sim.frame) {
+        const InputEvent& e = replayLog.events[replayNext++];
+        switch (e.type) {
+        case InputEvent::KEY:
+            keyboard((unsigned char)e.args[0], e.args[1], e.args[2]);
+            break;
+        case InputEvent::SPECIAL_KEY:
+            specialKeyboard(e.args[0], e.args[1], e.args[2]);
+            break;
+        case InputEvent::MOUSE_BUTTON:
+            mouseButton(e.args[0], e.args[1], e.args[2], e.args[3]);
+            break;
+        case InputEvent::MOUSE_MOTION:
+            mouseMotion(e.args[0], e.args[1]);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Run physics steps, applying replayed input at the step it was recorded
+void runSimSteps(int steps) {
+    ProfileScope scope(&profiler, phaseSim);
+    for (int i = 0; i < steps; ++i) {
+        if (replaying) {
+            if (sim.frame >= replayLog.endStep) break;
+            applyReplayEvents();
+        }
+        scene.step(simClock.stepSeconds(), &threadPool);
+        if (!sim.cpuFlakes) gpuSim.step(sim);
+    }
+}
+
+// Load a log and set the simulation up the way it was recorded
+bool startReplay(const char* path) {
+    if (!replayLog.load(path)) return false;
+
+    // Loading a snapshot depends on the file on disk at the time and the
+    // GPU sim on GL, so the log alone cannot reproduce a session using them
+    const char* start = replayLog.header.fromSnapshot ? "starts from a snapshot" :
+        replayLog.header.onGpu ? "starts with flake physics on the GPU" : nullptr;
+    if (start) {
+        fprintf(stderr, "%s %s, which a replay cannot reproduce\n", path, start);
+        return false;
+    }
+    for (const InputEvent& e : replayLog.events) {
+        if (e.type != InputEvent::KEY) continue;
+        int key = e.args[0];
+        const char* what = key == 'l' || key == 'L' ? "loads a snapshot" :
+            key == 'g' || key == 'G' ? "switches flake physics between CPU and GPU" : nullptr;
+        if (!what) continue;
+        fprintf(stderr, "%s %s at step %llu, which a replay cannot reproduce\n", path, what,
+            (unsigned long long)e.step);
+        return false;
+    }
+
+    sim.seed = replayLog.header.seed;
+    sim.numSnowflakes = replayLog.header.flakes;
+    sim.numStars = replayLog.header.stars;
+    simClock.stepRate = replayLog.header.stepRate;
+    sim.fluidFlow = replayLog.header.fluidCells > 0;
+    if (sim.fluidFlow) sim.fluidResolution = (int)replayLog.header.fluidCells;
+    replaying = true;
+    replayNext = 0;
+    startFromSnapshot = false;
+    return true;
+}
+
+// Compare the end of a replay with the recording
+bool finishReplay(double seconds) {
+    if (!sim.cpuFlakes) gpuSim.download(sim);
+    uint64_t checksum = sim.positionChecksum();
+    bool same = sim.frame == replayLog.endStep && checksum == replayLog.checksum;
+    fprintf(stderr, "Replayed %llu steps, %zu events in %.3f s (%.4f ms/step): checksum %016llx %s\n",
+        (unsigned long long)sim.frame, replayLog.events.size(), seconds,
+        sim.frame > 0 ? seconds * 1000.0 / sim.frame : 0.0, (unsigned long long)checksum,
+        same ? "matches the recording" : "DIFFERS from the recording");
+    return same;
+}
+
+// Replay with no GL at all: physics only, as fast as it goes
+int runReplay() {
+    sim.threadPool = &threadPool;
+    sim.profiler = &profiler;
+    sim.init();
+    scene.init(sim, globeCount);
+    phaseSim = profiler.phase("sim");
+
+    auto start = std::chrono::steady_clock::now();
+    while (sim.frame < replayLog.endStep) {
+        profiler.nextFrame();
+        runSimSteps(1);
+    }
+    profiler.nextFrame();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return finishReplay(seconds) ? 0 : 1;
+}
+
+// Close the recording, wherever the program exits from
+void finishRecording() {
+    if (!recorder.isOpen()) return;
+    if (!recorder.close(sim.frame, sim.positionChecksum())) {
+        fprintf(stderr, "Writing the input log failed\n");
+    }
+}
+
+// Two-sample Kolmogorov-Smirnov statistic: the largest gap between the
+// empirical distributions of a and b
+static double ksStatistic(std::vector<float> a, std::vector<float> b) {
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    size_t i = 0, j = 0;
+    double largest = 0.0;
+    while (i < a.size() && j < b.size()) {
+        float v = std::min(a[i], b[j]);
+        while (i < a.size() && a[i] <= v) ++i;
+        while (j < b.size() && b[j] <= v) ++j;
+        largest = std::max(largest, std::fabs((double)i / a.size() - (double)j / b.size()));
+    }
+    return largest;
+}
+
+// Run the CPU and GPU flake physics side by side from the same flakes and
+// compare the height, distance from the centre and speed of the flakes
+// at the end. The two use different random numbers, so individual flakes
+// part ways; the distributions should not.
+int runGpuCheck(int steps) {
+    HeadlessGL context;
+    if (!context.create(64, 64)) return 1;
+    loadGLFunctions(HeadlessGL::procAddress());
+    if (!gpuSim.init()) {
+        fprintf(stderr, "No transform feedback in this context\n");
+        return 1;
+    }
+
+    // Same seed, same start; only the physics both backends have
+    SnowSim cpu, gpu;
+    for (SnowSim* s : { &cpu, &gpu }) {
+        s->threadPool = &threadPool;
+        s->seed = sim.seed;
+        s->numSnowflakes = sim.numSnowflakes;
+        s->flakeInteraction = false;
+        s->snowAccumulation = false;
+        s->flakeSleep = false;
+        s->fluidFlow = false; // The GPU has no water
+        s->init();
+    }
+    gpu.cpuFlakes = false;
+    gpuSim.upload(gpu);
+
+    // A shake, a spin and a calm spell, so every force gets used
+    cpu.shake();
+    gpu.shake();
+    for (int i = 0; i < steps; ++i) {
+        if (i == steps / 3) {
+            cpu.spinGlobe(4.0f);
+            gpu.spinGlobe(4.0f);
+        }
+        cpu.step(simClock.stepSeconds());
+        gpu.step(simClock.stepSeconds());
+        gpuSim.step(gpu);
+    }
+    gpuSim.download(gpu);
+
+    struct Measure {
+        const char* name;
+        float (*of)(const SnowflakeStore&, size_t);
+    };
+    const Measure measures[] = {
+        { "height", [](const SnowflakeStore& s, size_t i) { return s.y[i]; } },
+        { "radius", [](const SnowflakeStore& s, size_t i) {
+            return std::sqrt(s.x[i] * s.x[i] + s.y[i] * s.y[i] + s.z[i] * s.z[i]); } },
+        { "speed", [](const SnowflakeStore& s, size_t i) {
+            return std::sqrt(s.vx[i] * s.vx[i] + s.vy[i] * s.vy[i] + s.vz[i] * s.vz[i]); } },
+    };
+
+    // Critical KS distance at the 0.1% level for two samples of n
+    size_t n = cpu.snowflakes.count();
+    double critical = n > 0 ? 1.95 * std::sqrt(2.0 / n) : 0.0;
+    bool same = n > 0;
+    printf("%d steps, %zu flakes, KS limit %.4f\n", steps, n, critical);
+    for (const Measure& m : measures) {
+        std::vector<float> a(n), b(n);
+        double meanA = 0.0, meanB = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = m.of(cpu.snowflakes, i);
+            b[i] = m.of(gpu.snowflakes, i);
+            meanA += a[i];
+            meanB += b[i];
+        }
+        double d = ksStatistic(a, b);
+        printf("  %-7s mean cpu %9.5f gpu %9.5f   KS %.4f %s\n", m.name, meanA / n, meanB / n, d,
+            d <= critical ? "ok" : "DIFFERENT");
+        if (d > critical) same = false;
+    }
+
+    gpuSim.destroy();
+    return same ? 0 : 1;
+}
+
+// Options for rendering with no window
+struct HeadlessOptions {
+    bool enabled = false;
+    int frames = 300;
+    const char* output = "-";
+    FrameCapture::Format format = FrameCapture::PPM;
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    bool shake = false;
+};
+
+// Render frames offscreen at a fixed frame rate and stream them out
+int runHeadless(const HeadlessOptions& options) {
+    HeadlessGL context;
+    if (!context.create(options.width, options.height)) return 1;
+
+    init(HeadlessGL::procAddress());
+    reshape(options.width, options.height);
+
+    FrameCapture capture;
+    if (!capture.open(options.output, options.format, options.width, options.height)) return 1;
+
+    if (options.shake) scene.shake();
+
+    // Frames are spaced 1 / fps apart in simulated time however long they
+    // take. A replay runs to the end of its log instead of a frame count.
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; replaying ? sim.frame < replayLog.endStep : frame < options.frames; ++frame) {
+        profiler.nextFrame();
+        gpuProfiler.collect(profiler);
+
+        runSimSteps(simClock.advance(1.0f / targetFps));
+        renderAlpha = simClock.alpha();
+        updateBackgroundColor();
+
+        renderScene();
+        capture.capture();
+    }
+    bool ok = capture.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // stdout may be carrying the frames, so report on stderr
+    fprintf(stderr, "Rendered %llu frames at %dx%d in %.2f s (%.1f fps)%s\n",
+        (unsigned long long)capture.framesWritten, options.width, options.height, seconds,
+        seconds > 0.0 ? capture.framesWritten / seconds : 0.0, gl.hasPixelBuffers ? "" : ", no pixel buffers");
+    if (capture.framesWritten > 0) {
+        double frames = (double)capture.framesWritten;
+        fprintf(stderr, "Per frame: %.0f draws, %.0f triangles, %.1f state changes, %.1f redundant skipped\n",
+            renderTotals.commands / frames, renderTotals.triangles / frames, renderTotals.stateChanges / frames,
+            renderTotals.redundant / frames);
+    }
+    if (!ok) fprintf(stderr, "Writing %s failed\n", options.output);
+    if (replaying && !finishReplay(seconds)) ok = false;
+
+    gpuProfiler.destroy();
+    return ok ? 0 : 1;
 }
 
 // Main function
 int main(int argc, char** argv) {
+    // Headless runs must not touch GLUT, which needs a display
+    HeadlessOptions headless;
+    const char* replayPath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) headless.enabled = true;
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPath = argv[i + 1];
+        if (strcmp(argv[i], "--gpu-check") == 0) headless.enabled = true;
+    }
+
     // Initialize GLUT
-    glutInit(&argc, argv);
+    if (!headless.enabled && !replayPath) glutInit(&argc, argv);
+
+    // Parse our own options (glutInit has already removed its own)
+    const char* recordPath = nullptr;
+    int gpuCheckSteps = -1;
+    std::random_device rd;
+    sim.seed = ((uint64_t)rd() << 32) | rd();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            sim.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--flakes") == 0 && i + 1 < argc) {
+            sim.numSnowflakes = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--fluid-cells") == 0 && i + 1 < argc) {
+            sim.fluidResolution = atoi(argv[++i]);
+            sim.fluidFlow = sim.fluidResolution > 0;
+        }
+        else if (strcmp(argv[i], "--stars") == 0 && i + 1 < argc) {
+            sim.numStars = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--physics-hz") == 0 && i + 1 < argc) {
+            simClock.stepRate = (float)atof(argv[++i]);
+            if (simClock.stepRate < 1.0f) simClock.stepRate = 1.0f;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            targetFps = (float)atof(argv[++i]);
+            if (targetFps <= 0.0f) targetFps = 60.0f;
+        }
+        else if (strcmp(argv[i], "--idle-fps") == 0 && i + 1 < argc) {
+            framePacer.idleFps = (float)atof(argv[++i]);
+            if (framePacer.idleFps < 0.0f) framePacer.idleFps = 0.0f;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headless.frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            headless.output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            ++i;
+            headless.format = strcmp(argv[i], "raw") == 0 ? FrameCapture::RAW_RGBA : FrameCapture::PPM;
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            int w = 0, h = 0;
+            if (sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                headless.width = w;
+                headless.height = h;
+            }
+        }
+        else if (strcmp(argv[i], "--shake") == 0) {
+            headless.shake = true;
+        }
+        else if (strcmp(argv[i], "--globes") == 0 && i + 1 < argc) {
+            globeCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--string-lights") == 0 && i + 1 < argc) {
+            stringLights = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--lockstep") == 0) {
+            lockstep = true;
+        }
+        else if (strcmp(argv[i], "--gpu-sim") == 0) {
+            startOnGpu = true;
+        }
+        else if (strcmp(argv[i], "--gpu-check") == 0 && i + 1 < argc) {
+            gpuCheckSteps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshotPath = argv[++i];
+            startFromSnapshot = true;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            ++i;
+        }
+    }
+
+    if (gpuCheckSteps >= 0) return runGpuCheck(gpuCheckSteps);
+
+    // The log decides the seed and settings, whatever the command line says
+    if (replayPath) {
+        if (!startReplay(replayPath)) return 1;
+        headless.shake = false;
+        return headless.enabled ? runHeadless(headless) : runReplay();
+    }
+    if (headless.enabled) return runHeadless(headless);
+
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
     glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
     glutCreateWindow("3D Snow Globe");
+    haveWindow = true;
 
     // Set up callbacks
     glutDisplayFunc(display);
@@ -975,10 +1443,30 @@ int main(int argc, char** argv) {
     glutSpecialFunc(specialKeyboard);
     glutMouseFunc(mouseButton);
     glutMotionFunc(mouseMotion);
-    glutTimerFunc(16, update, 0);
+    framePacer.activeFps = targetFps;
+    scheduleUpdate(0.0);
 
     // Initialize OpenGL settings
-    init();
+    init((SnowGLGetProcAddress)glutGetProcAddress);
+    lastTime = glutGet(GLUT_ELAPSED_TIME);
+
+    // Record from the first step, with what it takes to rerun the session
+    if (recordPath) {
+        InputLogHeader header;
+        header.seed = sim.seed;
+        header.flakes = sim.numSnowflakes;
+        header.stars = sim.numStars;
+        header.stepRate = simClock.stepRate;
+        header.fluidCells = sim.fluidFlow ? (uint32_t)sim.fluidResolution : 0;
+        header.fromSnapshot = startFromSnapshot;
+        header.onGpu = !sim.cpuFlakes;
+        if (recorder.open(recordPath, header)) atexit(finishRecording);
+    }
+
+    // Overlap physics with drawing; stopped at exit before the recording
+    // is closed
+    startSimThread();
+    atexit(stopSimThread);
 
     // Enter the main loop
     glutMainLoop();
@@ -0,0 +1,43 @@
+/*
+    Fixed-timestep clock for driving SnowSim from a variable frame rate.
+
+    Real frame time goes into an accumulator and comes out as whole
+    physics steps of 1 / stepRate seconds, so the simulation behaves the
+    same whether the display runs at 30 or 144 Hz. A long hitch runs at
+    most maxSubsteps steps and drops the rest rather than spiralling.
+    alpha() is how far the display is between the last two steps, for
+    interpolating what gets drawn.
+*/
+
+#pragma once
+
+#include <cmath>
+
+class SnowClock {
+public:
+    float stepRate = 60.0f; // Physics steps per second
+    int maxSubsteps = 8;    // Most steps run for one frame
+
+    float stepSeconds() const { return 1.0f / stepRate; }
+
+    // Add a frame's worth of real time and return how many steps to run
+    int advance(float frameSeconds) {
+        double step = stepSeconds();
+        accumulator += frameSeconds;
+        int steps = (int)(accumulator / step);
+        if (steps > maxSubsteps) steps = maxSubsteps;
+        accumulator -= steps * step;
+
+        // Too far behind: keep only the partial step
+        if (accumulator >= step) accumulator = std::fmod(accumulator, step);
+        return steps;
+    }
+
+    // Fraction of a step since the last one, in [0, 1)
+    float alpha() const { return (float)(accumulator / stepSeconds()); }
+
+    void reset() { accumulator = 0.0; }
+
+private:
+    double accumulator = 0.0;
+};
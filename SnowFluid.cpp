@@ -0,0 +1,307 @@
+#include "SnowFluid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Call f(k) for every inner slab k in [1, n - 1), across pool if there is one
+template <typename F>
+static void forEachSlab(ThreadPool* pool, int n, F&& f) {
+    auto slabs = [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) f((int)k + 1);
+    };
+    if (pool) {
+        pool->parallelFor((size_t)(n - 2), 1, slabs);
+    }
+    else {
+        slabs(0, (size_t)(n - 2));
+    }
+}
+
+// Row kernels over cells [begin, end) of one x row, starting at row index
+// base. Written against the lane interface in SnowSimd.h and run with the
+// widest lanes, then with ScalarLanes for the tail; each returns where it
+// stopped. dy and dz are the index steps to the neighbouring rows.
+
+// Divergence of the velocity, scaled for the pressure solve
+template <typename V>
+static int divergenceRow(const float* u, const float* v, const float* w, float* div,
+    size_t base, int begin, int end, size_t dy, size_t dz, float scale) {
+    const V s(scale);
+    int i = begin;
+    for (; i + V::width <= end; i += V::width) {
+        size_t c = base + i;
+        V d = V::load(&u[c + 1]) - V::load(&u[c - 1]) + V::load(&v[c + dy]) - V::load(&v[c - dy]) +
+            V::load(&w[c + dz]) - V::load(&w[c - dz]);
+        (d * s).store(&div[c]);
+    }
+    return i;
+}
+
+// One Jacobi iteration. Walls hold zero pressure, so the plain sum of the
+// neighbours covers only the water ones; subtracting the centre once per
+// water neighbour then makes each wall act as if it had the centre's
+// pressure (no flow through it).
+template <typename V>
+static int jacobiRow(const float* p, float* next, const float* div, const float* count,
+    size_t base, int begin, int end, size_t dy, size_t dz) {
+    const V sixth(1.0f / 6.0f);
+    int i = begin;
+    for (; i + V::width <= end; i += V::width) {
+        size_t c = base + i;
+        V centre = V::load(&p[c]);
+        V sum = V::load(&p[c - 1]) + V::load(&p[c + 1]) + V::load(&p[c - dy]) + V::load(&p[c + dy]) +
+            V::load(&p[c - dz]) + V::load(&p[c + dz]);
+        V residual = V::load(&div[c]) + sum - V::load(&count[c]) * centre;
+        (centre + residual * sixth).store(&next[c]);
+    }
+    return i;
+}
+
+// Subtract the pressure gradient, walls again taking the centre's
+// pressure, and track the fastest speed left
+template <typename V>
+static int gradientRow(const float* p, const float* water, float* u, float* v, float* w,
+    size_t base, int begin, int end, size_t dy, size_t dz, float scale, V& maxSq) {
+    const V s(scale);
+    int i = begin;
+    for (; i + V::width <= end; i += V::width) {
+        size_t c = base + i;
+        V centre = V::load(&p[c]);
+        V left = centre + V::load(&water[c - 1]) * (V::load(&p[c - 1]) - centre);
+        V right = centre + V::load(&water[c + 1]) * (V::load(&p[c + 1]) - centre);
+        V down = centre + V::load(&water[c - dy]) * (V::load(&p[c - dy]) - centre);
+        V up = centre + V::load(&water[c + dy]) * (V::load(&p[c + dy]) - centre);
+        V back = centre + V::load(&water[c - dz]) * (V::load(&p[c - dz]) - centre);
+        V front = centre + V::load(&water[c + dz]) * (V::load(&p[c + dz]) - centre);
+
+        V vx = V::load(&u[c]) - s * (right - left);
+        V vy = V::load(&v[c]) - s * (up - down);
+        V vz = V::load(&w[c]) - s * (front - back);
+        vx.store(&u[c]);
+        vy.store(&v[c]);
+        vz.store(&w[c]);
+        maxSq = lanesMax(maxSq, vx * vx + vy * vy + vz * vz);
+    }
+    return i;
+}
+
+void SnowFluid::init(int cells, float half, float waterRadius, float floor) {
+    n = std::min(std::max(cells, MIN_RESOLUTION), MAX_RESOLUTION);
+    halfSize = half;
+    radius = waterRadius;
+    floorY = floor;
+    cellSize = 2.0f * halfSize / n;
+    invCellSize = 1.0f / cellSize;
+    clear();
+}
+
+void SnowFluid::clear() {
+    moving = false;
+    pushed = false;
+    Grid* grids[] = { &u, &v, &w, &u0, &v0, &w0, &pressure, &pressureNext, &divergence, &water, &waterNeighbours };
+    for (Grid* grid : grids) Grid().swap(*grid);
+}
+
+void SnowFluid::saveState(float* out) const {
+    if (!moving) return;
+    const Grid* grids[] = { &u, &v, &w, &pressure };
+    for (const Grid* grid : grids) out = std::copy(grid->begin(), grid->end(), out);
+}
+
+// Scratch grids and walls start from zero as after allocate(), so the
+// next step matches one taken before saving
+void SnowFluid::loadState(const float* in) {
+    allocate();
+    moving = true;
+    Grid* grids[] = { &u, &v, &w, &pressure };
+    for (Grid* grid : grids) {
+        std::copy(in, in + grid->size(), grid->begin());
+        in += grid->size();
+    }
+}
+
+// Zeroed grids and the water's shape, for the first push after still water
+void SnowFluid::allocate() {
+    size_t cells = (size_t)n * n * n;
+    Grid* grids[] = { &u, &v, &w, &u0, &v0, &w0, &pressure, &pressureNext, &divergence, &water, &waterNeighbours };
+    for (Grid* grid : grids) grid->assign(cells, 0.0f);
+
+    // The outermost layer is always wall, so the row kernels never read
+    // past the grid
+    for (int k = 1; k < n - 1; ++k) {
+        for (int j = 1; j < n - 1; ++j) {
+            for (int i = 1; i < n - 1; ++i) {
+                float x = (i + 0.5f) * cellSize - halfSize;
+                float y = (j + 0.5f) * cellSize - halfSize;
+                float z = (k + 0.5f) * cellSize - halfSize;
+                if (x * x + y * y + z * z < radius * radius && y > floorY) water[index(i, j, k)] = 1.0f;
+            }
+        }
+    }
+
+    // Water is a sphere above a plane, so each row holds one span of it
+    rowBegin.assign((size_t)n * n, 0);
+    rowEnd.assign((size_t)n * n, 0);
+    size_t dy = n, dz = (size_t)n * n;
+    for (int k = 1; k < n - 1; ++k) {
+        for (int j = 1; j < n - 1; ++j) {
+            size_t row = (size_t)k * n + j;
+            for (int i = 1; i < n - 1; ++i) {
+                size_t c = index(i, j, k);
+                if (water[c] == 0.0f) continue;
+                if (rowEnd[row] == 0) rowBegin[row] = i;
+                rowEnd[row] = i + 1;
+                waterNeighbours[c] = water[c - 1] + water[c + 1] + water[c - dy] + water[c + dy] +
+                    water[c - dz] + water[c + dz];
+            }
+        }
+    }
+    slabMaxSq.assign(n, 0.0f);
+}
+
+void SnowFluid::addImpulse(float x, float y, float z, float blobRadius, float vx, float vy, float vz) {
+    if (!moving) allocate();
+    moving = true;
+    pushed = true;
+
+    // Cells whose centres fall inside the blob's bounding box
+    auto cellRange = [&](float centre, int& lo, int& hi) {
+        lo = std::max(1, (int)std::floor((centre - blobRadius + halfSize) * invCellSize - 0.5f));
+        hi = std::min(n - 2, (int)std::ceil((centre + blobRadius + halfSize) * invCellSize - 0.5f));
+    };
+    int i0, i1, j0, j1, k0, k1;
+    cellRange(x, i0, i1);
+    cellRange(y, j0, j1);
+    cellRange(z, k0, k1);
+
+    const float invRadiusSq = 1.0f / (blobRadius * blobRadius);
+    for (int k = k0; k <= k1; ++k) {
+        for (int j = j0; j <= j1; ++j) {
+            for (int i = i0; i <= i1; ++i) {
+                float dx = (i + 0.5f) * cellSize - halfSize - x;
+                float dy = (j + 0.5f) * cellSize - halfSize - y;
+                float dz = (k + 0.5f) * cellSize - halfSize - z;
+                float t = 1.0f - (dx * dx + dy * dy + dz * dz) * invRadiusSq;
+                if (t <= 0.0f) continue;
+
+                size_t c = index(i, j, k);
+                float weight = t * t * water[c];
+                u[c] += vx * weight;
+                v[c] += vy * weight;
+                w[c] += vz * weight;
+            }
+        }
+    }
+}
+
+void SnowFluid::dragWithWalls(float angularSpeed, float layer, float rate) {
+    if (!moving) allocate();
+    moving = true;
+    pushed = true;
+
+    for (int k = 1; k < n - 1; ++k) {
+        for (int j = 1; j < n - 1; ++j) {
+            size_t row = (size_t)k * n + j;
+            for (int i = rowBegin[row]; i < rowEnd[row]; ++i) {
+                float x = (i + 0.5f) * cellSize - halfSize;
+                float y = (j + 0.5f) * cellSize - halfSize;
+                float z = (k + 0.5f) * cellSize - halfSize;
+                float depth = std::min(radius - std::sqrt(x * x + y * y + z * z), y - floorY);
+                if (depth >= layer) continue;
+
+                // A point turning with the globe moves along (z, 0, -x)
+                size_t c = index(i, j, k);
+                float pull = rate * (1.0f - depth / layer);
+                u[c] += (angularSpeed * z - u[c]) * pull;
+                v[c] -= v[c] * pull;
+                w[c] += (-angularSpeed * x - w[c]) * pull;
+            }
+        }
+    }
+}
+
+void SnowFluid::step(float stepScale, ThreadPool* pool) {
+    if (!moving) return;
+    advect(stepScale, pool);
+    project(pool);
+
+    // Nothing left worth simulating until the next push
+    float maxSq = *std::max_element(slabMaxSq.begin(), slabMaxSq.end());
+    if (!pushed && maxSq < restSpeed * restSpeed) clear();
+    pushed = false;
+}
+
+// Each water cell takes the velocity found a step back along its own.
+// Lookups land anywhere in the grid, so this runs per cell rather than in
+// lanes.
+void SnowFluid::advect(float stepScale, ThreadPool* pool) {
+    u.swap(u0);
+    v.swap(v0);
+    w.swap(w0);
+    const float back = stepScale * invCellSize;
+    const float keep = std::pow(dissipation, stepScale);
+
+    forEachSlab(pool, n, [&](int k) {
+        for (int j = 1; j < n - 1; ++j) {
+            size_t row = (size_t)k * n + j;
+            for (int i = rowBegin[row]; i < rowEnd[row]; ++i) {
+                size_t c = index(i, j, k);
+                float a, b, d;
+                interpolate(i - u0[c] * back, j - v0[c] * back, k - w0[c] * back,
+                    u0.data(), v0.data(), w0.data(), a, b, d);
+                u[c] = a * keep;
+                v[c] = b * keep;
+                w[c] = d * keep;
+            }
+        }
+    });
+}
+
+// Remove the divergence: solve for the pressure that would cancel it,
+// starting from last step's, and subtract its gradient
+void SnowFluid::project(ThreadPool* pool) {
+    const size_t dy = n, dz = (size_t)n * n;
+
+    forEachSlab(pool, n, [&](int k) {
+        for (int j = 1; j < n - 1; ++j) {
+            size_t row = (size_t)k * n + j, base = row * n;
+            int begin = rowBegin[row], end = rowEnd[row];
+            int done = divergenceRow<FloatLanes>(u.data(), v.data(), w.data(), divergence.data(),
+                base, begin, end, dy, dz, -0.5f * cellSize);
+            divergenceRow<ScalarLanes>(u.data(), v.data(), w.data(), divergence.data(),
+                base, done, end, dy, dz, -0.5f * cellSize);
+        }
+    });
+
+    for (int iteration = 0; iteration < pressureIterations; ++iteration) {
+        forEachSlab(pool, n, [&](int k) {
+            for (int j = 1; j < n - 1; ++j) {
+                size_t row = (size_t)k * n + j, base = row * n;
+                int begin = rowBegin[row], end = rowEnd[row];
+                int done = jacobiRow<FloatLanes>(pressure.data(), pressureNext.data(), divergence.data(),
+                    waterNeighbours.data(), base, begin, end, dy, dz);
+                jacobiRow<ScalarLanes>(pressure.data(), pressureNext.data(), divergence.data(),
+                    waterNeighbours.data(), base, done, end, dy, dz);
+            }
+        });
+        pressure.swap(pressureNext);
+    }
+
+    forEachSlab(pool, n, [&](int k) {
+        FloatLanes wideMax(0.0f);
+        ScalarLanes tailMax(0.0f);
+        for (int j = 1; j < n - 1; ++j) {
+            size_t row = (size_t)k * n + j, base = row * n;
+            int begin = rowBegin[row], end = rowEnd[row];
+            int done = gradientRow<FloatLanes>(pressure.data(), water.data(), u.data(), v.data(), w.data(),
+                base, begin, end, dy, dz, 0.5f * invCellSize, wideMax);
+            gradientRow<ScalarLanes>(pressure.data(), water.data(), u.data(), v.data(), w.data(),
+                base, done, end, dy, dz, 0.5f * invCellSize, tailMax);
+        }
+        float lanes[FloatLanes::width];
+        wideMax.store(lanes);
+        slabMaxSq[k] = *std::max_element(lanes, lanes + FloatLanes::width);
+        slabMaxSq[k] = std::max(slabMaxSq[k], tailMax.v);
+    });
+}
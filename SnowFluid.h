@@ -0,0 +1,137 @@
+/*
+    The water in the globe as a coarse velocity grid (Stam's "stable
+    fluids"), so shaking and spinning move the snow in coherent swirls
+    rather than as independent jitter per flake.
+
+    The grid is a cube of resolution^3 cells around the globe. Cells whose
+    centre lies inside the glass and above the floor hold water; the rest
+    are walls at rest. Each step() carries the velocity along itself
+    (semi-Lagrangian: every cell looks back along its velocity and takes
+    what it finds there, stable for any step length), lets it fade by
+    dissipation, then makes it divergence free: a Jacobi solve for the
+    pressure, whose gradient is subtracted, so a push in one place turns
+    into a swirl around it instead of piling water up. Velocities are in
+    world units per 60 Hz step, like the flakes'.
+
+    The pressure solve and the divergence and gradient passes run along
+    x rows with FloatLanes (see SnowSimd.h), slabs of rows split across
+    the thread pool; every cell reads only the previous iterate, so the
+    result does not depend on the thread count.
+
+    Still water costs nothing: once every cell is slower than restSpeed
+    the field is dropped, step() returns at once until the next push, and
+    the grids only take memory while the water moves.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "SnowSimd.h"
+
+class ThreadPool;
+
+class SnowFluid {
+public:
+    int pressureIterations = 24;
+    float dissipation = 0.998f;  // Velocity kept per 60 Hz step
+    float restSpeed = 0.001f;    // Still once every cell is slower than this
+
+    // Cells per side init() takes; it clamps anything outside
+    static const int MIN_RESOLUTION = 4;
+    static const int MAX_RESOLUTION = 256;
+
+    // Shape the water: cells of a cube of halfSize around the origin, water
+    // where inside a sphere of radius and above floorY. Leaves it still.
+    void init(int cells, float halfSize, float radius, float floorY);
+
+    // Stop all motion and release the grids
+    void clear();
+
+    int resolution() const { return n; }
+    bool isMoving() const { return moving; }
+
+    // Push the water within blobRadius of (x, y, z) by up to (vx, vy, vz),
+    // fading smoothly towards the edge of the blob
+    void addImpulse(float x, float y, float z, float blobRadius, float vx, float vy, float vz);
+
+    // Drag the water within layer of the glass and floor towards the walls'
+    // velocity while the globe turns about y at angularSpeed (radians per
+    // 60 Hz step), closing up to rate of the difference per call
+    void dragWithWalls(float angularSpeed, float layer, float rate);
+
+    // Advance by stepScale 60 Hz steps
+    void step(float stepScale, ThreadPool* pool);
+
+    // Floats in the water's saved state: velocity and pressure per cell
+    // while moving, none while still
+    size_t stateSize() const { return moving ? 4 * (size_t)n * n * n : 0; }
+
+    // Copy the state out, stateSize() floats in index order
+    void saveState(float* out) const;
+
+    // Take back a state saved at the same resolution, moving again
+    void loadState(const float* in);
+
+    // Velocity at a world position, interpolated between cell centres.
+    // Only while isMoving(); still water has no grid to sample.
+    void sample(float x, float y, float z, float& vx, float& vy, float& vz) const {
+        interpolate((x + halfSize) * invCellSize - 0.5f, (y + halfSize) * invCellSize - 0.5f,
+            (z + halfSize) * invCellSize - 0.5f, u.data(), v.data(), w.data(), vx, vy, vz);
+    }
+
+private:
+    typedef std::vector<float, AlignedAllocator<float>> Grid;
+
+    void allocate();
+    void advect(float stepScale, ThreadPool* pool);
+    void project(ThreadPool* pool);
+
+    size_t index(int i, int j, int k) const { return ((size_t)k * n + j) * n + i; }
+
+    // Trilinear lookup of three grids at cell coordinates (cell centres at
+    // whole numbers), clamped to the grid
+    void interpolate(float gx, float gy, float gz, const float* a, const float* b, const float* c,
+        float& outA, float& outB, float& outC) const {
+        const float top = (float)(n - 1);
+        gx = gx < 0.0f ? 0.0f : (gx > top ? top : gx);
+        gy = gy < 0.0f ? 0.0f : (gy > top ? top : gy);
+        gz = gz < 0.0f ? 0.0f : (gz > top ? top : gz);
+        int i = (int)gx, j = (int)gy, k = (int)gz;
+        if (i > n - 2) i = n - 2;
+        if (j > n - 2) j = n - 2;
+        if (k > n - 2) k = n - 2;
+        float fx = gx - i, fy = gy - j, fz = gz - k;
+
+        size_t c000 = index(i, j, k);
+        size_t dy = n, dz = (size_t)n * n;
+        float w000 = (1 - fx) * (1 - fy) * (1 - fz), w100 = fx * (1 - fy) * (1 - fz);
+        float w010 = (1 - fx) * fy * (1 - fz), w110 = fx * fy * (1 - fz);
+        float w001 = (1 - fx) * (1 - fy) * fz, w101 = fx * (1 - fy) * fz;
+        float w011 = (1 - fx) * fy * fz, w111 = fx * fy * fz;
+        const float* grids[3] = { a, b, c };
+        float* outs[3] = { &outA, &outB, &outC };
+        for (int g = 0; g < 3; ++g) {
+            const float* f = grids[g] + c000;
+            *outs[g] = w000 * f[0] + w100 * f[1] + w010 * f[dy] + w110 * f[dy + 1] +
+                w001 * f[dz] + w101 * f[dz + 1] + w011 * f[dz + dy] + w111 * f[dz + dy + 1];
+        }
+    }
+
+    // Shape, set by init()
+    int n = 0;
+    float halfSize = 0.0f, radius = 0.0f, floorY = 0.0f;
+    float cellSize = 1.0f, invCellSize = 1.0f;
+
+    bool moving = false;
+    bool pushed = false;        // Pushed since the last step, so not yet still
+
+    // Allocated while moving. Walls keep zero velocity and pressure.
+    Grid u, v, w;               // Velocity
+    Grid u0, v0, w0;            // Velocity before advection
+    Grid pressure, pressureNext, divergence;
+    Grid water;                 // 1 in water cells, 0 in walls
+    Grid waterNeighbours;       // Water cells among the six neighbours
+    std::vector<int> rowBegin, rowEnd; // Water span [begin, end) along x of each (j, k) row
+    std::vector<float> slabMaxSq;      // Fastest speed squared per slab, for finding rest
+};
@@ -0,0 +1,176 @@
+#include "SnowGL.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+GLFunctions gl;
+
+// Look a function up by core name, then with the ARB suffix
+template <typename T>
+static void loadProc(SnowGLGetProcAddress getProcAddress, T& fn, const char* name) {
+    fn = (T)getProcAddress(name);
+    if (!fn) {
+        std::string arbName = std::string(name) + "ARB";
+        fn = (T)getProcAddress(arbName.c_str());
+    }
+}
+
+// Some getProcAddress implementations return an address for any name, so
+// features that are easy to get wrong are also checked against the
+// context's version and extension string
+static bool contextSupports(int major, int minor, const char* extension) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int haveMajor = 0, haveMinor = 0;
+    if (version && sscanf(version, "%d.%d", &haveMajor, &haveMinor) == 2 &&
+        (haveMajor > major || (haveMajor == major && haveMinor >= minor))) {
+        return true;
+    }
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    return extensions && strstr(extensions, extension);
+}
+
+void loadGLFunctions(SnowGLGetProcAddress getProcAddress) {
+    loadProc(getProcAddress, gl.GenBuffers, "glGenBuffers");
+    loadProc(getProcAddress, gl.DeleteBuffers, "glDeleteBuffers");
+    loadProc(getProcAddress, gl.BindBuffer, "glBindBuffer");
+    loadProc(getProcAddress, gl.BufferData, "glBufferData");
+    loadProc(getProcAddress, gl.BufferSubData, "glBufferSubData");
+    loadProc(getProcAddress, gl.MapBuffer, "glMapBuffer");
+    loadProc(getProcAddress, gl.UnmapBuffer, "glUnmapBuffer");
+
+    loadProc(getProcAddress, gl.CreateShader, "glCreateShader");
+    loadProc(getProcAddress, gl.DeleteShader, "glDeleteShader");
+    loadProc(getProcAddress, gl.ShaderSource, "glShaderSource");
+    loadProc(getProcAddress, gl.CompileShader, "glCompileShader");
+    loadProc(getProcAddress, gl.GetShaderiv, "glGetShaderiv");
+    loadProc(getProcAddress, gl.GetShaderInfoLog, "glGetShaderInfoLog");
+    loadProc(getProcAddress, gl.CreateProgram, "glCreateProgram");
+    loadProc(getProcAddress, gl.DeleteProgram, "glDeleteProgram");
+    loadProc(getProcAddress, gl.AttachShader, "glAttachShader");
+    loadProc(getProcAddress, gl.BindAttribLocation, "glBindAttribLocation");
+    loadProc(getProcAddress, gl.LinkProgram, "glLinkProgram");
+    loadProc(getProcAddress, gl.GetProgramiv, "glGetProgramiv");
+    loadProc(getProcAddress, gl.GetProgramInfoLog, "glGetProgramInfoLog");
+    loadProc(getProcAddress, gl.UseProgram, "glUseProgram");
+    loadProc(getProcAddress, gl.GetUniformLocation, "glGetUniformLocation");
+    loadProc(getProcAddress, gl.Uniform1f, "glUniform1f");
+    loadProc(getProcAddress, gl.Uniform1i, "glUniform1i");
+    loadProc(getProcAddress, gl.Uniform3f, "glUniform3f");
+    loadProc(getProcAddress, gl.Uniform4f, "glUniform4f");
+    loadProc(getProcAddress, gl.VertexAttribPointer, "glVertexAttribPointer");
+    loadProc(getProcAddress, gl.EnableVertexAttribArray, "glEnableVertexAttribArray");
+    loadProc(getProcAddress, gl.DisableVertexAttribArray, "glDisableVertexAttribArray");
+
+    loadProc(getProcAddress, gl.VertexAttribDivisor, "glVertexAttribDivisor");
+    loadProc(getProcAddress, gl.DrawArraysInstanced, "glDrawArraysInstanced");
+    loadProc(getProcAddress, gl.DrawElementsInstanced, "glDrawElementsInstanced");
+
+    loadProc(getProcAddress, gl.TransformFeedbackVaryings, "glTransformFeedbackVaryings");
+    loadProc(getProcAddress, gl.BindBufferBase, "glBindBufferBase");
+    loadProc(getProcAddress, gl.BeginTransformFeedback, "glBeginTransformFeedback");
+    loadProc(getProcAddress, gl.EndTransformFeedback, "glEndTransformFeedback");
+    loadProc(getProcAddress, gl.Uniform1ui, "glUniform1ui");
+
+    loadProc(getProcAddress, gl.ActiveTexture, "glActiveTexture");
+
+    loadProc(getProcAddress, gl.GenQueries, "glGenQueries");
+    loadProc(getProcAddress, gl.DeleteQueries, "glDeleteQueries");
+    loadProc(getProcAddress, gl.BeginQuery, "glBeginQuery");
+    loadProc(getProcAddress, gl.EndQuery, "glEndQuery");
+    loadProc(getProcAddress, gl.GetQueryObjectiv, "glGetQueryObjectiv");
+    loadProc(getProcAddress, gl.GetQueryObjectui64v, "glGetQueryObjectui64v");
+
+    gl.hasBuffers = gl.GenBuffers && gl.DeleteBuffers && gl.BindBuffer && gl.BufferData && gl.BufferSubData;
+    gl.hasPixelBuffers = gl.hasBuffers && gl.MapBuffer && gl.UnmapBuffer &&
+        contextSupports(2, 1, "GL_ARB_pixel_buffer_object");
+    gl.hasShaders = gl.CreateShader && gl.DeleteShader && gl.ShaderSource && gl.CompileShader &&
+        gl.GetShaderiv && gl.GetShaderInfoLog && gl.CreateProgram && gl.DeleteProgram &&
+        gl.AttachShader && gl.BindAttribLocation && gl.LinkProgram && gl.GetProgramiv &&
+        gl.GetProgramInfoLog && gl.UseProgram && gl.GetUniformLocation && gl.Uniform1f &&
+        gl.Uniform1i && gl.Uniform3f && gl.Uniform4f && gl.VertexAttribPointer &&
+        gl.EnableVertexAttribArray && gl.DisableVertexAttribArray;
+    gl.hasInstancing = gl.hasBuffers && gl.hasShaders && gl.VertexAttribDivisor && gl.DrawArraysInstanced &&
+        gl.DrawElementsInstanced;
+    gl.hasTransformFeedback = gl.hasShaders && gl.hasPixelBuffers && gl.TransformFeedbackVaryings &&
+        gl.BindBufferBase && gl.BeginTransformFeedback && gl.EndTransformFeedback && gl.Uniform1ui &&
+        contextSupports(3, 0, "GL_EXT_transform_feedback");
+    gl.hasTimerQuery = gl.GenQueries && gl.DeleteQueries && gl.BeginQuery && gl.EndQuery &&
+        gl.GetQueryObjectiv && gl.GetQueryObjectui64v && contextSupports(3, 3, "GL_ARB_timer_query");
+    gl.hasFloatTextures = gl.hasShaders && gl.ActiveTexture && contextSupports(3, 0, "GL_ARB_texture_float");
+}
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = gl.CreateShader(type);
+    gl.ShaderSource(shader, 1, &source, nullptr);
+    gl.CompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    gl.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        GLint length = 0;
+        gl.GetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length > 1 ? length : 1, '\0');
+        gl.GetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, log.data());
+        fprintf(stderr, "Shader compile failed:\n%s\n", log.data());
+        gl.DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Link vs with fs (if any), binding attributes and feedback outputs first
+static GLuint linkProgram(GLuint vs, GLuint fs, const char* const* attribNames, const char* const* feedbackNames) {
+    GLuint program = gl.CreateProgram();
+    gl.AttachShader(program, vs);
+    if (fs) gl.AttachShader(program, fs);
+    for (GLuint i = 0; attribNames && attribNames[i]; ++i) {
+        gl.BindAttribLocation(program, i, attribNames[i]);
+    }
+    if (feedbackNames) {
+        GLsizei count = 0;
+        while (feedbackNames[count]) ++count;
+        gl.TransformFeedbackVaryings(program, count, feedbackNames, GL_INTERLEAVED_ATTRIBS);
+    }
+    gl.LinkProgram(program);
+
+    // The program keeps the shaders alive while attached
+    gl.DeleteShader(vs);
+    if (fs) gl.DeleteShader(fs);
+
+    GLint ok = GL_FALSE;
+    gl.GetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        GLint length = 0;
+        gl.GetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length > 1 ? length : 1, '\0');
+        gl.GetProgramInfoLog(program, (GLsizei)log.size(), nullptr, log.data());
+        fprintf(stderr, "Shader link failed:\n%s\n", log.data());
+        gl.DeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+GLuint buildShaderProgram(const char* vertexSource, const char* fragmentSource, const char* const* attribNames) {
+    if (!gl.hasShaders) return 0;
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vs || !fs) {
+        if (vs) gl.DeleteShader(vs);
+        if (fs) gl.DeleteShader(fs);
+        return 0;
+    }
+    return linkProgram(vs, fs, attribNames, nullptr);
+}
+
+GLuint buildFeedbackProgram(const char* vertexSource, const char* const* attribNames,
+    const char* const* feedbackNames) {
+    if (!gl.hasTransformFeedback) return 0;
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource);
+    if (!vs) return 0;
+    return linkProgram(vs, 0, attribNames, feedbackNames);
+}
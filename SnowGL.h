@@ -0,0 +1,105 @@
+/*
+    Loader for the OpenGL entry points newer than 1.1 that the renderers use
+    (buffers, pixel buffers, shaders, instancing, transform feedback, timer
+    queries, float textures), plus small shader helpers.
+
+    Entry points are fetched through a caller supplied getProcAddress
+    (glutGetProcAddress for the GLUT window, eglGetProcAddress when
+    rendering headless), tried under their core name
+    and then their ARB name. Anything missing stays null; callers check the
+    has* flags and fall back to immediate mode.
+*/
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+typedef void (*SnowGLProc)();
+typedef SnowGLProc (*SnowGLGetProcAddress)(const char* name);
+
+struct GLFunctions {
+    // Buffer objects (GL 1.5)
+    PFNGLGENBUFFERSPROC GenBuffers;
+    PFNGLDELETEBUFFERSPROC DeleteBuffers;
+    PFNGLBINDBUFFERPROC BindBuffer;
+    PFNGLBUFFERDATAPROC BufferData;
+    PFNGLBUFFERSUBDATAPROC BufferSubData;
+    PFNGLMAPBUFFERPROC MapBuffer;
+    PFNGLUNMAPBUFFERPROC UnmapBuffer;
+
+    // Shaders (GL 2.0)
+    PFNGLCREATESHADERPROC CreateShader;
+    PFNGLDELETESHADERPROC DeleteShader;
+    PFNGLSHADERSOURCEPROC ShaderSource;
+    PFNGLCOMPILESHADERPROC CompileShader;
+    PFNGLGETSHADERIVPROC GetShaderiv;
+    PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog;
+    PFNGLCREATEPROGRAMPROC CreateProgram;
+    PFNGLDELETEPROGRAMPROC DeleteProgram;
+    PFNGLATTACHSHADERPROC AttachShader;
+    PFNGLBINDATTRIBLOCATIONPROC BindAttribLocation;
+    PFNGLLINKPROGRAMPROC LinkProgram;
+    PFNGLGETPROGRAMIVPROC GetProgramiv;
+    PFNGLGETPROGRAMINFOLOGPROC GetProgramInfoLog;
+    PFNGLUSEPROGRAMPROC UseProgram;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+    PFNGLUNIFORM1FPROC Uniform1f;
+    PFNGLUNIFORM1IPROC Uniform1i;
+    PFNGLUNIFORM3FPROC Uniform3f;
+    PFNGLUNIFORM4FPROC Uniform4f;
+    PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+    PFNGLDISABLEVERTEXATTRIBARRAYPROC DisableVertexAttribArray;
+
+    // Instancing (GL 3.3, ARB_instanced_arrays / ARB_draw_instanced)
+    PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+    PFNGLDRAWARRAYSINSTANCEDPROC DrawArraysInstanced;
+    PFNGLDRAWELEMENTSINSTANCEDPROC DrawElementsInstanced;
+
+    // Transform feedback (GL 3.0); Uniform1ui for the uint uniforms it uses
+    PFNGLTRANSFORMFEEDBACKVARYINGSPROC TransformFeedbackVaryings;
+    PFNGLBINDBUFFERBASEPROC BindBufferBase;
+    PFNGLBEGINTRANSFORMFEEDBACKPROC BeginTransformFeedback;
+    PFNGLENDTRANSFORMFEEDBACKPROC EndTransformFeedback;
+    PFNGLUNIFORM1UIPROC Uniform1ui;
+
+    // Multitexture (GL 1.3), for the float textures shaders read (GL 3.0,
+    // ARB_texture_float)
+    PFNGLACTIVETEXTUREPROC ActiveTexture;
+
+    // Queries (GL 1.5) and GPU timing (GL 3.3, ARB_timer_query)
+    PFNGLGENQUERIESPROC GenQueries;
+    PFNGLDELETEQUERIESPROC DeleteQueries;
+    PFNGLBEGINQUERYPROC BeginQuery;
+    PFNGLENDQUERYPROC EndQuery;
+    PFNGLGETQUERYOBJECTIVPROC GetQueryObjectiv;
+    PFNGLGETQUERYOBJECTUI64VPROC GetQueryObjectui64v;
+
+    bool hasBuffers;
+    bool hasPixelBuffers; // Buffers as glReadPixels targets (GL 2.1, ARB_pixel_buffer_object)
+    bool hasShaders;
+    bool hasInstancing;
+    bool hasTransformFeedback;
+    bool hasTimerQuery;
+    bool hasFloatTextures;
+};
+
+extern GLFunctions gl;
+
+// Fetch every entry point; needs a current context. Safe to call again
+// after switching contexts.
+void loadGLFunctions(SnowGLGetProcAddress getProcAddress);
+
+// Compile and link a program from vertex and fragment source. Attribute
+// names in attribNames are bound to locations 0, 1, 2, ... in order
+// (null-terminated list). Returns 0 and prints the log on failure.
+GLuint buildShaderProgram(const char* vertexSource, const char* fragmentSource, const char* const* attribNames);
+
+// Vertex-only program whose outputs in feedbackNames (null-terminated)
+// are captured interleaved into one transform feedback buffer
+GLuint buildFeedbackProgram(const char* vertexSource, const char* const* attribNames,
+    const char* const* feedbackNames);
@@ -0,0 +1,262 @@
+#include "SnowGpuSim.h"
+#include "SnowRandom.h"
+#include "SnowSim.h"
+
+#include <cstddef>
+#include <vector>
+
+// Attribute locations, bound before linking
+enum {
+    ATTRIB_POS_SIZE = 0,
+    ATTRIB_VEL_SPEED = 1,
+    ATTRIB_PREV_ANGLE = 2,
+    ATTRIB_SPARKLE = 3
+};
+
+static const char* const stepAttribNames[] = { "posSize", "velSpeed", "prevAngle", "sparkle", nullptr };
+static const char* const stepFeedbackNames[] = { "outPosSize", "outVelSpeed", "outPrevAngle", "outSparkle", nullptr };
+
+// applyRandomImpulses() followed by updateSnowKernel(), per flake. Random
+// draw n of flake i uses counter i * 8 + n as on the CPU.
+static const char* stepVertexShader = R"(
+#version 130
+in vec4 posSize;
+in vec4 velSpeed;
+in vec4 prevAngle;
+in vec2 sparkle;
+out vec4 outPosSize;
+out vec4 outVelSpeed;
+out vec4 outPrevAngle;
+out vec2 outSparkle;
+
+uniform float shake, gravity, damping, dtScale, rotationForce, angleStep, angleSpeedStep;
+uniform float groundY, groundBounce, hutX, hutZ, hutSize, hutMinY, hutMaxY;
+uniform float boundary, boundaryPlace, wallDamping, globeRadius;
+uniform uint keyLow, keyHigh;
+
+uint mixBits(uint x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float uniformAt(uint counter, float lo, float hi) {
+    uint bits = mixBits(mixBits(counter ^ keyLow) + keyHigh);
+    return lo + (hi - lo) * float(bits >> 8) * (1.0 / 16777216.0);
+}
+
+void main() {
+    vec3 p = posSize.xyz;
+    vec3 v = velSpeed.xyz;
+    float speed = velSpeed.w;
+    vec3 prev = p;
+    uint c = uint(gl_VertexID) * 8u;
+
+    // Shake kicks and pickup, or a light breeze
+    if (shake > 0.0) {
+        float kick = shake * 0.05 * dtScale;
+        v += vec3(uniformAt(c, -1.0, 1.0), uniformAt(c + 1u, -1.0, 1.0), uniformAt(c + 2u, -1.0, 1.0)) * kick;
+        if (shake > 0.5 && p.y <= groundY + 0.001 && uniformAt(c + 3u, 0.0, 1.0) < shake * 0.2 * dtScale) {
+            p.y = uniformAt(c + 4u, -globeRadius * 0.5, globeRadius * 0.9);
+            prev.y = p.y;
+            v = vec3(uniformAt(c + 5u, -0.01, 0.01) * 0.05,
+                     uniformAt(c + 6u, -0.01, 0.01) * 0.02,
+                     uniformAt(c + 7u, -0.01, 0.01) * 0.05);
+        }
+    }
+    else {
+        float breeze = 0.01 * dtScale;
+        v.x += uniformAt(c, -0.01, 0.01) * breeze;
+        v.z += uniformAt(c + 2u, -0.01, 0.01) * breeze;
+    }
+
+    // Gravity and the inertia force from globe rotation
+    v.y -= gravity * speed;
+    v.x -= rotationForce * p.z;
+    v.z += rotationForce * p.x;
+
+    // Air resistance, then integrate
+    v *= damping;
+    p += v * dtScale;
+
+    // Ground bounce with energy loss
+    if (p.y < groundY) {
+        p.y = groundY;
+        v.y = -v.y * groundBounce;
+    }
+
+    // Box collision with the hut, pushed out along the shallower axis
+    vec2 d = p.xz - vec2(hutX, hutZ);
+    vec2 ad = abs(d);
+    if (p.y < hutMaxY && p.y > hutMinY && ad.x < hutSize && ad.y < hutSize) {
+        if (ad.x > ad.y) {
+            p.x = hutX + (d.x > 0.0 ? hutSize : -hutSize);
+            v.x = -v.x * 0.5;
+        }
+        else {
+            p.z = hutZ + (d.y > 0.0 ? hutSize : -hutSize);
+            v.z = -v.z * 0.5;
+        }
+    }
+
+    // Reflect off the globe boundary
+    float distSq = dot(p, p);
+    if (distSq > boundary * boundary) {
+        vec3 n = p / sqrt(distSq);
+        v = (v - 2.0 * dot(v, n) * n) * wallDamping;
+        p = n * boundaryPlace;
+    }
+
+    outPosSize = vec4(p, posSize.w);
+    outVelSpeed = vec4(v, speed);
+    outPrevAngle = vec4(prev, prevAngle.w + angleStep + angleSpeedStep * speed);
+    outSparkle = sparkle;
+
+    // Nothing is rasterized, but some drivers refuse to link without it
+    gl_Position = vec4(0.0);
+}
+)";
+
+bool SnowGpuSim::init() {
+    program = buildFeedbackProgram(stepVertexShader, stepAttribNames, stepFeedbackNames);
+    if (!program) return false;
+
+    uShake = gl.GetUniformLocation(program, "shake");
+    uGravity = gl.GetUniformLocation(program, "gravity");
+    uDamping = gl.GetUniformLocation(program, "damping");
+    uDtScale = gl.GetUniformLocation(program, "dtScale");
+    uRotationForce = gl.GetUniformLocation(program, "rotationForce");
+    uAngleStep = gl.GetUniformLocation(program, "angleStep");
+    uAngleSpeedStep = gl.GetUniformLocation(program, "angleSpeedStep");
+    uGroundY = gl.GetUniformLocation(program, "groundY");
+    uGroundBounce = gl.GetUniformLocation(program, "groundBounce");
+    uHutX = gl.GetUniformLocation(program, "hutX");
+    uHutZ = gl.GetUniformLocation(program, "hutZ");
+    uHutSize = gl.GetUniformLocation(program, "hutSize");
+    uHutMinY = gl.GetUniformLocation(program, "hutMinY");
+    uHutMaxY = gl.GetUniformLocation(program, "hutMaxY");
+    uBoundary = gl.GetUniformLocation(program, "boundary");
+    uBoundaryPlace = gl.GetUniformLocation(program, "boundaryPlace");
+    uWallDamping = gl.GetUniformLocation(program, "wallDamping");
+    uGlobeRadius = gl.GetUniformLocation(program, "globeRadius");
+    uKeyLow = gl.GetUniformLocation(program, "keyLow");
+    uKeyHigh = gl.GetUniformLocation(program, "keyHigh");
+
+    gl.GenBuffers(2, buffers);
+    return true;
+}
+
+void SnowGpuSim::destroy() {
+    if (program) gl.DeleteProgram(program);
+    if (buffers[0]) gl.DeleteBuffers(2, buffers);
+    program = 0;
+    buffers[0] = buffers[1] = 0;
+    flakes = capacity = 0;
+}
+
+void SnowGpuSim::upload(const SnowSim& sim) {
+    if (!program) return;
+    const SnowflakeStore& s = sim.snowflakes;
+    flakes = s.count();
+
+    std::vector<Flake> data(flakes);
+    for (size_t i = 0; i < flakes; ++i) {
+        data[i] = { s.x[i], s.y[i], s.z[i], s.size[i],
+                    s.vx[i], s.vy[i], s.vz[i], s.speed[i],
+                    s.prevX[i], s.prevY[i], s.prevZ[i], s.angle[i],
+                    s.sparkleRate[i], s.sparklePhase[i] };
+    }
+
+    // Both buffers get room for every flake; the second is written by the first step
+    capacity = flakes > 0 ? flakes : 1;
+    for (int b = 0; b < 2; ++b) {
+        gl.BindBuffer(GL_ARRAY_BUFFER, buffers[b]);
+        gl.BufferData(GL_ARRAY_BUFFER, capacity * sizeof(Flake), b == 0 && flakes ? data.data() : nullptr,
+            GL_DYNAMIC_COPY);
+    }
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    current = 0;
+}
+
+void SnowGpuSim::download(SnowSim& sim) const {
+    if (!program) return;
+    SnowflakeStore& s = sim.snowflakes;
+    s.resize(flakes);
+    sim.activeCount = flakes;
+    if (flakes == 0) return;
+
+    gl.BindBuffer(GL_ARRAY_BUFFER, buffers[current]);
+    const Flake* data = (const Flake*)gl.MapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
+    if (data) {
+        for (size_t i = 0; i < flakes; ++i) {
+            const Flake& f = data[i];
+            s.x[i] = f.x; s.y[i] = f.y; s.z[i] = f.z;
+            s.vx[i] = f.vx; s.vy[i] = f.vy; s.vz[i] = f.vz;
+            s.prevX[i] = f.prevX; s.prevY[i] = f.prevY; s.prevZ[i] = f.prevZ;
+            s.size[i] = f.size;
+            s.speed[i] = f.speed;
+            s.angle[i] = f.angle;
+            s.sparkleRate[i] = f.sparkleRate;
+            s.sparklePhase[i] = f.sparklePhase;
+        }
+    }
+    gl.UnmapBuffer(GL_ARRAY_BUFFER);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SnowGpuSim::step(const SnowSim& sim) {
+    if (!program || flakes == 0) return;
+    const SnowStepParams& p = sim.stepParams;
+
+    // Same key as SnowRandom(seed, step), folded to the 32 bits the shader has
+    uint64_t key = SnowRandom(sim.seed, sim.frame - 1).key;
+
+    gl.UseProgram(program);
+    gl.Uniform1f(uShake, p.shakeMagnitude);
+    gl.Uniform1f(uGravity, p.gravity);
+    gl.Uniform1f(uDamping, p.damping);
+    gl.Uniform1f(uDtScale, p.dtScale);
+    gl.Uniform1f(uRotationForce, p.rotationForce);
+    gl.Uniform1f(uAngleStep, p.angleStep);
+    gl.Uniform1f(uAngleSpeedStep, p.angleSpeedStep);
+    gl.Uniform1f(uGroundY, p.groundY);
+    gl.Uniform1f(uGroundBounce, p.groundBounce);
+    gl.Uniform1f(uHutX, p.hutX);
+    gl.Uniform1f(uHutZ, p.hutZ);
+    gl.Uniform1f(uHutSize, p.hutSize);
+    gl.Uniform1f(uHutMinY, p.hutMinY);
+    gl.Uniform1f(uHutMaxY, p.hutMaxY);
+    gl.Uniform1f(uBoundary, p.boundary);
+    gl.Uniform1f(uBoundaryPlace, p.boundaryPlace);
+    gl.Uniform1f(uWallDamping, p.wallDamping);
+    gl.Uniform1f(uGlobeRadius, GLOBE_RADIUS);
+    gl.Uniform1ui(uKeyLow, (GLuint)key);
+    gl.Uniform1ui(uKeyHigh, (GLuint)(key >> 32));
+
+    const GLsizei stride = sizeof(Flake);
+    gl.BindBuffer(GL_ARRAY_BUFFER, buffers[current]);
+    gl.VertexAttribPointer(ATTRIB_POS_SIZE, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Flake, x));
+    gl.VertexAttribPointer(ATTRIB_VEL_SPEED, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Flake, vx));
+    gl.VertexAttribPointer(ATTRIB_PREV_ANGLE, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Flake, prevX));
+    gl.VertexAttribPointer(ATTRIB_SPARKLE, 2, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(Flake, sparkleRate));
+    for (GLuint a = ATTRIB_POS_SIZE; a <= ATTRIB_SPARKLE; ++a) {
+        gl.EnableVertexAttribArray(a);
+    }
+
+    int next = current ^ 1;
+    gl.BindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next]);
+    glEnable(GL_RASTERIZER_DISCARD);
+    gl.BeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)flakes);
+    gl.EndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    gl.BindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+    for (GLuint a = ATTRIB_POS_SIZE; a <= ATTRIB_SPARKLE; ++a) {
+        gl.DisableVertexAttribArray(a);
+    }
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.UseProgram(0);
+    current = next;
+}
@@ -0,0 +1,71 @@
+/*
+    Snowflake physics on the GPU, with transform feedback.
+
+    Flake state lives in two GL buffers. Each step draws every flake as a
+    point through a vertex shader that applies the same physics as the
+    CPU path (turbulence, shake impulses and pickup, gravity, rotation
+    inertia, damping, and ground, hut and glass collisions) and captures
+    its outputs into the other buffer, with rasterization off. The
+    renderer then draws straight from the current buffer, so flakes are
+    never uploaded per frame.
+
+    SnowSim still runs the globe: with SnowSim::cpuFlakes off, each
+    SnowSim::step() updates shake, rotation and day/night and leaves the
+    per-step constants in stepParams for step() here. The CPU path stays
+    the reference. The GPU has no 64-bit integers for the Squares
+    generator, so it draws its random numbers from a 32-bit hash of the
+    same (seed, step, flake, draw) and matches the CPU statistically, not
+    bit for bit. Flake interaction, settling into the heightfield and
+    sleep are CPU only; on the GPU flakes bounce off the ground as they
+    did before snow could settle.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include "SnowGL.h"
+
+class SnowSim;
+
+class SnowGpuSim {
+public:
+    // Per-flake layout of the state buffers, interleaved
+    struct Flake {
+        float x, y, z, size;
+        float vx, vy, vz, speed;
+        float prevX, prevY, prevZ, angle;
+        float sparkleRate, sparklePhase;
+    };
+
+    // Build the step program; needs a current context and
+    // loadGLFunctions() done. False without transform feedback.
+    bool init();
+    void destroy();
+
+    bool isAvailable() const { return program != 0; }
+
+    // Copy every flake of sim, awake or asleep, into the GPU buffers
+    void upload(const SnowSim& sim);
+
+    // Copy the GPU flakes back into sim, all awake
+    void download(SnowSim& sim) const;
+
+    // Move the flakes one step; call right after SnowSim::step()
+    void step(const SnowSim& sim);
+
+    // Buffer holding the latest state, for drawing
+    GLuint currentBuffer() const { return buffers[current]; }
+    size_t count() const { return flakes; }
+
+private:
+    GLuint program = 0;
+    GLuint buffers[2] = { 0, 0 };
+    int current = 0;
+    size_t flakes = 0;
+    size_t capacity = 0;
+
+    // Uniform locations
+    GLint uShake, uGravity, uDamping, uDtScale, uRotationForce, uAngleStep, uAngleSpeedStep;
+    GLint uGroundY, uGroundBounce, uHutX, uHutZ, uHutSize, uHutMinY, uHutMaxY;
+    GLint uBoundary, uBoundaryPlace, uWallDamping, uGlobeRadius, uKeyLow, uKeyHigh;
+};
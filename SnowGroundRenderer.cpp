@@ -0,0 +1,182 @@
+#include "SnowGroundRenderer.h"
+#include "SnowHeightfield.h"
+
+#include <cmath>
+
+// How far bare corners sink under the mound so the bare ground shows
+static const float BARE_SINK = 0.03f;
+
+void SnowGroundRenderer::init(const SnowHeightfield& field) {
+    destroy();
+
+    resolution = field.resolution;
+    tileSize = field.tileSize();
+    int corners = resolution + 1;
+
+    vertices.resize((size_t)corners * corners);
+    for (int cz = 0; cz < corners; ++cz) {
+        for (int cx = 0; cx < corners; ++cx) {
+            Vertex& v = vertices[cz * corners + cx];
+            v.px = -field.groundRadius + cx * tileSize;
+            v.pz = -field.groundRadius + cz * tileSize;
+            v.py = cornerHeight(field, cx, cz);
+        }
+    }
+    for (int cz = 0; cz < corners; ++cz) {
+        for (int cx = 0; cx < corners; ++cx) {
+            updateNormal(cx, cz);
+        }
+    }
+
+    // Only tiles over the mound are drawn
+    indices.clear();
+    for (int tz = 0; tz < resolution; ++tz) {
+        for (int tx = 0; tx < resolution; ++tx) {
+            float x = -field.groundRadius + (tx + 0.5f) * tileSize;
+            float z = -field.groundRadius + (tz + 0.5f) * tileSize;
+            if (x * x + z * z >= field.groundRadius * field.groundRadius) continue;
+
+            // Counter-clockwise seen from above
+            GLuint a = tz * corners + tx;
+            indices.insert(indices.end(), { a, a + corners, a + corners + 1, a, a + corners + 1, a + 1 });
+        }
+    }
+
+    rowDirtyMin.assign(corners, corners);
+    rowDirtyMax.assign(corners, -1);
+    drawnCount = field.flakeCount;
+
+    if (gl.hasBuffers) {
+        gl.GenBuffers(1, &vertexBuffer);
+        gl.BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        gl.BufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
+        gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+        gl.GenBuffers(1, &indexBuffer);
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+void SnowGroundRenderer::destroy() {
+    if (vertexBuffer) gl.DeleteBuffers(1, &vertexBuffer);
+    if (indexBuffer) gl.DeleteBuffers(1, &indexBuffer);
+    vertexBuffer = 0;
+    indexBuffer = 0;
+}
+
+// Mound height at a tile corner plus the mean snow depth of the tiles
+// sharing it
+float SnowGroundRenderer::cornerHeight(const SnowHeightfield& field, int cx, int cz) const {
+    float depth = 0.0f;
+    int tiles = 0;
+    bool snowy = false;
+    for (int tz = cz - 1; tz <= cz; ++tz) {
+        for (int tx = cx - 1; tx <= cx; ++tx) {
+            if (tx < 0 || tz < 0 || tx >= resolution || tz >= resolution) continue;
+            uint32_t settled = field.flakeCount[tz * resolution + tx];
+            depth += settled * field.depthPerFlake;
+            snowy = snowy || settled > 0;
+            ++tiles;
+        }
+    }
+
+    const Vertex& v = vertices[cz * (resolution + 1) + cx];
+    float base = field.baseHeight(v.px, v.pz);
+    return snowy ? base + depth / tiles : base - BARE_SINK;
+}
+
+// Normal from the slope between the neighbouring corners
+void SnowGroundRenderer::updateNormal(int cx, int cz) {
+    int corners = resolution + 1;
+    int x0 = cx > 0 ? cx - 1 : cx, x1 = cx < resolution ? cx + 1 : cx;
+    int z0 = cz > 0 ? cz - 1 : cz, z1 = cz < resolution ? cz + 1 : cz;
+    float dydx = (vertices[cz * corners + x1].py - vertices[cz * corners + x0].py) / ((x1 - x0) * tileSize);
+    float dydz = (vertices[z1 * corners + cx].py - vertices[z0 * corners + cx].py) / ((z1 - z0) * tileSize);
+
+    float length = std::sqrt(dydx * dydx + 1.0f + dydz * dydz);
+    Vertex& v = vertices[cz * corners + cx];
+    v.nx = -dydx / length;
+    v.ny = 1.0f / length;
+    v.nz = -dydz / length;
+}
+
+// Recompute the corners of every dirty tile, then the normals one corner
+// further out, and upload the changed span of each row
+void SnowGroundRenderer::updateDirty(SnowHeightfield& field) {
+    lastUpdatedVertices = 0;
+    if (field.dirtyTiles.empty()) return;
+
+    int corners = resolution + 1;
+    for (uint32_t tile : field.dirtyTiles) {
+        int tx = tile % resolution, tz = tile / resolution;
+        drawnCount[tile] = field.flakeCount[tile];
+        for (int cz = tz; cz <= tz + 1; ++cz) {
+            for (int cx = tx; cx <= tx + 1; ++cx) {
+                vertices[cz * corners + cx].py = cornerHeight(field, cx, cz);
+            }
+        }
+    }
+    for (uint32_t tile : field.dirtyTiles) {
+        int tx = tile % resolution, tz = tile / resolution;
+        int x0 = tx > 0 ? tx - 1 : 0, x1 = tx + 2 < corners ? tx + 2 : corners - 1;
+        int z0 = tz > 0 ? tz - 1 : 0, z1 = tz + 2 < corners ? tz + 2 : corners - 1;
+        for (int cz = z0; cz <= z1; ++cz) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                updateNormal(cx, cz);
+            }
+            if (x0 < rowDirtyMin[cz]) rowDirtyMin[cz] = x0;
+            if (x1 > rowDirtyMax[cz]) rowDirtyMax[cz] = x1;
+        }
+    }
+    field.clearDirty();
+
+    if (vertexBuffer) gl.BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    for (int cz = 0; cz < corners; ++cz) {
+        if (rowDirtyMax[cz] < 0) continue;
+        size_t first = (size_t)cz * corners + rowDirtyMin[cz];
+        size_t count = rowDirtyMax[cz] - rowDirtyMin[cz] + 1;
+        if (vertexBuffer) {
+            gl.BufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), &vertices[first]);
+        }
+        lastUpdatedVertices += (int)count;
+        rowDirtyMin[cz] = corners;
+        rowDirtyMax[cz] = -1;
+    }
+    if (vertexBuffer) gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SnowGroundRenderer::markStale(SnowHeightfield& field) const {
+    if (field.resolution != resolution) return; // draw() rebuilds it all
+    for (size_t tile = 0; tile < drawnCount.size(); ++tile) {
+        if (field.flakeCount[tile] != drawnCount[tile]) field.markDirty((int)tile);
+    }
+}
+
+void SnowGroundRenderer::draw(SnowHeightfield& field) {
+    if (field.resolution != resolution) init(field);
+    updateDirty(field);
+
+    const char* vertexBase = (const char*)vertices.data();
+    const void* indexBase = indices.data();
+    if (vertexBuffer) {
+        gl.BindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        vertexBase = nullptr;
+        indexBase = nullptr;
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), vertexBase);
+    glNormalPointer(GL_FLOAT, sizeof(Vertex), vertexBase + 3 * sizeof(float));
+
+    glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, indexBase);
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    if (vertexBuffer) {
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
@@ -0,0 +1,68 @@
+/*
+    Draws the settled snow of a SnowHeightfield as a layer over the
+    ground mound.
+
+    The layer is one grid mesh with a vertex at every tile corner, kept on
+    the CPU and in a vertex buffer. Each draw() only recomputes the
+    vertices around tiles the heightfield marked dirty and re-uploads the
+    changed span of each vertex row with glBufferSubData, so a steady
+    snowfall costs a few small uploads per frame rather than a new mesh.
+    Corners with no snow around them sit just under the mound and stay
+    hidden. Without buffer objects the same arrays are drawn from client
+    memory.
+
+    A field whose dirty marks were cleared by someone else (the copies the
+    sim thread publishes, see SimThread.h) goes through markStale() first,
+    which compares it with the counts the mesh was last built from.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SnowGL.h"
+
+class SnowHeightfield;
+
+class SnowGroundRenderer {
+public:
+    // Build the grid for the heightfield's size; needs a current context
+    // and loadGLFunctions() done
+    void init(const SnowHeightfield& field);
+    void destroy();
+
+    // Bring dirty tiles up to date, clear them in the heightfield and draw
+    // in globe-local coordinates with the current color
+    void draw(SnowHeightfield& field);
+
+    // Mark dirty every tile of field that differs from what was last drawn
+    void markStale(SnowHeightfield& field) const;
+
+    // Triangles each draw() sends
+    size_t triangleCount() const { return indices.size() / 3; }
+
+    // Vertices re-uploaded by the last draw()
+    int lastUpdatedVertices = 0;
+
+private:
+    void updateDirty(SnowHeightfield& field);
+    float cornerHeight(const SnowHeightfield& field, int cx, int cz) const;
+    void updateNormal(int cx, int cz);
+
+    // Interleaved position + normal, as in MeshCache
+    struct Vertex {
+        float px, py, pz;
+        float nx, ny, nz;
+    };
+
+    int resolution = 0;  // Tiles per side; corners per side is one more
+    float tileSize = 0.0f;
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<int> rowDirtyMin, rowDirtyMax; // Changed corner span per row
+    std::vector<uint32_t> drawnCount;          // Flakes per tile the mesh was built from
+
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+};
@@ -0,0 +1,68 @@
+#include "SnowHeightfield.h"
+
+void SnowHeightfield::init(int tiles, float radius, float centerY, float scaleY, float averageDepth, size_t totalFlakes) {
+    resolution = tiles;
+    groundRadius = radius;
+    groundCenterY = centerY;
+    groundScaleY = scaleY;
+
+    // Tiles whose centre lies on the mound share the snow
+    int onMound = 0;
+    tileBase.resize((size_t)resolution * resolution);
+    for (int tz = 0; tz < resolution; ++tz) {
+        for (int tx = 0; tx < resolution; ++tx) {
+            float x = -groundRadius + (tx + 0.5f) * tileSize();
+            float z = -groundRadius + (tz + 0.5f) * tileSize();
+            if (x * x + z * z < groundRadius * groundRadius) ++onMound;
+            tileBase[tz * resolution + tx] = baseHeight(x, z);
+        }
+    }
+    depthPerFlake = totalFlakes > 0 ? averageDepth * onMound / totalFlakes : averageDepth;
+
+    flakeCount.assign((size_t)resolution * resolution, 0);
+    tileDirty.assign((size_t)resolution * resolution, 0);
+    dirtyTiles.clear();
+    settledTotal = 0;
+
+    // A fresh field replaces whatever the renderer had
+    for (int tile = 0; tile < resolution * resolution; ++tile) {
+        markDirty(tile);
+    }
+}
+
+void SnowHeightfield::deposit(int tile) {
+    const float maxStep = reposeSlope * tileSize();
+    static const int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+    // Roll to the lowest neighbour while the drop is too steep. Each move
+    // goes strictly downhill, so this ends within a few tiles.
+    for (;;) {
+        int tx = tile % resolution, tz = tile / resolution;
+        float height = tileBase[tile] + (flakeCount[tile] + 1) * depthPerFlake;
+        int lowest = -1;
+        float lowestHeight = height - maxStep;
+        for (const auto& offset : offsets) {
+            int nx = tx + offset[0], nz = tz + offset[1];
+            if (nx < 0 || nz < 0 || nx >= resolution || nz >= resolution) continue;
+            int neighbour = nz * resolution + nx;
+            float h = tileBase[neighbour] + (flakeCount[neighbour] + 1) * depthPerFlake;
+            if (h < lowestHeight) {
+                lowest = neighbour;
+                lowestHeight = h;
+            }
+        }
+        if (lowest < 0) break;
+        tile = lowest;
+    }
+
+    ++flakeCount[tile];
+    ++settledTotal;
+    markDirty(tile);
+}
+
+void SnowHeightfield::clearDirty() {
+    for (uint32_t tile : dirtyTiles) {
+        tileDirty[tile] = 0;
+    }
+    dirtyTiles.clear();
+}
@@ -0,0 +1,104 @@
+/*
+    Settled snow on the globe floor, as a 2D grid of snow depth.
+
+    Tiles cover the ground mound (the squashed sphere drawn under the
+    hut) in globe-local coordinates, so the snow turns with the
+    globe. Each tile counts the flakes that settled on it; the surface is
+    the mound height plus count * depthPerFlake. A deposited flake rolls
+    to a lower neighbouring tile while the step down is steeper than the
+    angle of repose, so the snow spreads into drifts rather than spikes.
+    Tiles whose count changes are marked dirty so the renderer only
+    rebuilds those parts of the mesh.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+class SnowHeightfield {
+public:
+    // Tiles per side of the square grid
+    int resolution = 64;
+
+    // Ground mound: top of a sphere of groundRadius squashed to
+    // groundScaleY and centred at groundCenterY
+    float groundRadius = 4.0f;
+    float groundCenterY = -4.5f;
+    float groundScaleY = 0.15f;
+
+    // Height one settled flake adds to its tile
+    float depthPerFlake = 0.01f;
+
+    // Steepest snow slope (rise over run) before flakes roll downhill
+    float reposeSlope = 0.7f;
+
+    std::vector<uint32_t> flakeCount;  // Settled flakes per tile
+    std::vector<float> tileBase;       // Mound height at each tile centre
+    std::vector<uint8_t> tileDirty;    // Changed since the last clearDirty()
+    std::vector<uint32_t> dirtyTiles;  // Indices of dirty tiles
+    uint64_t settledTotal = 0;         // Flakes currently held in the field
+
+    // Set up an empty field. averageDepth is the depth the snow would have
+    // over the whole mound if totalFlakes all settled on it.
+    void init(int tiles, float radius, float centerY, float scaleY, float averageDepth, size_t totalFlakes);
+
+    float tileSize() const { return 2.0f * groundRadius / resolution; }
+
+    // Tile under a globe-local position, or -1 off the grid
+    int tileAt(float x, float z) const {
+        int tx = (int)std::floor((x + groundRadius) / tileSize());
+        int tz = (int)std::floor((z + groundRadius) / tileSize());
+        if (tx < 0 || tz < 0 || tx >= resolution || tz >= resolution) return -1;
+        return tz * resolution + tx;
+    }
+
+    // Height of the bare mound at a globe-local position
+    float baseHeight(float x, float z) const {
+        float rSq = groundRadius * groundRadius - (x * x + z * z);
+        return rSq > 0.0f ? groundCenterY + groundScaleY * std::sqrt(rSq) : groundCenterY;
+    }
+
+    // Height of the snow surface at a globe-local position
+    float surfaceHeight(float x, float z) const {
+        int tile = tileAt(x, z);
+        float depth = tile >= 0 ? flakeCount[tile] * depthPerFlake : 0.0f;
+        return baseHeight(x, z) + depth;
+    }
+
+    // Add one flake at tile, letting it roll down to where it rests
+    void deposit(int tile);
+
+    void remove(int tile, uint32_t flakes) {
+        flakeCount[tile] -= flakes;
+        settledTotal -= flakes;
+        markDirty(tile);
+    }
+
+    void markDirty(int tile) {
+        if (!tileDirty[tile]) {
+            tileDirty[tile] = 1;
+            dirtyTiles.push_back((uint32_t)tile);
+        }
+    }
+
+    // Called by whoever consumed dirtyTiles (the ground renderer)
+    void clearDirty();
+};
+
+// Rotate a world position into globe-local coordinates and back, matching
+// glRotatef(angleDegrees, 0, 1, 0) used to draw the globe contents
+inline void worldToGlobe(float angleDegrees, float x, float z, float& lx, float& lz) {
+    float a = angleDegrees * 3.14159265f / 180.0f;
+    float c = std::cos(a), s = std::sin(a);
+    lx = c * x - s * z;
+    lz = s * x + c * z;
+}
+
+inline void globeToWorld(float angleDegrees, float lx, float lz, float& x, float& z) {
+    float a = angleDegrees * 3.14159265f / 180.0f;
+    float c = std::cos(a), s = std::sin(a);
+    x = c * lx + s * lz;
+    z = -s * lx + c * lz;
+}
@@ -0,0 +1,57 @@
+/*
+    Counter-based random numbers for the simulation.
+
+    Uses Widynski's "Squares" generator: the output is a pure function of
+    a 64-bit key and a 64-bit counter, with no state carried between calls.
+    The simulation derives the key from its seed and a stream number
+    (the step index, or a fixed id for initialization) and the counter from
+    the flake index and draw number, so any flake can be processed on any
+    thread in any order and still get the same numbers for the same seed.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// Streams used for initialization; per-step streams use the step index
+const uint64_t SNOW_STREAM_FLAKES = ~0ull;
+const uint64_t SNOW_STREAM_STARS = ~0ull - 1;
+
+// Or'd with the step index for flakes thrown up from the settled snow
+const uint64_t SNOW_STREAM_LIFT = 1ull << 62;
+
+// Or'd with the step index for where a shake pushes the water
+const uint64_t SNOW_STREAM_FLUID = 1ull << 61;
+
+// splitmix64 finalizer, used to spread seed and stream bits into a key
+inline uint64_t snowMix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+struct SnowRandom {
+    uint64_t key;
+
+    SnowRandom(uint64_t seed, uint64_t stream)
+        // Squares wants an odd key with well mixed bits
+        : key(snowMix64(seed ^ snowMix64(stream)) | 1) {}
+
+    // 32 random bits for this counter (Squares, four rounds)
+    uint32_t bits(uint64_t counter) const {
+        uint64_t x = counter * key;
+        uint64_t y = x;
+        uint64_t z = y + key;
+        x = x * x + y; x = (x >> 32) | (x << 32);
+        x = x * x + z; x = (x >> 32) | (x << 32);
+        x = x * x + y; x = (x >> 32) | (x << 32);
+        return (uint32_t)((x * x + z) >> 32);
+    }
+
+    // Uniform float in [lo, hi)
+    float uniform(uint64_t counter, float lo, float hi) const {
+        float unit = (bits(counter) >> 8) * (1.0f / 16777216.0f);
+        return lo + (hi - lo) * unit;
+    }
+};
@@ -0,0 +1,834 @@
+#include "SnowSim.h"
+#include "FrameProfiler.h"
+#include "SnowRandom.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+SnowflakeStore::SnowflakeStore(const SnowflakeStore& other) {
+    *this = other;
+}
+
+SnowflakeStore& SnowflakeStore::operator=(const SnowflakeStore& other) {
+    if (this == &other) return *this;
+    resize(0);
+    reserve(other.flakes);
+    resize(other.flakes);
+    std::array<FloatArray*, FIELD_COUNT> to = fields();
+    std::array<FloatArray*, FIELD_COUNT> from = const_cast<SnowflakeStore&>(other).fields();
+    for (int f = 0; f < FIELD_COUNT; ++f) {
+        if (flakes) memcpy(to[f]->ptr, from[f]->ptr, flakes * sizeof(float));
+    }
+    return *this;
+}
+
+SnowflakeStore::SnowflakeStore(SnowflakeStore&& other) noexcept {
+    *this = std::move(other);
+}
+
+SnowflakeStore& SnowflakeStore::operator=(SnowflakeStore&& other) noexcept {
+    if (this == &other) return *this;
+    freePool();
+    pool = other.pool;
+    poolCapacity = other.poolCapacity;
+    flakes = other.flakes;
+    poolOwner = std::move(other.poolOwner);
+    pointFields();
+    other.pool = nullptr;
+    other.poolCapacity = 0;
+    other.flakes = 0;
+    other.pointFields();
+    return *this;
+}
+
+SnowflakeStore::~SnowflakeStore() {
+    freePool();
+}
+
+void SnowflakeStore::freePool() {
+    if (poolOwner) {
+        poolOwner.reset();
+    }
+    else if (pool) {
+        AlignedAllocator<float>().deallocate(pool, poolCapacity * FIELD_COUNT);
+    }
+    pool = nullptr;
+}
+
+void SnowflakeStore::pointFields() {
+    std::array<FloatArray*, FIELD_COUNT> all = fields();
+    for (int f = 0; f < FIELD_COUNT; ++f) {
+        all[f]->ptr = pool ? pool + f * poolCapacity : nullptr;
+        all[f]->n = flakes;
+    }
+}
+
+void SnowflakeStore::adopt(float* memory, size_t capacity, size_t count, std::shared_ptr<void> owner) {
+    freePool();
+    pool = memory;
+    poolCapacity = capacity;
+    flakes = count;
+    poolOwner = std::move(owner);
+    pointFields();
+}
+
+void SnowflakeStore::reserve(size_t n) {
+    if (n <= poolCapacity) return;
+
+    // Round each field up to whole cache lines so every field stays aligned
+    size_t capacity = (n + 15) & ~(size_t)15;
+    float* grown = AlignedAllocator<float>().allocate(capacity * FIELD_COUNT);
+    std::array<FloatArray*, FIELD_COUNT> all = fields();
+    for (int f = 0; f < FIELD_COUNT; ++f) {
+        float* field = grown + f * capacity;
+        if (flakes) memcpy(field, all[f]->ptr, flakes * sizeof(float));
+        all[f]->ptr = field;
+    }
+    freePool();
+    pool = grown;
+    poolCapacity = capacity;
+}
+
+void SnowflakeStore::resize(size_t n) {
+    if (n > poolCapacity) reserve(n);
+    flakes = n;
+    for (FloatArray* a : fields()) a->n = n;
+}
+
+// Run fn over [0, count) on the pool if there is one
+static void forRange(ThreadPool* pool, size_t count, const ThreadPool::RangeFunc& fn) {
+    if (pool) {
+        pool->parallelFor(count, SNOW_CHUNK_SIZE, fn);
+    }
+    else if (count > 0) {
+        fn(0, count);
+    }
+}
+
+// Initialize stars for night sky
+void SnowSim::initStars() {
+    SnowRandom rng(seed, SNOW_STREAM_STARS);
+    const float twoPi = 2.0f * M_PI;
+
+    stars.clear();
+    stars.reserve(numStars);
+    for (size_t i = 0; i < numStars; ++i) {
+        uint64_t c = (uint64_t)i * 8;
+        Star star;
+        star.x = rng.uniform(c + 0, -20.0f, 20.0f);
+        star.y = rng.uniform(c + 1, 5.0f, 20.0f);
+        star.z = rng.uniform(c + 2, -20.0f, 20.0f);
+        star.brightness = rng.uniform(c + 3, 0.5f, 1.0f);
+        star.twinkleRate = rng.uniform(c + 4, 0.5f, 3.0f);
+        star.twinkleOffset = rng.uniform(c + 5, 0.0f, twoPi);
+        stars.push_back(star);
+    }
+}
+
+// Initialize hut lights
+void SnowSim::initHutLights() {
+    hutLights.clear();
+
+    // Lights around the door
+    HutLight doorLight1 = { 0.2f, -0.1f, 0.55f, 1.0f, 0.8f, 0.0f, 1.5f, 0.0f, false }; // Steady yellow
+    HutLight doorLight2 = { -0.2f, -0.1f, 0.55f, 1.0f, 0.8f, 0.0f, 1.5f, 0.0f, false }; // Steady yellow
+    hutLights.push_back(doorLight1);
+    hutLights.push_back(doorLight2);
+
+    // Window lights
+    HutLight windowLight1 = { 0.4f, 0.1f, 0.55f, 0.9f, 0.9f, 0.7f, 0.0f, 0.0f, false }; // Steady warm white
+    HutLight windowLight2 = { -0.4f, 0.1f, 0.55f, 0.9f, 0.9f, 0.7f, 0.0f, 0.0f, false }; // Steady warm white
+    hutLights.push_back(windowLight1);
+    hutLights.push_back(windowLight2);
+
+    // Roof decoration lights
+    for (int i = 0; i < 8; i++) {
+        float angle = i * (2.0f * M_PI / 8.0f);
+        HutLight roofLight;
+        roofLight.x = 0.7f * cos(angle);
+        roofLight.y = 0.3f;
+        roofLight.z = 0.7f * sin(angle);
+
+        // Alternating colors
+        if (i % 3 == 0) {
+            roofLight.r = 1.0f;
+            roofLight.g = 0.0f;
+            roofLight.b = 0.0f; // Red
+        }
+        else if (i % 3 == 1) {
+            roofLight.r = 0.0f;
+            roofLight.g = 1.0f;
+            roofLight.b = 0.0f; // Green
+        }
+        else {
+            roofLight.r = 0.0f;
+            roofLight.g = 0.5f;
+            roofLight.b = 1.0f; // Blue
+        }
+
+        roofLight.blinkRate = 0.5f + (i * 0.2f); // Different blink rates
+        roofLight.blinkPhase = i * 0.7f; // Different phases
+        roofLight.blinks = true; // These lights blink
+
+        hutLights.push_back(roofLight);
+    }
+
+    // Chimney light 
+    HutLight chimneyLight = { 0.3f, 1.1f, 0.0f, 1.0f, 0.6f, 0.2f, 2.0f, 0.0f, true }; // Blinking orange
+    hutLights.push_back(chimneyLight);
+}
+
+// Random size, speed, spin and sparkle for a new flake, drawn from the
+// flake's block of counters starting at c
+static void randomFlakeLook(const SnowRandom& rng, uint64_t c, Snowflake& flake) {
+    const float twoPi = 2.0f * M_PI;
+    flake.size = rng.uniform(c + 3, 0.02f, 0.08f);
+    flake.speed = rng.uniform(c + 4, 0.3f, 1.0f);
+    flake.angle = rng.uniform(c + 5, 0.0f, twoPi);
+    flake.sparkleRate = rng.uniform(c + 8, 2.0f, 6.0f);
+    flake.sparklePhase = rng.uniform(c + 9, 0.0f, twoPi);
+}
+
+// Initialize snowflakes randomly within the globe. The pool is sized once
+// and filled in parallel; each flake's values depend only on its index.
+void SnowSim::initSnowflakes() {
+    SnowRandom rng(seed, SNOW_STREAM_FLAKES);
+    const float twoPi = 2.0f * M_PI;
+
+    snowflakes.clear();
+    snowflakes.reserve(numSnowflakes);
+    snowflakes.resize(numSnowflakes);
+
+    auto initChunk = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            // Each flake owns 16 counters
+            uint64_t c = (uint64_t)i * 16;
+            float radius = rng.uniform(c + 0, 0.0f, GLOBE_RADIUS * 0.9f);
+            float angle = rng.uniform(c + 1, 0.0f, twoPi);
+            float height = rng.uniform(c + 2, -GLOBE_RADIUS * 0.8f, GLOBE_RADIUS * 0.9f);
+
+            Snowflake flake;
+            flake.x = radius * cos(angle);
+            flake.y = height;
+            flake.z = radius * sin(angle);
+            randomFlakeLook(rng, c, flake);
+            flake.vx = rng.uniform(c + 6, -0.01f, 0.01f);
+            flake.vy = -flake.speed * 0.01f; // Initial downward velocity
+            flake.vz = rng.uniform(c + 7, -0.01f, 0.01f);
+
+            snowflakes.set(i, flake);
+        }
+    };
+    forRange(threadPool, numSnowflakes, initChunk);
+}
+
+// Regenerate snowflakes, stars and hut lights from the seed
+void SnowSim::init() {
+    frame = 0;
+    prevGlobeRotationY = globeRotationY;
+    initSnowflakes();
+    activeCount = snowflakes.count();
+    initSnowField();
+    initStars();
+    initHutLights();
+    initFluid();
+}
+
+void SnowSim::copyState(const SnowSim& other) {
+    snowflakes = other.snowflakes;
+    activeCount = other.activeCount;
+    stepLimit = other.stepLimit;
+    stars = other.stars;
+    hutLights = other.hutLights;
+    numSnowflakes = other.numSnowflakes;
+    numStars = other.numStars;
+
+    rotationSpeed = other.rotationSpeed;
+    globeRotationY = other.globeRotationY;
+    prevGlobeRotationY = other.prevGlobeRotationY;
+    isRotating = other.isRotating;
+    isShaking = other.isShaking;
+    shakeMagnitude = other.shakeMagnitude;
+    isNightMode = other.isNightMode;
+    dayNightTransition = other.dayNightTransition;
+    totalTime = other.totalTime;
+    seed = other.seed;
+    frame = other.frame;
+
+    snowField = other.snowField;
+    fluid = other.fluid;
+    fluidFlow = other.fluidFlow;
+    cpuFlakes = other.cpuFlakes;
+    stepParams = other.stepParams;
+}
+
+void SnowSim::initSnowField(int resolution) {
+    snowField.init(resolution, GLOBE_RADIUS * 0.8f, -GLOBE_RADIUS + 0.5f, 0.15f, settledDepth, numSnowflakes);
+}
+
+// Water fills the glass out to where flakes bounce, above the floor
+void SnowSim::initFluid() {
+    fluid.init(fluidResolution, GLOBE_RADIUS, GLOBE_RADIUS * 0.95f, -GLOBE_RADIUS + 0.5f);
+}
+
+// Function to rotate a point around the y-axis
+static void rotatePointY(float& x, float& z, float angle) {
+    float radAngle = angle * M_PI / 180.0f;
+    float newX = x * cos(radAngle) - z * sin(radAngle);
+    float newZ = x * sin(radAngle) + z * cos(radAngle);
+    x = newX;
+    z = newZ;
+}
+
+// Advance the day/night transition towards the current mode
+void SnowSim::updateDayNight(float dt) {
+    float change = transitionSpeed * dt * 60.0f;
+    if (isNightMode) {
+        // Transition to night
+        if (dayNightTransition < 1.0f) {
+            dayNightTransition += change;
+            if (dayNightTransition > 1.0f) dayNightTransition = 1.0f;
+        }
+    }
+    else {
+        // Transition to day
+        if (dayNightTransition > 0.0f) {
+            dayNightTransition -= change;
+            if (dayNightTransition < 0.0f) dayNightTransition = 0.0f;
+        }
+    }
+}
+
+// Sky color based on transition value
+void SnowSim::backgroundColor(float& r, float& g, float& b) const {
+    r = 0.5f - (0.45f * dayNightTransition); // 0.5 (day) to 0.05 (night)
+    g = 0.8f - (0.75f * dayNightTransition); // 0.8 (day) to 0.05 (night)
+    b = 0.98f - (0.8f * dayNightTransition); // 0.98 (day) to 0.18 (night)
+}
+
+// Deterministic part of the snow physics: gravity, rotation force, damping,
+// integration, ground bounce, hut collision and globe reflection.
+// Written once against the lane interface in SnowSimd.h and instantiated
+// for the widest vector type and for plain floats (fallback and tail).
+template <typename V>
+static size_t updateSnowKernel(SnowflakeStore& s, size_t begin, size_t end, const SnowStepParams& p) {
+    typedef typename V::Mask M;
+
+    const V gravity(p.gravity), damping(p.damping), dtScale(p.dtScale);
+    const V rotationForce(p.rotationForce);
+    const V angleStep(p.angleStep), angleSpeedStep(p.angleSpeedStep);
+    const V groundY(p.groundY), groundBounce(p.groundBounce);
+    const V hutX(p.hutX), hutZ(p.hutZ), hutSize(p.hutSize), negHutSize(-p.hutSize);
+    const V hutMinY(p.hutMinY), hutMaxY(p.hutMaxY);
+    const V boundarySq(p.boundary * p.boundary), boundaryPlace(p.boundaryPlace);
+    const V wallDamping(p.wallDamping), hutBounce(0.5f), zero(0.0f), two(2.0f);
+
+    size_t i = begin;
+    for (; i + V::width <= end; i += V::width) {
+        V x = V::load(&s.x[i]), y = V::load(&s.y[i]), z = V::load(&s.z[i]);
+        V vx = V::load(&s.vx[i]), vy = V::load(&s.vy[i]), vz = V::load(&s.vz[i]);
+        V speed = V::load(&s.speed[i]);
+
+        // Gravity and the inertia force from globe rotation
+        vy = vy - gravity * speed;
+        vx = vx - rotationForce * z;
+        vz = vz + rotationForce * x;
+
+        // Air resistance, then integrate
+        vx = vx * damping;
+        vy = vy * damping;
+        vz = vz * damping;
+        x = x + vx * dtScale;
+        y = y + vy * dtScale;
+        z = z + vz * dtScale;
+
+        // Ground bounce with energy loss
+        M below = y < groundY;
+        y = lanesSelect(below, groundY, y);
+        vy = lanesSelect(below, -vy * groundBounce, vy);
+
+        // Box collision with the hut, pushed out along the shallower axis
+        V dx = x - hutX;
+        V dz = z - hutZ;
+        V adx = lanesAbs(dx);
+        V adz = lanesAbs(dz);
+        M hit = maskAnd(maskAnd(y < hutMaxY, y > hutMinY), maskAnd(adx < hutSize, adz < hutSize));
+        if (maskAny(hit)) {
+            M alongX = adx > adz;
+            M pushX = maskAnd(hit, alongX);
+            M pushZ = maskAndNot(alongX, hit);
+            x = lanesSelect(pushX, hutX + lanesSelect(dx > zero, hutSize, negHutSize), x);
+            vx = lanesSelect(pushX, -vx * hutBounce, vx);
+            z = lanesSelect(pushZ, hutZ + lanesSelect(dz > zero, hutSize, negHutSize), z);
+            vz = lanesSelect(pushZ, -vz * hutBounce, vz);
+        }
+
+        // Reflect off the globe boundary
+        V distSq = x * x + y * y + z * z;
+        M outside = distSq > boundarySq;
+        if (maskAny(outside)) {
+            V dist = lanesSqrt(distSq);
+            V nx = x / dist, ny = y / dist, nz = z / dist;
+            V dot = two * (vx * nx + vy * ny + vz * nz);
+            vx = lanesSelect(outside, (vx - dot * nx) * wallDamping, vx);
+            vy = lanesSelect(outside, (vy - dot * ny) * wallDamping, vy);
+            vz = lanesSelect(outside, (vz - dot * nz) * wallDamping, vz);
+            x = lanesSelect(outside, nx * boundaryPlace, x);
+            y = lanesSelect(outside, ny * boundaryPlace, y);
+            z = lanesSelect(outside, nz * boundaryPlace, z);
+        }
+
+        V angle = V::load(&s.angle[i]);
+        angle = angle + angleStep + angleSpeedStep * speed;
+
+        x.store(&s.x[i]); y.store(&s.y[i]); z.store(&s.z[i]);
+        vx.store(&s.vx[i]); vy.store(&s.vy[i]); vz.store(&s.vz[i]);
+        angle.store(&s.angle[i]);
+    }
+    return i;
+}
+
+// Run the kernel over [begin, end) with the widest lanes, then finish the tail
+void updateSnowRange(SnowflakeStore& s, size_t begin, size_t end, const SnowStepParams& p) {
+    size_t done = updateSnowKernel<FloatLanes>(s, begin, end, p);
+    updateSnowKernel<ScalarLanes>(s, done, end, p);
+}
+
+// Update snow positions and handle shaking and rotation effects
+void SnowSim::updateSnow(float deltaTime) {
+    // Per-step constants are tuned for 60 Hz; stepScale stretches them to
+    // this step's length (decays become powers, impulses scale linearly)
+    const float stepScale = deltaTime * 60.0f;
+
+    // Apply shake decay
+    if (isShaking) {
+        shakeMagnitude *= std::pow(shakeDecay, stepScale);
+        if (shakeMagnitude < 0.01f) {
+            isShaking = false;
+            shakeMagnitude = 0.0f;
+        }
+    }
+
+    // Calculate rotation effect on particles
+    float rotationEffect = 0.0f;
+    if (isRotating) {
+        rotationEffect = rotationSpeed * 2.0f;
+        rotationSpeed *= std::pow(0.98f, stepScale);  // Damping
+
+        if (fabs(rotationSpeed) < 0.05f) {
+            isRotating = false;
+            rotationSpeed = 0.0f;
+        }
+    }
+
+    // Update globe rotation
+    prevGlobeRotationY = globeRotationY;
+    if (isRotating) {
+        globeRotationY += rotationSpeed * stepScale;
+        // Keep angle between 0-360
+        if (globeRotationY > 360.0f) globeRotationY -= 360.0f;
+        if (globeRotationY < 0.0f) globeRotationY += 360.0f;
+    }
+
+    // Shaking and spinning move every flake
+    if (isShaking || isRotating) wakeAll();
+
+    float minY = -GLOBE_RADIUS + 0.5f;
+    size_t count = std::min(activeCount, stepLimit);
+
+    SnowStepParams params;
+    params.shakeMagnitude = isShaking ? shakeMagnitude : 0.0f;
+    params.gravity = 0.0005f * stepScale;
+    params.damping = std::pow(0.99f, stepScale);
+    params.dtScale = stepScale;
+    params.rotationForce = 0.0f;
+    params.angleStep = 0.0f;
+    params.angleSpeedStep = 0.0f;
+    if (isShaking) {
+        // Spin the snowflakes faster during shaking
+        params.angleStep = shakeMagnitude * 10.0f * stepScale;
+    }
+    else if (isRotating) {
+        // Apply opposite force to simulate inertia
+        params.rotationForce = rotationEffect * 0.01f * stepScale;
+        params.angleStep = rotationEffect * 0.5f * stepScale;
+    }
+    else {
+        // Gentle rotation even when not shaking or rotating
+        params.angleSpeedStep = 0.2f * stepScale;
+    }
+    params.groundY = minY;
+    params.groundBounce = 0.3f;
+
+    // Rotate hut position according to globe rotation
+    params.hutX = 0.0f;
+    params.hutZ = 0.0f;
+    rotatePointY(params.hutX, params.hutZ, globeRotationY);
+    params.hutSize = 0.8f;
+    params.hutMinY = -GLOBE_RADIUS + 0.5f;
+    params.hutMaxY = -GLOBE_RADIUS + 2.0f;
+
+    params.boundary = GLOBE_RADIUS * 0.95f;
+    params.boundaryPlace = GLOBE_RADIUS * 0.94f;
+    params.wallDamping = 0.8f;
+    stepParams = params;
+
+    // Another backend moves the flakes; only the globe state advances here
+    if (!cpuFlakes) return;
+
+    // The water carries shakes and spins to the flakes instead
+    bool fluidMoving = false;
+    if (fluidFlow) {
+        ProfileScope scope(profiler, "sim.fluid");
+        params.rotationForce = 0.0f;
+        stirFluid(stepScale);
+        fluid.step(stepScale, threadPool);
+        fluidMoving = fluid.isMoving();
+    }
+
+    if (flakeInteraction) {
+        ProfileScope scope(profiler, "sim.interaction");
+        applyFlakeInteraction(stepScale);
+    }
+
+    restingByChunk.resize((count + SNOW_CHUNK_SIZE - 1) / SNOW_CHUNK_SIZE);
+    bool findingResting = snowAccumulation || flakeSleep;
+
+    auto updateChunk = [&](size_t begin, size_t end) {
+        size_t bytes = (end - begin) * sizeof(float);
+        memcpy(&snowflakes.prevX[begin], &snowflakes.x[begin], bytes);
+        memcpy(&snowflakes.prevY[begin], &snowflakes.y[begin], bytes);
+        memcpy(&snowflakes.prevZ[begin], &snowflakes.z[begin], bytes);
+        applyRandomImpulses(begin, end, params);
+        if (fluidMoving) applyFluid(begin, end, params);
+        updateSnowRange(snowflakes, begin, end, params);
+        if (findingResting) findResting(begin, end, params, fluidMoving);
+    };
+
+    {
+        ProfileScope scope(profiler, "sim.flakes");
+        if (threadPool) {
+            threadPool->parallelFor(count, SNOW_CHUNK_SIZE, updateChunk);
+        }
+        else {
+            // Chunk by chunk as the pool would, so every chunk's resting list
+            // is refreshed and none is touched when no flake is active
+            for (size_t begin = 0; begin < count; begin += SNOW_CHUNK_SIZE) {
+                updateChunk(begin, std::min(begin + SNOW_CHUNK_SIZE, count));
+            }
+        }
+    }
+
+    // Changing the flake set is serial so flake order stays deterministic
+    ProfileScope scope(profiler, "sim.settle");
+    if (findingResting) retireResting();
+    if (snowAccumulation && isShaking && shakeMagnitude > 0.5f) liftSnow(stepScale);
+}
+
+// Collect flakes in [begin, end) that came to rest this step: those that
+// touched the snow surface slowly enough to stick, and those barely moving
+// just above the floor or the snow, which go to sleep. A flake the water
+// still carries is not at rest, however slow it is in the water. Only
+// reads the heightfield and the water, so chunks run in parallel.
+void SnowSim::findResting(size_t begin, size_t end, const SnowStepParams& p, bool withWater) {
+    std::vector<uint32_t>& resting = restingByChunk[begin / SNOW_CHUNK_SIZE];
+    resting.clear();
+
+    const float settleSq = snowAccumulation ? settleSpeed * settleSpeed : 0.0f;
+    const float sleepSq = flakeSleep ? sleepSpeed * sleepSpeed : 0.0f;
+    const float slowSq = settleSq > sleepSq ? settleSq : sleepSq;
+    for (size_t i = begin; i < end; ++i) {
+        float vx = snowflakes.vx[i], vy = snowflakes.vy[i], vz = snowflakes.vz[i];
+        float speedSq = vx * vx + vy * vy + vz * vz;
+        if (speedSq >= slowSq) continue;
+
+        float y = snowflakes.y[i];
+        if (withWater) {
+            float ux, uy, uz;
+            fluid.sample(snowflakes.x[i], y, snowflakes.z[i], ux, uy, uz);
+            if (ux * ux + uy * uy + uz * uz >= slowSq) continue;
+        }
+        float lx, lz;
+        worldToGlobe(globeRotationY, snowflakes.x[i], snowflakes.z[i], lx, lz);
+        bool onField = snowField.tileAt(lx, lz) >= 0;
+        float surface = onField ? snowField.surfaceHeight(lx, lz) : p.groundY;
+
+        if (speedSq < settleSq && onField && y <= surface) {
+            resting.push_back((uint32_t)i);
+        }
+        else if (speedSq < sleepSq && (y <= p.groundY + sleepMargin || y <= surface + sleepMargin)) {
+            resting.push_back((uint32_t)i | RESTING_SLEEP);
+        }
+    }
+}
+
+// Deposit settled flakes in the heightfield and move sleepers past the
+// active range. Highest index first: each step only moves flakes from the
+// end of the active range, which are never still queued.
+void SnowSim::retireResting() {
+    for (size_t chunk = restingByChunk.size(); chunk-- > 0;) {
+        const std::vector<uint32_t>& resting = restingByChunk[chunk];
+        for (size_t k = resting.size(); k-- > 0;) {
+            uint32_t i = resting[k] & ~RESTING_SLEEP;
+            if (resting[k] & RESTING_SLEEP) {
+                // Sleepers are drawn where they stopped
+                snowflakes.prevX[i] = snowflakes.x[i];
+                snowflakes.prevY[i] = snowflakes.y[i];
+                snowflakes.prevZ[i] = snowflakes.z[i];
+                snowflakes.swap(i, --activeCount);
+                continue;
+            }
+            float lx, lz;
+            worldToGlobe(globeRotationY, snowflakes.x[i], snowflakes.z[i], lx, lz);
+            snowField.deposit(snowField.tileAt(lx, lz));
+            removeActive(i);
+        }
+    }
+}
+
+// Drop active flake i, keeping actives first and sleepers after them
+void SnowSim::removeActive(size_t i) {
+    snowflakes.swap(i, --activeCount);
+    snowflakes.swapRemove(activeCount);
+}
+
+void SnowSim::wakeAll() {
+    activeCount = snowflakes.count();
+}
+
+// A hard shake throws settled snow back up. Each settled flake has the
+// same chance of leaving as a resting flake had before, so the expected
+// number per tile is rounded with one random draw.
+void SnowSim::liftSnow(float stepScale) {
+    SnowRandom rng(seed, frame | SNOW_STREAM_LIFT);
+    const float chance = shakeMagnitude * 0.2f * stepScale;
+    const float tileSize = snowField.tileSize();
+
+    uint64_t spawned = 0;
+    for (int tile = 0; tile < (int)snowField.flakeCount.size(); ++tile) {
+        uint32_t settled = snowField.flakeCount[tile];
+        if (settled == 0) continue;
+
+        float expected = settled * chance + rng.uniform((uint64_t)tile, 0.0f, 1.0f);
+        uint32_t lifted = (uint32_t)expected;
+        if (lifted > settled) lifted = settled;
+        if (lifted == 0) continue;
+        snowField.remove(tile, lifted);
+
+        float tileX = -snowField.groundRadius + (tile % snowField.resolution) * tileSize;
+        float tileZ = -snowField.groundRadius + (tile / snowField.resolution) * tileSize;
+        for (uint32_t n = 0; n < lifted; ++n, ++spawned) {
+            // Counters above the per-tile draws, 16 per new flake
+            uint64_t c = ((uint64_t)snowField.flakeCount.size() + spawned) * 16;
+            float lx = tileX + rng.uniform(c + 0, 0.0f, tileSize);
+            float lz = tileZ + rng.uniform(c + 1, 0.0f, tileSize);
+
+            Snowflake flake;
+            globeToWorld(globeRotationY, lx, lz, flake.x, flake.z);
+            flake.y = snowField.surfaceHeight(lx, lz) + 0.01f;
+            randomFlakeLook(rng, c, flake);
+            flake.vx = rng.uniform(c + 6, -0.05f, 0.05f) * shakeMagnitude;
+            flake.vy = rng.uniform(c + 2, 0.05f, 0.2f) * shakeMagnitude;
+            flake.vz = rng.uniform(c + 7, -0.05f, 0.05f) * shakeMagnitude;
+            snowflakes.push_back(flake);
+            snowflakes.swap(activeCount++, snowflakes.count() - 1);
+        }
+    }
+}
+
+// Short-range repulsion and clumping between neighbouring flakes.
+// Walks flakes in grid order so neighbour positions are read from
+// contiguous memory; each flake only writes its own velocity. Sleeping
+// flakes are left out of the grid.
+void SnowSim::applyFlakeInteraction(float stepScale) {
+    size_t count = std::min(activeCount, stepLimit);
+
+    // The radii and strengths are tuned for NUM_SNOWFLAKES; scale them with
+    // the mean spacing so every flake keeps about as many neighbours
+    float spacing = numSnowflakes > 0 ? std::cbrt((float)NUM_SNOWFLAKES / numSnowflakes) : 1.0f;
+    const float interaction = interactionRadius * spacing;
+    const float repulsion = repulsionRadius * spacing;
+    const float repulsionForce = repulsionStrength * spacing * stepScale;
+    const float cohesionForce = cohesionStrength * spacing * stepScale;
+
+    grid.build(snowflakes.x.data(), snowflakes.y.data(), snowflakes.z.data(), count,
+        2.0f * interaction, threadPool);
+
+    const float radiusSq = interaction * interaction;
+    const float cohesionBand = interaction - repulsion;
+
+    auto interactChunk = [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            float px = grid.sortedX[k];
+            float py = grid.sortedY[k];
+            float pz = grid.sortedZ[k];
+            float ax = 0.0f, ay = 0.0f, az = 0.0f;
+
+            grid.forEachNear(px, py, pz, [&](uint32_t m) {
+                float dx = grid.sortedX[m] - px;
+                float dy = grid.sortedY[m] - py;
+                float dz = grid.sortedZ[m] - pz;
+                float distSq = dx * dx + dy * dy + dz * dz;
+                if (distSq >= radiusSq || distSq == 0.0f) return; // Out of range, or ourselves
+
+                float dist = sqrt(distSq);
+                float force;
+                if (dist < repulsion) {
+                    force = -repulsionForce * (1.0f - dist / repulsion);
+                }
+                else {
+                    force = cohesionForce * (1.0f - (dist - repulsion) / cohesionBand);
+                }
+                float scale = force / dist;
+                ax += dx * scale;
+                ay += dy * scale;
+                az += dz * scale;
+            });
+
+            uint32_t i = grid.sortedIndex[k];
+            snowflakes.vx[i] += ax;
+            snowflakes.vy[i] += ay;
+            snowflakes.vz[i] += az;
+        }
+    };
+
+    if (threadPool) {
+        threadPool->parallelFor(count, SNOW_CHUNK_SIZE, interactChunk);
+    }
+    else {
+        interactChunk(0, count);
+    }
+}
+
+// Random impulses: subtle air movement, or kicks while shaking.
+// With snowAccumulation off, flakes resting on the ground may get picked
+// back up by a hard shake.
+// Draws are keyed by (seed, step, flake index), so the result does not
+// depend on how flakes are split across threads.
+void SnowSim::applyRandomImpulses(size_t begin, size_t end, const SnowStepParams& p) {
+    SnowRandom rng(seed, frame);
+
+    float shake = p.shakeMagnitude;
+    float kick = fluidFlow ? 0.0f : shake * 0.05f * p.dtScale;
+    float breeze = 0.01f * p.dtScale;
+    for (size_t i = begin; i < end; ++i) {
+        uint64_t c = (uint64_t)i * 8;
+        if (shake > 0.0f) {
+            if (kick > 0.0f) {
+                snowflakes.vx[i] += rng.uniform(c + 0, -1.0f, 1.0f) * kick;
+                snowflakes.vy[i] += rng.uniform(c + 1, -1.0f, 1.0f) * kick;
+                snowflakes.vz[i] += rng.uniform(c + 2, -1.0f, 1.0f) * kick;
+            }
+
+            if (shake > 0.5f && snowflakes.y[i] <= p.groundY + 0.001f &&
+                rng.uniform(c + 3, 0.0f, 1.0f) < shake * 0.2f * p.dtScale) {
+                snowflakes.y[i] = rng.uniform(c + 4, -GLOBE_RADIUS * 0.5f, GLOBE_RADIUS * 0.9f);
+                snowflakes.prevY[i] = snowflakes.y[i]; // Jump rather than streak
+                // Reset velocity for particles that get picked back up
+                snowflakes.vx[i] = rng.uniform(c + 5, -0.01f, 0.01f) * 0.05f;
+                snowflakes.vy[i] = rng.uniform(c + 6, -0.01f, 0.01f) * 0.02f;
+                snowflakes.vz[i] = rng.uniform(c + 7, -0.01f, 0.01f) * 0.05f;
+            }
+        }
+        else {
+            snowflakes.vx[i] += rng.uniform(c + 0, -0.01f, 0.01f) * breeze;
+            snowflakes.vz[i] += rng.uniform(c + 2, -0.01f, 0.01f) * breeze;
+        }
+    }
+}
+
+// A shake pushes the water about in a few blobs per step, each somewhere
+// in the middle of the globe and in a random direction; a spinning globe
+// drags the water next to the glass and the floor along with it
+void SnowSim::stirFluid(float stepScale) {
+    if (isShaking) {
+        SnowRandom rng(seed, (frame / std::max(fluidPushSteps, 1)) | SNOW_STREAM_FLUID);
+        const float reach = GLOBE_RADIUS * 0.5f;
+        const float strength = shakeMagnitude * fluidPushStrength * stepScale;
+        for (int push = 0; push < fluidPushes; ++push) {
+            uint64_t c = (uint64_t)push * 8;
+            fluid.addImpulse(rng.uniform(c + 0, -reach, reach), rng.uniform(c + 1, -reach, reach),
+                rng.uniform(c + 2, -reach, reach), fluidPushRadius,
+                rng.uniform(c + 3, -1.0f, 1.0f) * strength, rng.uniform(c + 4, -1.0f, 1.0f) * strength,
+                rng.uniform(c + 5, -1.0f, 1.0f) * strength);
+        }
+    }
+    if (isRotating) {
+        float drag = 1.0f - std::pow(1.0f - fluidWallDrag, stepScale);
+        fluid.dragWithWalls(rotationSpeed * (float)M_PI / 180.0f, fluidWallLayer, drag);
+    }
+}
+
+// Carry flakes in [begin, end) with the water. Flakes are small enough to
+// go wherever it goes, so their own velocity stays relative to it: falling
+// and bouncing work as in still water, and the kernel that runs next keeps
+// them off the glass, the floor and the hut.
+void SnowSim::applyFluid(size_t begin, size_t end, const SnowStepParams& p) {
+    for (size_t i = begin; i < end; ++i) {
+        float ux, uy, uz;
+        fluid.sample(snowflakes.x[i], snowflakes.y[i], snowflakes.z[i], ux, uy, uz);
+        snowflakes.x[i] += ux * p.dtScale;
+        snowflakes.y[i] += uy * p.dtScale;
+        snowflakes.z[i] += uz * p.dtScale;
+    }
+}
+
+// Advance the simulation by dt seconds
+void SnowSim::step(float dt) {
+    totalTime += dt;
+    updateDayNight(dt);
+    updateSnow(dt);
+    ++frame;
+}
+
+// Globe rotation a fraction alpha of the way through the last step,
+// taking the short way across 0/360
+float SnowSim::interpolatedRotationY(float alpha) const {
+    float delta = globeRotationY - prevGlobeRotationY;
+    if (delta > 180.0f) delta -= 360.0f;
+    if (delta < -180.0f) delta += 360.0f;
+    return prevGlobeRotationY + delta * alpha;
+}
+
+bool SnowSim::isMoving(float driftingFraction) const {
+    // GPU flakes never settle or sleep
+    if (!cpuFlakes || isShaking || isRotating) return true;
+    if (dayNightTransition != (isNightMode ? 1.0f : 0.0f)) return true;
+    if (fluid.isMoving()) return true;
+    // Flakes held still past the step limit are not drifting
+    return std::min(activeCount, stepLimit) > (size_t)(driftingFraction * std::min(numSnowflakes, stepLimit));
+}
+
+uint64_t SnowSim::positionChecksum() const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const FloatArray* arrays[] = { &snowflakes.x, &snowflakes.y, &snowflakes.z };
+    for (const FloatArray* a : arrays) {
+        const unsigned char* bytes = (const unsigned char*)a->data();
+        for (size_t i = 0; i < a->size() * sizeof(float); ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+// Shake the globe
+void SnowSim::shake() {
+    isShaking = true;
+    shakeMagnitude = maxShakeMagnitude;
+}
+
+// Toggle night mode
+void SnowSim::toggleNightMode() {
+    isNightMode = !isNightMode;
+}
+
+// Spin the globe, e.g. from a mouse drag
+void SnowSim::spinGlobe(float speed) {
+    rotationSpeed = speed;
+
+    if (fabs(rotationSpeed) > 0.1f) {
+        isRotating = true;
+    }
+}
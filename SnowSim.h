@@ -0,0 +1,352 @@
+/*
+    SnowSim: the snow globe simulation without any GL or GLUT calls.
+
+    Holds the snowflakes, stars, hut lights and the globe state
+    (shaking, rotation, day/night) and advances them with step(dt).
+    The GLUT program in "Snow Globe.cpp" is one frontend over it;
+    SnowSimHeadless.cpp runs it with no display at all.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "SnowFluid.h"
+#include "SnowHeightfield.h"
+#include "SnowSimd.h"
+#include "SpatialGrid.h"
+
+// Snow parameters (NUM_SNOWFLAKES and NUM_STARS are the defaults for
+// SnowSim::numSnowflakes and SnowSim::numStars)
+const int NUM_SNOWFLAKES = 800;
+const float GLOBE_RADIUS = 5.0f;
+
+// Star variables for night sky
+const int NUM_STARS = 200;
+struct Star {
+    float x, y, z;
+    float brightness;
+    float twinkleRate;
+    float twinkleOffset;
+};
+
+// Snowflake struct
+struct Snowflake {
+    float x, y, z;
+    float size;
+    float speed;
+    float angle; // Angle for particle rotation
+    float vx, vy, vz; // Velocity components
+    float sparkleRate; // Rate at which snowflake sparkles in night mode
+    float sparklePhase; // Phase offset for sparkling effect
+};
+
+// One field of the flake pool: a window onto SnowflakeStore's block with
+// the few vector operations the simulation needs. Never owns memory.
+class FloatArray {
+public:
+    float& operator[](size_t i) { return ptr[i]; }
+    const float& operator[](size_t i) const { return ptr[i]; }
+    float* data() { return ptr; }
+    const float* data() const { return ptr; }
+    size_t size() const { return n; }
+    float& back() { return ptr[n - 1]; }
+
+private:
+    friend struct SnowflakeStore;
+    float* ptr = nullptr;
+    size_t n = 0;
+};
+
+// Snowflakes stored as one array per field (structure of arrays), so the
+// update kernel streams only the fields it needs and can run several
+// flakes per SIMD instruction. All fields share one 64-byte-aligned pool
+// allocation, each starting on its own cache line. Only reserve() (or a
+// push_back past capacity) allocates; the simulation reserves the full
+// flake count up front, so removing, adding and swapping flakes while it
+// runs never reallocates. The pool can also be memory someone else owns,
+// such as a mapped snapshot file (see adopt()).
+struct SnowflakeStore {
+    FloatArray x, y, z;
+    FloatArray vx, vy, vz;
+    FloatArray size;
+    FloatArray speed;
+    FloatArray angle;
+    FloatArray sparkleRate;
+    FloatArray sparklePhase;
+    FloatArray prevX, prevY, prevZ; // Position before the last step, for interpolation
+
+    SnowflakeStore() = default;
+    SnowflakeStore(const SnowflakeStore& other);
+    SnowflakeStore& operator=(const SnowflakeStore& other);
+    SnowflakeStore(SnowflakeStore&& other) noexcept;
+    SnowflakeStore& operator=(SnowflakeStore&& other) noexcept;
+    ~SnowflakeStore();
+
+    size_t count() const { return flakes; }
+    size_t capacity() const { return poolCapacity; }
+
+    void clear() { resize(0); }
+
+    // Make room for n flakes, keeping the current ones
+    void reserve(size_t n);
+
+    // Set the flake count; new flakes are left uninitialized so callers
+    // can fill them in parallel with set()
+    void resize(size_t n);
+
+    // Use pool as the store's memory, laid out as FIELD_COUNT fields of
+    // capacity floats in declaration order and 64-byte aligned, holding
+    // count flakes. owner keeps it alive and is released when the store
+    // moves to memory of its own.
+    void adopt(float* pool, size_t capacity, size_t count, std::shared_ptr<void> owner);
+
+    // The whole pool, FIELD_COUNT * capacity() floats in adopt()'s layout
+    const float* poolData() const { return pool; }
+
+    static const int FIELD_COUNT = 14;
+
+    void set(size_t i, const Snowflake& flake) {
+        x[i] = flake.x;
+        y[i] = flake.y;
+        z[i] = flake.z;
+        vx[i] = flake.vx;
+        vy[i] = flake.vy;
+        vz[i] = flake.vz;
+        size[i] = flake.size;
+        speed[i] = flake.speed;
+        angle[i] = flake.angle;
+        sparkleRate[i] = flake.sparkleRate;
+        sparklePhase[i] = flake.sparklePhase;
+        prevX[i] = flake.x;
+        prevY[i] = flake.y;
+        prevZ[i] = flake.z;
+    }
+
+    void push_back(const Snowflake& flake) {
+        if (flakes == poolCapacity) reserve(flakes * 2 + 64);
+        resize(flakes + 1);
+        set(flakes - 1, flake);
+    }
+
+    // Remove flake i by moving the last flake into its place
+    void swapRemove(size_t i) {
+        for (FloatArray* a : fields()) (*a)[i] = a->back();
+        resize(flakes - 1);
+    }
+
+    void swap(size_t i, size_t j) {
+        for (FloatArray* a : fields()) std::swap((*a)[i], (*a)[j]);
+    }
+
+private:
+    std::array<FloatArray*, FIELD_COUNT> fields() {
+        return { { &x, &y, &z, &vx, &vy, &vz, &size, &speed, &angle, &sparkleRate, &sparklePhase,
+            &prevX, &prevY, &prevZ } };
+    }
+
+    void freePool();
+    void pointFields();
+
+    float* pool = nullptr;
+    size_t poolCapacity = 0; // Flakes per field, a multiple of 16 floats
+    size_t flakes = 0;
+    std::shared_ptr<void> poolOwner; // Set when pool is not ours to free
+};
+
+// Hut light struct
+struct HutLight {
+    float x, y, z; // Position
+    float r, g, b; // Color
+    float blinkRate; // How fast the light blinks (if it does)
+    float blinkPhase; // Phase offset for blinking
+    bool blinks; // Whether this light blinks or stays steady
+};
+
+// Flakes per work item when the update is split across threads
+// (a multiple of every SIMD width)
+const size_t SNOW_CHUNK_SIZE = 16384;
+
+class ThreadPool;
+class FrameProfiler;
+
+// Per-step constants shared by every flake, computed once before the kernel runs
+struct SnowStepParams {
+    float shakeMagnitude; // Current shake strength, 0 when not shaking
+    float gravity;        // Downward acceleration, scaled by flake speed
+    float damping;        // Air resistance applied to velocity
+    float dtScale;        // Step length in 60 Hz steps; scales per-step impulses
+                          // and turns velocity into distance
+    float rotationForce;  // Tangential force from globe rotation
+    float angleStep;      // Spin added to every flake
+    float angleSpeedStep; // Spin added per unit of flake speed
+    float groundY;        // Height of the snow ground
+    float groundBounce;   // Velocity kept when bouncing off the ground
+    float hutX, hutZ;     // Hut centre, rotated with the globe
+    float hutSize;        // Half-width of the hut collision box
+    float hutMinY, hutMaxY;
+    float boundary;       // Radius at which flakes reflect off the glass
+    float boundaryPlace;  // Radius flakes are put back to after reflecting
+    float wallDamping;    // Velocity kept when reflecting off the glass
+};
+
+// Run the deterministic snow physics over flakes [begin, end)
+void updateSnowRange(SnowflakeStore& s, size_t begin, size_t end, const SnowStepParams& p);
+
+class SnowSim {
+public:
+    // Particles and scenery. Flakes [0, activeCount) are simulated; the
+    // rest are asleep and keep their place until something wakes them.
+    SnowflakeStore snowflakes;
+    size_t activeCount = 0;
+    // Most flakes step() moves; active flakes past it hold still until it
+    // rises again. GlobeScene lowers it for globes drawn with fewer flakes.
+    size_t stepLimit = SIZE_MAX;
+    std::vector<Star> stars;
+    std::vector<HutLight> hutLights;
+
+    // How many flakes and stars init() creates
+    size_t numSnowflakes = NUM_SNOWFLAKES;
+    size_t numStars = NUM_STARS;
+
+    // Globe rotation
+    float rotationSpeed = 0.0f;
+    float globeRotationY = 0.0f;
+    float prevGlobeRotationY = 0.0f; // Before the last step, for interpolation
+    bool isRotating = false;
+
+    // Shaking variables
+    bool isShaking = false;
+    float shakeMagnitude = 0.0f;
+    float shakeDecay = 0.95f;
+    float maxShakeMagnitude = 1.0f;
+
+    // Night mode variables
+    bool isNightMode = false;
+    float dayNightTransition = 0.0f; // 0.0 = day, 1.0 = night
+    float transitionSpeed = 0.02f; // Speed of day/night transition
+
+    // Time tracking
+    float totalTime = 0.0f; // Total simulated time for animations
+
+    // Random numbers are a pure function of (seed, frame, flake index),
+    // so the same seed replays the same snowfall
+    uint64_t seed = 1;
+    uint64_t frame = 0; // Steps taken since init()
+
+    // Flake-to-flake interaction through a uniform grid rebuilt every step.
+    // Closer than repulsionRadius flakes push apart; between that and
+    // interactionRadius they pull together slightly, so snow clumps.
+    // Values are for NUM_SNOWFLAKES and scale with the mean flake spacing.
+    bool flakeInteraction = true;
+    float interactionRadius = 0.15f;
+    float repulsionRadius = 0.06f;
+    float repulsionStrength = 0.002f;
+    float cohesionStrength = 0.0002f;
+    SpatialGrid grid;
+
+    // Flakes that come to rest on the ground leave the particle set and
+    // pile up in snowField; a hard shake throws them back out as new flakes
+    bool snowAccumulation = true;
+    float settleSpeed = 0.08f;      // Flakes slower than this stick on contact
+    float settledDepth = 0.04f;     // Mean depth if every flake settled
+    SnowHeightfield snowField;
+
+    // Flakes slower than sleepSpeed within sleepMargin of the floor or the
+    // snow surface stop being simulated until a shake or spin wakes them
+    bool flakeSleep = true;
+    float sleepSpeed = 0.005f;
+    float sleepMargin = 0.02f;
+
+    // The water as a coarse velocity grid: shakes push it about in a few
+    // blobs per step, a spin drags it along the glass, and flakes drift
+    // with it. Off, shakes kick each flake at random and spins push flakes
+    // sideways directly, as the GPU backend still does.
+    bool fluidFlow = true;
+    int fluidResolution = 32;         // Cells per side of the grid
+    int fluidPushes = 3;              // Blobs pushed per shaking step
+    int fluidPushSteps = 12;          // Steps each blob keeps its place and direction
+    float fluidPushRadius = 2.0f;
+    float fluidPushStrength = 0.1f;   // Push per step at full shake
+    float fluidWallLayer = 0.8f;      // Depth of water a spinning globe drags
+    float fluidWallDrag = 0.1f;       // Share of the gap to the glass closed per step
+    SnowFluid fluid;
+
+    // When false, step() advances the globe, shake and day/night state
+    // but leaves the flakes to another backend (SnowGpuSim), which moves
+    // them with stepParams. Interaction, settling and sleep are CPU only.
+    bool cpuFlakes = true;
+    SnowStepParams stepParams = {}; // Per-flake constants of the last step
+
+    // Optional pool the flake update is split across; serial when null
+    ThreadPool* threadPool = nullptr;
+
+    // Optional profiler the step's phases are timed on; off when null
+    FrameProfiler* profiler = nullptr;
+
+    // Regenerate snowflakes, stars and hut lights from the seed
+    void init();
+
+    // Copy what drawing and snapshots read from other: flakes, scenery,
+    // globe and day/night state, settled snow, the water, the step count
+    // and the step limit. Settings and the interaction grid are left alone, and memory
+    // is reused, so copying into the same sim every step does not allocate.
+    void copyState(const SnowSim& other);
+
+    // Empty snowField, sized for numSnowflakes
+    void initSnowField(int resolution = 64);
+
+    // Still water, fluidResolution cells per side
+    void initFluid();
+
+    // Advance the simulation by dt seconds. Per-step constants are tuned
+    // for 1/60 s and scaled to dt, but fixed steps (see SnowClock.h) keep
+    // runs reproducible and collisions reliable.
+    void step(float dt);
+
+    // Globe rotation a fraction alpha of the way through the last step
+    float interpolatedRotationY(float alpha) const;
+
+    // Input events
+    void shake();
+    void toggleNightMode();
+    void spinGlobe(float speed);
+
+    // Sky color for the current day/night transition
+    void backgroundColor(float& r, float& g, float& b) const;
+
+    // True while step() changes what is drawn beyond the time-based
+    // effects (twinkle, blink, sparkle, smoke): a shake, a spin, moving
+    // water, a day/night fade, or more than driftingFraction of the flakes
+    // in flight
+    bool isMoving(float driftingFraction = 0.0f) const;
+
+    // FNV-1a over the raw bits of the flake positions; equal runs give
+    // equal checksums on any thread count
+    uint64_t positionChecksum() const;
+
+private:
+    void initStars();
+    void initHutLights();
+    void initSnowflakes();
+    void updateDayNight(float dt);
+    void updateSnow(float dt);
+    void applyFlakeInteraction(float stepScale);
+    void applyRandomImpulses(size_t begin, size_t end, const SnowStepParams& p);
+    void stirFluid(float stepScale);
+    void applyFluid(size_t begin, size_t end, const SnowStepParams& p);
+    void findResting(size_t begin, size_t end, const SnowStepParams& p, bool withWater);
+    void retireResting();
+    void liftSnow(float stepScale);
+    void wakeAll();
+    void removeActive(size_t i);
+
+    // Flakes that settled or fell asleep this step, per work item.
+    // RESTING_SLEEP marks sleepers; the rest are deposited in snowField.
+    static const uint32_t RESTING_SLEEP = 0x80000000u;
+    std::vector<std::vector<uint32_t>> restingByChunk;
+};
@@ -0,0 +1,108 @@
+/*
+    Headless driver for SnowSim: runs the simulation with no window,
+    no GL context and no GLUT, and reports how long the steps took.
+
+    Usage: SnowSimHeadless [steps] [dt] [threads] [seed] [flakes]
+        steps    number of fixed steps to run (default 600)
+        dt       step length in seconds (default 1/60)
+        threads  threads for the flake update, 0 = all cores (default 0)
+        seed     random seed (default 1)
+        flakes   number of snowflakes (default NUM_SNOWFLAKES)
+
+    Prints a checksum of the final flake positions: the same seed and
+    step count give the same checksum on any thread count, and the
+    p50/p95/p99 of each simulation phase over the last steps. Set
+    SNOW_TRACE=path to also save them as a Chrome trace.
+
+    SNOW_LOAD=path starts from a snapshot (see SnowSnapshot.h) instead of
+    a fresh snowfall, taking its seed and flake count; SNOW_SAVE=path
+    saves one after the last step.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "FrameProfiler.h"
+#include "SnowSim.h"
+#include "SnowSnapshot.h"
+#include "ThreadPool.h"
+
+int main(int argc, char** argv) {
+    int steps = argc > 1 ? atoi(argv[1]) : 600;
+    float dt = argc > 2 ? (float)atof(argv[2]) : 1.0f / 60.0f;
+    unsigned threads = argc > 3 ? (unsigned)atoi(argv[3]) : 0;
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    size_t flakes = argc > 5 ? (size_t)strtoull(argv[5], nullptr, 10) : NUM_SNOWFLAKES;
+
+    ThreadPool pool(threads);
+    SnowSim sim;
+    sim.threadPool = &pool;
+    sim.seed = seed;
+    sim.numSnowflakes = flakes;
+
+    // One profiler frame per step
+    FrameProfiler profiler;
+    sim.profiler = &profiler;
+
+    auto initStart = std::chrono::steady_clock::now();
+    sim.init();
+    double initMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count();
+    printf("init: %zu flakes in %.1f ms\n", flakes, initMs);
+
+    // Shake at the start so the run exercises every physics path, and
+    // again halfway to throw up the snow that has settled by then. A
+    // loaded snapshot carries on as it was.
+    const char* loadPath = getenv("SNOW_LOAD");
+    if (loadPath) {
+        auto loadStart = std::chrono::steady_clock::now();
+        SnowSnapshot snapshot;
+        SnowCamera camera;
+        if (!snapshot.read(loadPath)) return 1;
+        snapshot.restore(sim, camera);
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+        printf("load: %zu flakes from %s in %.2f ms (step %llu)\n",
+            sim.snowflakes.count(), loadPath, loadMs, (unsigned long long)sim.frame);
+    }
+    else {
+        sim.shake();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; ++i) {
+        if (i == steps / 2) sim.shake();
+        profiler.nextFrame();
+        sim.step(dt);
+    }
+    profiler.nextFrame();
+    auto end = std::chrono::steady_clock::now();
+
+    double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+    printf("%d steps, %zu flakes (%zu awake, %llu settled), %u threads: %.3f ms total, %.4f ms/step\n",
+        steps, sim.snowflakes.count(), sim.activeCount, (unsigned long long)sim.snowField.settledTotal,
+        pool.size(), totalMs, steps > 0 ? totalMs / steps : 0.0);
+    printf("seed %llu, checksum %016llx\n",
+        (unsigned long long)seed, (unsigned long long)sim.positionChecksum());
+
+    for (int id = 0; id < profiler.phaseCount(); ++id) {
+        FrameProfiler::Percentiles p = profiler.cpuPercentiles(id);
+        printf("  %-16s p50 %8.4f  p95 %8.4f  p99 %8.4f ms  (%d steps)\n",
+            profiler.phaseName(id).c_str(), p.p50, p.p95, p.p99, p.samples);
+    }
+
+    const char* savePath = getenv("SNOW_SAVE");
+    if (savePath) {
+        auto saveStart = std::chrono::steady_clock::now();
+        SnowSnapshot snapshot;
+        snapshot.capture(sim, SnowCamera());
+        if (!snapshot.write(savePath)) return 1;
+        double saveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - saveStart).count();
+        printf("save: %s in %.2f ms\n", savePath, saveMs);
+    }
+
+    const char* tracePath = getenv("SNOW_TRACE");
+    if (tracePath && !profiler.writeChromeTrace(tracePath)) {
+        fprintf(stderr, "Could not write %s\n", tracePath);
+    }
+
+    return 0;
+}
@@ -0,0 +1,349 @@
+/*
+    Checks that the snow code keeps the promises its headers make, with
+    no window, GL or GLUT.
+
+    Usage: SnowSimTest
+    Prints one line per check and exits with 1 if any failed.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "GlobeScene.h"
+#include "SnowSim.h"
+#include "SnowSimd.h"
+#include "SnowSnapshot.h"
+#include "ThreadPool.h"
+
+static const float STEP = 1.0f / 60.0f;
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// Values the kernels meet: both signs, zero, tiny and large, and pairs
+// that compare equal
+static const int VALUE_COUNT = 16;
+static const float VALUES_A[VALUE_COUNT] = {
+    1.5f, -2.25f, 0.0f, 3.0e-7f, -4.5f, 1024.0f, 0.3f, -0.001f,
+    7.0f, -7.0f, 2.0f, 0.5f, -1.0e6f, 9.75f, -3.5f, 0.125f,
+};
+static const float VALUES_B[VALUE_COUNT] = {
+    0.5f, 2.25f, -1.0f, 3.0e-7f, 4.5f, -8.0f, 0.3f, 0.002f,
+    -7.0f, 7.0f, 2.0f, -0.75f, 5.0e5f, 1.0f, -3.5f, 64.0f,
+};
+
+// op on FloatLanes gives, lane for lane, the bits op on ScalarLanes gives
+template <typename Op>
+static bool sameAsScalar(Op op) {
+    const int width = FloatLanes::width;
+    for (int i = 0; i + width <= VALUE_COUNT; i += width) {
+        float wide[width];
+        op(FloatLanes::load(VALUES_A + i), FloatLanes::load(VALUES_B + i)).store(wide);
+        for (int k = 0; k < width; ++k) {
+            float narrow;
+            op(ScalarLanes::load(VALUES_A + i + k), ScalarLanes::load(VALUES_B + i + k)).store(&narrow);
+            if (memcmp(&wide[k], &narrow, sizeof(float)) != 0) return false;
+        }
+    }
+    return true;
+}
+
+// The kernels are templates run on FloatLanes for the bulk of the flakes
+// and on ScalarLanes for the tail, so every operation must agree exactly
+static void checkLanes() {
+    bool same = sameAsScalar([](auto a, auto b) { return a + b; }) &&
+        sameAsScalar([](auto a, auto b) { return a - b; }) &&
+        sameAsScalar([](auto a, auto b) { return a * b; }) &&
+        sameAsScalar([](auto a, auto b) { return a / b; }) &&
+        sameAsScalar([](auto a, auto) { return -a; }) &&
+        sameAsScalar([](auto a, auto) { return lanesSqrt(lanesAbs(a)); }) &&
+        sameAsScalar([](auto a, auto b) { return lanesMin(a, b); }) &&
+        sameAsScalar([](auto a, auto b) { return lanesMax(a, b); }) &&
+        sameAsScalar([](auto a, auto b) { return lanesSelect(a < b, a, b); }) &&
+        sameAsScalar([](auto a, auto b) { return lanesSelect(maskAnd(a > b, a > 0.0f), a, b); }) &&
+        sameAsScalar([](auto a, auto b) { return lanesSelect(maskAndNot(a < b, b > 0.0f), a, b); });
+    check(same, "SIMD lanes match the scalar stand-in");
+}
+
+// FNV-1a over the bits of the flakes' positions and velocities
+static uint64_t checksum(const SnowflakeStore& s) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const FloatArray* arrays[] = { &s.x, &s.y, &s.z, &s.vx, &s.vy, &s.vz };
+    for (const FloatArray* a : arrays) {
+        const unsigned char* bytes = (const unsigned char*)a->data();
+        for (size_t i = 0; i < s.count() * sizeof(float); ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Constants as SnowSim::updateSnow sets them for a 60 Hz step of a
+// spinning globe, with the hut turned off centre
+static SnowStepParams spinningStep() {
+    SnowStepParams p = {};
+    p.gravity = 0.0005f;
+    p.damping = 0.99f;
+    p.dtScale = 1.0f;
+    p.rotationForce = 0.02f;
+    p.angleStep = 5.0f;
+    p.angleSpeedStep = 0.2f;
+    p.groundY = -GLOBE_RADIUS + 0.5f;
+    p.groundBounce = 0.3f;
+    p.hutX = 0.3f;
+    p.hutZ = -0.2f;
+    p.hutSize = 0.8f;
+    p.hutMinY = -GLOBE_RADIUS + 0.5f;
+    p.hutMaxY = -GLOBE_RADIUS + 2.0f;
+    p.boundary = GLOBE_RADIUS * 0.95f;
+    p.boundaryPlace = GLOBE_RADIUS * 0.94f;
+    p.wallDamping = 0.8f;
+    return p;
+}
+
+// The whole kernel run in lanes with a scalar tail moves flakes exactly
+// as running it one flake at a time, all scalar. Flakes are thrown about
+// so they bounce off the glass, the floor and the hut.
+static void checkSimdKernel() {
+    SnowSim sim;
+    sim.init();
+    SnowflakeStore& s = sim.snowflakes;
+    for (size_t i = 0; i < s.count(); ++i) {
+        s.vx[i] = (float)((int)(i * 37 % 101) - 50) * 0.004f;
+        s.vy[i] = (float)((int)(i * 53 % 89) - 44) * 0.004f;
+        s.vz[i] = (float)((int)(i * 71 % 97) - 48) * 0.004f;
+    }
+
+    SnowflakeStore wide = s, narrow = s;
+    SnowStepParams p = spinningStep();
+    for (int step = 0; step < 120; ++step) {
+        updateSnowRange(wide, 0, wide.count(), p);
+        for (size_t i = 0; i < narrow.count(); ++i) updateSnowRange(narrow, i, i + 1, p);
+    }
+    check(checksum(wide) == checksum(narrow) && checksum(wide) != checksum(s),
+        "SIMD kernel matches the scalar one");
+}
+
+// parallelFor hands out every index exactly once, in chunks no larger
+// than the grain, however the chunks get stolen
+static void checkParallelFor() {
+    const size_t counts[] = { 0, 1, 7, 1000, 100003 };
+    const size_t grains[] = { 1, 16, 4096 };
+    const unsigned threads[] = { 1, 4 };
+    bool once = true;
+    std::atomic<bool> inGrain(true);
+    for (unsigned t : threads) {
+        ThreadPool pool(t);
+        for (size_t count : counts) {
+            for (size_t grain : grains) {
+                std::vector<std::atomic<int>> visits(count);
+                for (std::atomic<int>& v : visits) v.store(0);
+                pool.parallelFor(count, grain, [&](size_t begin, size_t end) {
+                    if (end - begin > grain) inGrain = false;
+                    for (size_t i = begin; i < end; ++i) visits[i].fetch_add(1);
+                });
+                for (std::atomic<int>& v : visits) once = once && v.load() == 1;
+            }
+        }
+    }
+    check(once && inGrain, "parallelFor covers every index once");
+}
+
+// Shake, then spin once the first swirl has died down
+static void stepShaken(SnowSim& sim, int first, int steps) {
+    for (int i = first; i < first + steps; ++i) {
+        if (i == 0) sim.shake();
+        if (i == 150) sim.spinGlobe(6.0f);
+        sim.step(STEP);
+    }
+}
+
+static void setUp(SnowSim& sim, ThreadPool* pool, size_t flakes) {
+    sim.threadPool = pool;
+    sim.seed = 9;
+    sim.numSnowflakes = flakes;
+    sim.init();
+}
+
+static void checkThreadCounts() {
+    uint64_t checksums[3];
+    unsigned threads[3] = { 0, 1, 4 };
+    for (int t = 0; t < 3; ++t) {
+        ThreadPool pool(threads[t] ? threads[t] : 1);
+        SnowSim sim;
+        setUp(sim, threads[t] ? &pool : nullptr, 20000);
+        stepShaken(sim, 0, 240);
+        checksums[t] = checksum(sim.snowflakes);
+    }
+    check(checksums[0] == checksums[1] && checksums[1] == checksums[2],
+        "same flakes with no pool, 1 and 4 threads");
+}
+
+// Saved halfway through a shake, while the water still swirls, and
+// loaded into a fresh globe, the rest of the run comes out as if it had
+// never stopped
+static void checkSnapshotResume() {
+    const char* path = "snowsim-test.snap";
+    ThreadPool pool(2);
+    SnowSim straight;
+    setUp(straight, &pool, 3000);
+    stepShaken(straight, 0, 200);
+
+    SnowSnapshot saved;
+    saved.capture(straight, SnowCamera());
+    bool written = saved.write(path);
+    bool waterMoving = straight.fluid.isMoving();
+    stepShaken(straight, 200, 200);
+
+    SnowSim resumed;
+    setUp(resumed, &pool, 3000);
+    SnowSnapshot loaded;
+    SnowCamera camera;
+    bool read = written && loaded.read(path);
+    if (read) {
+        loaded.restore(resumed, camera);
+        stepShaken(resumed, 200, 200);
+    }
+    remove(path);
+
+    check(waterMoving, "water still moving when the snapshot is taken");
+    check(read && resumed.frame == straight.frame && checksum(resumed.snowflakes) == checksum(straight.snowflakes),
+        "snapshot resumes where it was saved");
+}
+
+// A globe drawn coarsely on a wall steps only the flakes it draws; the
+// rest hold still until it is drawn in full again
+static void checkStepLimit() {
+    SnowSim sim;
+    setUp(sim, nullptr, 2000);
+    size_t limit = GlobeScene::flakeLimit(sim.numSnowflakes, 2);
+    sim.stepLimit = limit;
+    SnowflakeStore before = sim.snowflakes;
+    stepShaken(sim, 0, 60);
+
+    size_t moved = 0, held = 0;
+    for (size_t i = 0; i < sim.snowflakes.count(); ++i) {
+        bool same = sim.snowflakes.x[i] == before.x[i] && sim.snowflakes.y[i] == before.y[i] &&
+            sim.snowflakes.z[i] == before.z[i];
+        if (i < limit) moved += same ? 0 : 1;
+        else held += same ? 1 : 0;
+    }
+    check(limit == 125 && moved == limit && held == sim.snowflakes.count() - limit,
+        "step limit holds the undrawn flakes still");
+}
+
+static void checkNoFlakes() {
+    SnowSim sim;
+    setUp(sim, nullptr, 0);
+    stepShaken(sim, 0, 200);
+    check(sim.frame == 200 && sim.activeCount == 0, "globe with no flakes steps");
+}
+
+// Steps a wall of globes (--globes), which step serially on the pool's
+// threads, and returns the checksum of each
+static std::vector<uint64_t> stepWall(ThreadPool* pool, size_t flakes, int steps) {
+    SnowSim primary;
+    setUp(primary, pool, flakes);
+    GlobeScene scene;
+    scene.init(primary, 4);
+    scene.shake();
+    for (int i = 0; i < steps; ++i) scene.step(STEP, pool);
+
+    std::vector<uint64_t> checksums;
+    for (size_t i = 0; i < scene.size(); ++i) checksums.push_back(checksum(scene[i].sim->snowflakes));
+    return checksums;
+}
+
+// A wall with nothing awake on it, either no flakes at all or every
+// flake settled or asleep, keeps stepping and wakes on a shake
+static bool stepQuietWall(size_t flakes, int steps, bool untilSettled) {
+    ThreadPool pool(2);
+    SnowSim primary;
+    setUp(primary, &pool, flakes);
+    GlobeScene scene;
+    scene.init(primary, 4);
+    scene.shake();
+
+    int step = 0;
+    for (; step < steps; ++step) {
+        bool settled = true;
+        for (size_t i = 0; i < scene.size(); ++i) settled = settled && scene[i].sim->activeCount == 0;
+        if (untilSettled && settled) break;
+        scene.step(STEP, &pool);
+    }
+    if (untilSettled && step == steps) return false;
+
+    for (int i = 0; i < 30; ++i) scene.step(STEP, &pool);
+    scene.shake();
+    for (int i = 0; i < 30; ++i) scene.step(STEP, &pool);
+    return true;
+}
+
+static void checkWall() {
+    ThreadPool pool(4);
+    std::vector<uint64_t> serial = stepWall(nullptr, 500, 120);
+    std::vector<uint64_t> parallel = stepWall(&pool, 500, 120);
+    check(serial == parallel, "same wall of globes with and without a pool");
+    check(serial[0] != serial[1] && serial[1] != serial[2], "each globe on the wall snows its own way");
+    check(stepQuietWall(0, 60, false), "wall of globes with no flakes steps");
+    check(stepQuietWall(200, 6000, true), "wall of fully settled globes steps");
+}
+
+// A snapshot of a globe with snow on the ground maps a pool with room
+// for every flake, so lifting the snow back up stays in the mapping
+static void checkSnapshotRoom() {
+    const char* path = "snowsim-test.snap";
+    SnowSim sim;
+    setUp(sim, nullptr, 2000);
+    for (int i = 0; i < 6000 && sim.snowflakes.count() + 32 > sim.numSnowflakes; ++i) sim.step(STEP);
+
+    SnowSnapshot saved;
+    saved.capture(sim, SnowCamera());
+    SnowSnapshot loaded;
+    bool read = saved.write(path) && loaded.read(path);
+    remove(path);
+
+    check(sim.snowflakes.count() + 32 <= sim.numSnowflakes, "snow settles");
+    check(read && loaded.snowflakes.capacity() >= loaded.numSnowflakes, "snapshot pool has room for every flake");
+}
+
+// Grid sizes no globe runs with are refused rather than allocated, even
+// with no water values or tile counts in the file to give them away
+static void checkSnapshotSizes() {
+    const char* path = "snowsim-test.snap";
+    SnowSim sim;
+    setUp(sim, nullptr, 100);
+    SnowSnapshot saved, loaded;
+
+    saved.capture(sim, SnowCamera());
+    saved.fluidResolution = 1 << 20;
+    saved.fluidState.clear();
+    bool hugeWater = saved.write(path) && loaded.read(path);
+
+    saved.capture(sim, SnowCamera());
+    saved.fieldResolution = 0;
+    saved.fieldCounts.clear();
+    bool noGround = saved.write(path) && loaded.read(path);
+    remove(path);
+
+    check(!hugeWater && !noGround, "snapshot with impossible grid sizes refused");
+}
+
+int main() {
+    checkLanes();
+    checkSimdKernel();
+    checkParallelFor();
+    checkThreadCounts();
+    checkSnapshotResume();
+    checkSnapshotRoom();
+    checkSnapshotSizes();
+    checkStepLimit();
+    checkNoFlakes();
+    checkWall();
+
+    if (failures) printf("%d check(s) FAILED\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/*
+    Small SIMD helpers for the snow particle kernels.
+
+    FloatLanes wraps the widest float vector available at compile time
+    (AVX2 -> 8 lanes, SSE2 -> 4 lanes) and ScalarLanes is a one-lane stand-in
+    with the same interface, so a kernel written once as a template runs on
+    either and the scalar version doubles as the fallback and tail loop.
+    Define SNOW_NO_SIMD to force the scalar path.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <new>
+
+#if defined(SNOW_NO_SIMD)
+// Scalar only
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SNOW_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SNOW_SIMD_SSE2 1
+#endif
+
+// Allocator returning memory aligned to a cache line, so particle arrays
+// start on a vector boundary and never share a line with other data
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+// One float per lane, used for the fallback path and array tails
+struct ScalarLanes {
+    typedef bool Mask;
+    static const int width = 1;
+    float v;
+
+    ScalarLanes() : v(0.0f) {}
+    ScalarLanes(float f) : v(f) {}
+
+    static ScalarLanes load(const float* p) { return ScalarLanes(*p); }
+    void store(float* p) const { *p = v; }
+};
+
+inline ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return a.v + b.v; }
+inline ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return a.v - b.v; }
+inline ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return a.v * b.v; }
+inline ScalarLanes operator/(ScalarLanes a, ScalarLanes b) { return a.v / b.v; }
+inline ScalarLanes operator-(ScalarLanes a) { return -a.v; }
+inline bool operator<(ScalarLanes a, ScalarLanes b) { return a.v < b.v; }
+inline bool operator>(ScalarLanes a, ScalarLanes b) { return a.v > b.v; }
+inline ScalarLanes lanesSqrt(ScalarLanes a) { return std::sqrt(a.v); }
+inline ScalarLanes lanesAbs(ScalarLanes a) { return std::fabs(a.v); }
+inline ScalarLanes lanesMin(ScalarLanes a, ScalarLanes b) { return a.v < b.v ? a.v : b.v; }
+inline ScalarLanes lanesMax(ScalarLanes a, ScalarLanes b) { return a.v > b.v ? a.v : b.v; }
+inline ScalarLanes lanesSelect(bool m, ScalarLanes a, ScalarLanes b) { return m ? a : b; }
+inline bool maskAnd(bool a, bool b) { return a && b; }
+inline bool maskAndNot(bool a, bool b) { return !a && b; } // (~a) & b
+inline bool maskAny(bool m) { return m; }
+
+#if defined(SNOW_SIMD_AVX2)
+
+struct FloatMask8 { __m256 m; };
+
+struct FloatLanes {
+    typedef FloatMask8 Mask;
+    static const int width = 8;
+    __m256 v;
+
+    FloatLanes() : v(_mm256_setzero_ps()) {}
+    FloatLanes(__m256 x) : v(x) {}
+    FloatLanes(float f) : v(_mm256_set1_ps(f)) {}
+
+    static FloatLanes load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline FloatLanes operator+(FloatLanes a, FloatLanes b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatLanes operator-(FloatLanes a, FloatLanes b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatLanes operator*(FloatLanes a, FloatLanes b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatLanes operator/(FloatLanes a, FloatLanes b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatLanes operator-(FloatLanes a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline FloatMask8 operator<(FloatLanes a, FloatLanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline FloatMask8 operator>(FloatLanes a, FloatLanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline FloatLanes lanesSqrt(FloatLanes a) { return _mm256_sqrt_ps(a.v); }
+inline FloatLanes lanesAbs(FloatLanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline FloatLanes lanesMin(FloatLanes a, FloatLanes b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatLanes lanesMax(FloatLanes a, FloatLanes b) { return _mm256_max_ps(a.v, b.v); }
+inline FloatLanes lanesSelect(FloatMask8 m, FloatLanes a, FloatLanes b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+inline FloatMask8 maskAnd(FloatMask8 a, FloatMask8 b) { return { _mm256_and_ps(a.m, b.m) }; }
+inline FloatMask8 maskAndNot(FloatMask8 a, FloatMask8 b) { return { _mm256_andnot_ps(a.m, b.m) }; }
+inline bool maskAny(FloatMask8 m) { return _mm256_movemask_ps(m.m) != 0; }
+
+#elif defined(SNOW_SIMD_SSE2)
+
+struct FloatMask4 { __m128 m; };
+
+struct FloatLanes {
+    typedef FloatMask4 Mask;
+    static const int width = 4;
+    __m128 v;
+
+    FloatLanes() : v(_mm_setzero_ps()) {}
+    FloatLanes(__m128 x) : v(x) {}
+    FloatLanes(float f) : v(_mm_set1_ps(f)) {}
+
+    static FloatLanes load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline FloatLanes operator+(FloatLanes a, FloatLanes b) { return _mm_add_ps(a.v, b.v); }
+inline FloatLanes operator-(FloatLanes a, FloatLanes b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatLanes operator*(FloatLanes a, FloatLanes b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatLanes operator/(FloatLanes a, FloatLanes b) { return _mm_div_ps(a.v, b.v); }
+inline FloatLanes operator-(FloatLanes a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline FloatMask4 operator<(FloatLanes a, FloatLanes b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline FloatMask4 operator>(FloatLanes a, FloatLanes b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline FloatLanes lanesSqrt(FloatLanes a) { return _mm_sqrt_ps(a.v); }
+inline FloatLanes lanesAbs(FloatLanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline FloatLanes lanesMin(FloatLanes a, FloatLanes b) { return _mm_min_ps(a.v, b.v); }
+inline FloatLanes lanesMax(FloatLanes a, FloatLanes b) { return _mm_max_ps(a.v, b.v); }
+// SSE2 has no blendv, so select with and/andnot/or
+inline FloatLanes lanesSelect(FloatMask4 m, FloatLanes a, FloatLanes b) {
+    return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+}
+inline FloatMask4 maskAnd(FloatMask4 a, FloatMask4 b) { return { _mm_and_ps(a.m, b.m) }; }
+inline FloatMask4 maskAndNot(FloatMask4 a, FloatMask4 b) { return { _mm_andnot_ps(a.m, b.m) }; }
+inline bool maskAny(FloatMask4 m) { return _mm_movemask_ps(m.m) != 0; }
+
+#else
+
+// No vector unit available: the "wide" path is the scalar one
+typedef ScalarLanes FloatLanes;
+
+#endif
@@ -0,0 +1,356 @@
+#include "SnowSnapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char MAGIC[8] = { 'S', 'N', 'O', 'W', 'S', 'N', 'A', 'P' };
+static const uint32_t BYTE_ORDER_MARK = 0x01020304u;
+static const uint64_t POOL_ALIGNMENT = 4096; // A page, so the mapped pool is 64-byte aligned
+static const uint32_t MAX_FIELD_RESOLUTION = 1024; // Heightfield tiles per side
+
+// Start of the file, written and read as raw bytes
+struct SnapshotFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;     // BYTE_ORDER_MARK as the writer stored it
+    uint32_t headerBytes;   // sizeof(SnapshotFileHeader)
+    uint32_t fieldCount;    // SnowflakeStore::FIELD_COUNT
+    uint64_t fileBytes;
+
+    uint64_t poolOffset, poolCapacity, flakeCount, activeCount;
+    uint64_t starOffset, starCount;
+    uint64_t lightOffset, lightCount;
+    uint64_t fieldOffset;
+    uint32_t fieldResolution;
+    uint32_t flags;         // FLAG_* below
+    uint64_t fluidOffset, fluidValues;
+
+    uint64_t seed, frame, numSnowflakes, numStars, settledTotal;
+    float totalTime, rotationSpeed, globeRotationY, prevGlobeRotationY;
+    float shakeMagnitude, dayNightTransition;
+    float cameraDistance, cameraAngleX, cameraAngleY;
+    uint32_t fluidResolution;
+};
+
+static const uint32_t FLAG_ROTATING = 1, FLAG_SHAKING = 2, FLAG_NIGHT = 4;
+
+// HutLight with its bool widened, so the file has no padding
+struct SnapshotLight {
+    float x, y, z;
+    float r, g, b;
+    float blinkRate, blinkPhase;
+    uint32_t blinks;
+};
+
+static_assert(sizeof(Star) == 6 * sizeof(float), "Star is stored as raw floats");
+
+static uint64_t alignUp(uint64_t n, uint64_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+void SnowSnapshot::capture(const SnowSim& sim, const SnowCamera& view) {
+    snowflakes = sim.snowflakes;
+    activeCount = sim.activeCount;
+    stars = sim.stars;
+    hutLights = sim.hutLights;
+    seed = sim.seed;
+    frame = sim.frame;
+    numSnowflakes = sim.numSnowflakes;
+    numStars = sim.numStars;
+    totalTime = sim.totalTime;
+    rotationSpeed = sim.rotationSpeed;
+    globeRotationY = sim.globeRotationY;
+    prevGlobeRotationY = sim.prevGlobeRotationY;
+    isRotating = sim.isRotating;
+    isShaking = sim.isShaking;
+    shakeMagnitude = sim.shakeMagnitude;
+    isNightMode = sim.isNightMode;
+    dayNightTransition = sim.dayNightTransition;
+    fieldResolution = sim.snowField.resolution;
+    fieldCounts = sim.snowField.flakeCount;
+    settledTotal = sim.snowField.settledTotal;
+    fluidResolution = sim.fluidFlow ? sim.fluid.resolution() : 0;
+    fluidState.resize(sim.fluidFlow ? sim.fluid.stateSize() : 0);
+    if (!fluidState.empty()) sim.fluid.saveState(fluidState.data());
+    camera = view;
+}
+
+bool SnowSnapshot::write(const char* path) const {
+    // Room for every flake, settled ones too, so lifting snow back into
+    // the air never reallocates the pool out of the mapping
+    size_t count = snowflakes.count();
+    uint64_t capacity = alignUp(std::max<uint64_t>(count, numSnowflakes), 16);
+
+    SnapshotFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.byteOrder = BYTE_ORDER_MARK;
+    h.headerBytes = sizeof(h);
+    h.fieldCount = SnowflakeStore::FIELD_COUNT;
+
+    h.starOffset = sizeof(h);
+    h.starCount = stars.size();
+    h.lightOffset = h.starOffset + stars.size() * sizeof(Star);
+    h.lightCount = hutLights.size();
+    h.fieldOffset = h.lightOffset + hutLights.size() * sizeof(SnapshotLight);
+    h.fieldResolution = (uint32_t)fieldResolution;
+    h.fluidOffset = h.fieldOffset + fieldCounts.size() * sizeof(uint32_t);
+    h.fluidValues = fluidState.size();
+    h.fluidResolution = (uint32_t)fluidResolution;
+    h.poolOffset = alignUp(h.fluidOffset + fluidState.size() * sizeof(float), POOL_ALIGNMENT);
+    h.poolCapacity = capacity;
+    h.flakeCount = count;
+    h.activeCount = activeCount;
+    h.fileBytes = h.poolOffset + capacity * SnowflakeStore::FIELD_COUNT * sizeof(float);
+
+    h.flags = (isRotating ? FLAG_ROTATING : 0) | (isShaking ? FLAG_SHAKING : 0) | (isNightMode ? FLAG_NIGHT : 0);
+    h.seed = seed;
+    h.frame = frame;
+    h.numSnowflakes = numSnowflakes;
+    h.numStars = numStars;
+    h.settledTotal = settledTotal;
+    h.totalTime = totalTime;
+    h.rotationSpeed = rotationSpeed;
+    h.globeRotationY = globeRotationY;
+    h.prevGlobeRotationY = prevGlobeRotationY;
+    h.shakeMagnitude = shakeMagnitude;
+    h.dayNightTransition = dayNightTransition;
+    h.cameraDistance = camera.distance;
+    h.cameraAngleX = camera.angleX;
+    h.cameraAngleY = camera.angleY;
+
+    std::vector<SnapshotLight> lights(hutLights.size());
+    for (size_t i = 0; i < hutLights.size(); ++i) {
+        const HutLight& l = hutLights[i];
+        lights[i] = { l.x, l.y, l.z, l.r, l.g, l.b, l.blinkRate, l.blinkPhase, l.blinks ? 1u : 0u };
+    }
+
+    // Write beside the target and rename over it, so a globe running on a
+    // mapping of the old file keeps its pages
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s for writing\n", temporary.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&h, sizeof(h), 1, file) == 1;
+    if (!stars.empty()) ok = ok && fwrite(stars.data(), sizeof(Star), stars.size(), file) == stars.size();
+    if (!lights.empty()) ok = ok && fwrite(lights.data(), sizeof(SnapshotLight), lights.size(), file) == lights.size();
+    if (!fieldCounts.empty()) {
+        ok = ok && fwrite(fieldCounts.data(), sizeof(uint32_t), fieldCounts.size(), file) == fieldCounts.size();
+    }
+    if (!fluidState.empty()) {
+        ok = ok && fwrite(fluidState.data(), sizeof(float), fluidState.size(), file) == fluidState.size();
+    }
+
+    // Zero padding up to the pool and after each field's flakes
+    std::vector<char> zeros(POOL_ALIGNMENT, 0);
+    uint64_t gap = h.poolOffset - (h.fluidOffset + fluidState.size() * sizeof(float));
+    ok = ok && fwrite(zeros.data(), 1, gap, file) == gap;
+
+    const float* pool = snowflakes.poolData();
+    for (int f = 0; f < SnowflakeStore::FIELD_COUNT && ok; ++f) {
+        if (count) ok = fwrite(pool + f * snowflakes.capacity(), sizeof(float), count, file) == count;
+        size_t tail = (capacity - count) * sizeof(float);
+        ok = ok && fwrite(zeros.data(), 1, tail, file) == tail;
+    }
+
+    if (fclose(file) != 0) ok = false;
+#ifdef _WIN32
+    // rename() will not replace an existing file here
+    if (ok) remove(path);
+#endif
+    if (ok && rename(temporary.c_str(), path) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Writing snapshot %s failed\n", path);
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+// Map a whole file copy-on-write. The returned owner unmaps it.
+static std::shared_ptr<void> mapFile(const char* path, uint64_t& bytes) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return nullptr;
+    bytes = (uint64_t)size.QuadPart;
+    return std::shared_ptr<void>(view, [](void* p) { UnmapViewOfFile(p); });
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    size_t length = (size_t)info.st_size;
+    void* view = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return nullptr;
+    bytes = length;
+    return std::shared_ptr<void>(view, [length](void* p) { munmap(p, length); });
+#endif
+}
+
+// [offset, offset + count * size) lies within a file of the given length
+static bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileBytes) {
+    return offset <= fileBytes && count <= (fileBytes - offset) / size;
+}
+
+bool SnowSnapshot::read(const char* path) {
+    uint64_t bytes = 0;
+    std::shared_ptr<void> mapping = mapFile(path, bytes);
+    if (!mapping) {
+        fprintf(stderr, "Could not map snapshot %s\n", path);
+        return false;
+    }
+    const char* base = (const char*)mapping.get();
+
+    SnapshotFileHeader h;
+    if (bytes < sizeof(h)) {
+        fprintf(stderr, "%s is not a snow globe snapshot\n", path);
+        return false;
+    }
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a snow globe snapshot\n", path);
+        return false;
+    }
+    if (h.version != VERSION || h.byteOrder != BYTE_ORDER_MARK || h.headerBytes != sizeof(h) ||
+        h.fieldCount != (uint32_t)SnowflakeStore::FIELD_COUNT) {
+        fprintf(stderr, "%s is a version %u snapshot from an incompatible build (this build reads version %u)\n",
+            path, h.version, VERSION);
+        return false;
+    }
+
+    // Grid sizes are checked on their own too: with the water still there
+    // are no values to bound the size by, and restoring allocates the grids
+    uint64_t tiles = (uint64_t)h.fieldResolution * h.fieldResolution;
+    uint64_t fluidCells = (uint64_t)h.fluidResolution * h.fluidResolution * h.fluidResolution;
+    bool valid = h.fileBytes == bytes &&
+        h.fieldResolution >= 1 && h.fieldResolution <= MAX_FIELD_RESOLUTION &&
+        (h.fluidResolution == 0 || (h.fluidResolution >= (uint32_t)SnowFluid::MIN_RESOLUTION &&
+            h.fluidResolution <= (uint32_t)SnowFluid::MAX_RESOLUTION)) &&
+        h.poolOffset % POOL_ALIGNMENT == 0 && h.poolCapacity % 16 == 0 &&
+        h.flakeCount <= h.poolCapacity && h.activeCount <= h.flakeCount &&
+        fits(h.starOffset, h.starCount, sizeof(Star), bytes) &&
+        fits(h.lightOffset, h.lightCount, sizeof(SnapshotLight), bytes) &&
+        fits(h.fieldOffset, tiles, sizeof(uint32_t), bytes) &&
+        (h.fluidValues == 0 || h.fluidValues == 4 * fluidCells) &&
+        fits(h.fluidOffset, h.fluidValues, sizeof(float), bytes) &&
+        fits(h.poolOffset, h.poolCapacity, SnowflakeStore::FIELD_COUNT * sizeof(float), bytes);
+    if (!valid) {
+        fprintf(stderr, "Snapshot %s is cut off or damaged\n", path);
+        return false;
+    }
+
+    // The small parts are copied out; the flake pool stays in the mapping
+    stars.resize(h.starCount);
+    if (h.starCount) memcpy(stars.data(), base + h.starOffset, h.starCount * sizeof(Star));
+
+    hutLights.resize(h.lightCount);
+    for (size_t i = 0; i < h.lightCount; ++i) {
+        SnapshotLight l;
+        memcpy(&l, base + h.lightOffset + i * sizeof(SnapshotLight), sizeof(l));
+        hutLights[i] = { l.x, l.y, l.z, l.r, l.g, l.b, l.blinkRate, l.blinkPhase, l.blinks != 0 };
+    }
+
+    fieldResolution = (int)h.fieldResolution;
+    fieldCounts.resize(tiles);
+    if (tiles) memcpy(fieldCounts.data(), base + h.fieldOffset, tiles * sizeof(uint32_t));
+
+    fluidResolution = (int)h.fluidResolution;
+    fluidState.resize(h.fluidValues);
+    if (h.fluidValues) memcpy(fluidState.data(), base + h.fluidOffset, h.fluidValues * sizeof(float));
+
+    snowflakes.adopt((float*)(base + h.poolOffset), h.poolCapacity, h.flakeCount, mapping);
+    activeCount = h.activeCount;
+    seed = h.seed;
+    frame = h.frame;
+    numSnowflakes = h.numSnowflakes;
+    numStars = h.numStars;
+    settledTotal = h.settledTotal;
+    totalTime = h.totalTime;
+    rotationSpeed = h.rotationSpeed;
+    globeRotationY = h.globeRotationY;
+    prevGlobeRotationY = h.prevGlobeRotationY;
+    isRotating = (h.flags & FLAG_ROTATING) != 0;
+    isShaking = (h.flags & FLAG_SHAKING) != 0;
+    shakeMagnitude = h.shakeMagnitude;
+    isNightMode = (h.flags & FLAG_NIGHT) != 0;
+    dayNightTransition = h.dayNightTransition;
+    camera.distance = h.cameraDistance;
+    camera.angleX = h.cameraAngleX;
+    camera.angleY = h.cameraAngleY;
+    return true;
+}
+
+void SnowSnapshot::restore(SnowSim& sim, SnowCamera& view) {
+    sim.seed = seed;
+    sim.frame = frame;
+    sim.numSnowflakes = numSnowflakes;
+    sim.numStars = numStars;
+    sim.snowflakes = std::move(snowflakes);
+    sim.snowflakes.reserve(numSnowflakes); // Files with no room to spare are copied out once here
+    sim.activeCount = activeCount;
+    sim.stars = stars;
+    sim.hutLights = hutLights;
+    sim.totalTime = totalTime;
+    sim.rotationSpeed = rotationSpeed;
+    sim.globeRotationY = globeRotationY;
+    sim.prevGlobeRotationY = prevGlobeRotationY;
+    sim.isRotating = isRotating;
+    sim.isShaking = isShaking;
+    sim.shakeMagnitude = shakeMagnitude;
+    sim.isNightMode = isNightMode;
+    sim.dayNightTransition = dayNightTransition;
+
+    // The water at the size it was saved with, still or moving
+    sim.fluidFlow = fluidResolution > 0;
+    if (sim.fluidFlow) sim.fluidResolution = fluidResolution;
+    sim.initFluid();
+    if (!fluidState.empty()) sim.fluid.loadState(fluidState.data());
+
+    // A fresh field marks every tile dirty, so the renderer rebuilds it all
+    sim.initSnowField(fieldResolution);
+    if (fieldCounts.size() == sim.snowField.flakeCount.size()) {
+        sim.snowField.flakeCount = fieldCounts;
+        sim.snowField.settledTotal = settledTotal;
+    }
+    view = camera;
+}
+
+void SnowSnapshotSaver::save(const SnowSim& sim, const SnowCamera& camera, const std::string& path) {
+    wait();
+    pending.capture(sim, camera);
+    worker = std::thread([this, path]() { pending.write(path.c_str()); });
+}
+
+void SnowSnapshotSaver::wait() {
+    if (worker.joinable()) worker.join();
+}
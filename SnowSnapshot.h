@@ -0,0 +1,95 @@
+/*
+    Binary snapshot of a whole snow globe: every flake, the stars, hut
+    lights, settled snow, the water, globe rotation, shake, day/night
+    state and the camera, so a globe can restart or be swapped for another in
+    milliseconds and carry on from a settled scene.
+
+    The flake pool is stored exactly as SnowflakeStore keeps it in memory
+    (one 64-byte-aligned block of per-field arrays) at a page-aligned
+    offset. Loading maps the file copy-on-write and hands that block to
+    the store with adopt(), so nothing is parsed or copied per flake:
+    pages are read in as the simulation first touches them and copied
+    only once it writes to them. Sleeping flakes cost nothing until woken.
+
+    Files are written to a temporary name and renamed into place, so a
+    snapshot can be saved over the one the running globe was loaded from.
+    They are only read back by builds with the same byte order and float
+    format; the header is checked and a mismatch is refused, not
+    converted.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SnowSim.h"
+
+// View settings kept with the simulation; the frontend owns the camera
+struct SnowCamera {
+    float distance = 10.0f;
+    float angleX = 15.0f;
+    float angleY = 30.0f;
+};
+
+class SnowSnapshot {
+public:
+    static const uint32_t VERSION = 2;
+
+    // Copy the state of sim and camera. The flake pool copy is one
+    // memcpy; everything else is small.
+    void capture(const SnowSim& sim, const SnowCamera& camera);
+
+    // Write the captured state; prints why and returns false on failure
+    bool write(const char* path) const;
+
+    // Map a snapshot file; prints why and returns false if it is missing,
+    // from another version or byte order, or cut off
+    bool read(const char* path);
+
+    // Put the state into sim and camera. The flakes move into sim, still
+    // backed by the mapped file when they came from read().
+    void restore(SnowSim& sim, SnowCamera& camera);
+
+    SnowflakeStore snowflakes;
+    size_t activeCount = 0;
+    std::vector<Star> stars;
+    std::vector<HutLight> hutLights;
+    uint64_t seed = 1;
+    uint64_t frame = 0;
+    uint64_t numSnowflakes = 0;
+    uint64_t numStars = 0;
+    float totalTime = 0.0f;
+    float rotationSpeed = 0.0f;
+    float globeRotationY = 0.0f;
+    float prevGlobeRotationY = 0.0f;
+    bool isRotating = false;
+    bool isShaking = false;
+    float shakeMagnitude = 0.0f;
+    bool isNightMode = false;
+    float dayNightTransition = 0.0f;
+    int fieldResolution = 0;
+    std::vector<uint32_t> fieldCounts; // Settled flakes per heightfield tile
+    uint64_t settledTotal = 0;
+    int fluidResolution = 0;           // Cells per side, 0 with the water off
+    std::vector<float> fluidState;     // SnowFluid::saveState(), empty while still
+    SnowCamera camera;
+};
+
+// Saves snapshots on a background thread. save() takes the copy on the
+// caller's thread, so the simulation can keep running while the file is
+// written.
+class SnowSnapshotSaver {
+public:
+    ~SnowSnapshotSaver() { wait(); }
+
+    // Waits for the previous save to finish first
+    void save(const SnowSim& sim, const SnowCamera& camera, const std::string& path);
+
+    void wait();
+
+private:
+    std::thread worker;
+    SnowSnapshot pending;
+};
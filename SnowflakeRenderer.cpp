@@ -0,0 +1,276 @@
+#include "SnowflakeRenderer.h"
+#include "ClusteredLights.h"
+#include "RenderQueue.h"
+#include "SnowGpuSim.h"
+#include "SnowSim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+// Attribute locations, bound before linking
+enum {
+    ATTRIB_CORNER = 0,
+    ATTRIB_POS_SIZE = 1,
+    ATTRIB_PREV_ANGLE = 2,
+    ATTRIB_SPARKLE = 3
+};
+
+static const char* const snowAttribNames[] = { "corner", "posSize", "prevAngle", "sparkle", nullptr };
+
+// Places the flake between its previous and current step, then applies
+// the same transform as glTranslatef(pos) * glRotatef(angle, 0, 1, 0) *
+// glScalef(size) and colors it like snowflakeColor() below
+static const char* snowVertexShader = R"(
+#version 120
+attribute vec3 corner;
+attribute vec4 posSize;
+attribute vec4 prevAngle;
+attribute vec2 sparkle;
+uniform float alpha;
+uniform float night;
+uniform float time;
+uniform float transition;
+varying vec3 color;
+varying vec3 eyePos;
+
+void main() {
+    float a = radians(prevAngle.w);
+    float c = cos(a);
+    float s = sin(a);
+    vec3 p = corner * posSize.w;
+    vec3 rotated = vec3(c * p.x + s * p.z, p.y, -s * p.x + c * p.z);
+    vec3 center = mix(prevAngle.xyz, posSize.xyz, alpha);
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(center + rotated, 1.0);
+    eyePos = (gl_ModelViewMatrix * vec4(center + rotated, 1.0)).xyz;
+
+    if (night > 0.5) {
+        float glint = (sin(time * sparkle.x + sparkle.y) + 1.0) * 0.5;
+        color = vec3(0.5 + 0.5 * glint, 0.5 + 0.5 * glint, 0.6 + 0.4 * glint);
+    }
+    else {
+        color = vec3(1.0 - transition * 0.3);
+    }
+}
+)";
+
+// Follows ClusteredLights::shaderSource; flakes catch light from every side
+static const char* snowFragmentShader = R"(
+varying vec3 color;
+varying vec3 eyePos;
+
+void main() {
+    gl_FragColor = vec4(min(color + color * clusterLights(eyePos, vec3(0.0), 0.0), 1.0), 1.0);
+}
+)";
+
+// Two crossed unit quads, as triangles
+static const float snowShape[] = {
+    // Quad in the XY plane
+    -1.0f, -1.0f, 0.0f,   1.0f, -1.0f, 0.0f,   1.0f,  1.0f, 0.0f,
+    -1.0f, -1.0f, 0.0f,   1.0f,  1.0f, 0.0f,  -1.0f,  1.0f, 0.0f,
+    // Perpendicular quad in the YZ plane
+     0.0f, -1.0f, -1.0f,  0.0f,  1.0f, -1.0f,  0.0f,  1.0f,  1.0f,
+     0.0f, -1.0f, -1.0f,  0.0f,  1.0f,  1.0f,  0.0f, -1.0f,  1.0f,
+};
+static const GLsizei snowShapeVertices = 12;
+
+// Snowflake color based on night mode
+static void snowflakeColor(const SnowSim& sim, size_t i, float& r, float& g, float& b) {
+    if (sim.isNightMode) {
+        // In night mode, add sparkle effect
+        float sparkle = sin(sim.totalTime * sim.snowflakes.sparkleRate[i] + sim.snowflakes.sparklePhase[i]);
+        sparkle = (sparkle + 1.0f) * 0.5f; // Convert to [0,1] range
+
+        // Create a sparkling effect with slight color variation
+        float brightness = 0.5f + 0.5f * sparkle;
+        r = g = brightness;
+        b = 0.6f + 0.4f * sparkle;
+    }
+    else {
+        // Normal white snow in day mode with slight transition
+        float brightness = 1.0f - (sim.dayNightTransition * 0.3f);
+        r = g = b = brightness;
+    }
+}
+
+void SnowflakeRenderer::init() {
+    if (!gl.hasInstancing) return;
+
+    std::string fragment = std::string("#version 120\n") + ClusteredLights::shaderSource + snowFragmentShader;
+    program = buildShaderProgram(snowVertexShader, fragment.c_str(), snowAttribNames);
+    if (!program) return;
+    clusterUniforms = ClusteredLights::Uniforms();
+    if (lighting) clusterUniforms = lighting->locate(program);
+
+    uAlpha = gl.GetUniformLocation(program, "alpha");
+    uNight = gl.GetUniformLocation(program, "night");
+    uTime = gl.GetUniformLocation(program, "time");
+    uTransition = gl.GetUniformLocation(program, "transition");
+
+    gl.GenBuffers(1, &shapeBuffer);
+    gl.BindBuffer(GL_ARRAY_BUFFER, shapeBuffer);
+    gl.BufferData(GL_ARRAY_BUFFER, sizeof(snowShape), snowShape, GL_STATIC_DRAW);
+
+    gl.GenBuffers(1, &instanceBuffer);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SnowflakeRenderer::destroy() {
+    if (program) gl.DeleteProgram(program);
+    if (shapeBuffer) gl.DeleteBuffers(1, &shapeBuffer);
+    if (instanceBuffer) gl.DeleteBuffers(1, &instanceBuffer);
+    program = shapeBuffer = instanceBuffer = 0;
+    instanceCapacity = 0;
+}
+
+// Flake position a fraction alpha of the way through the last step
+static void flakePosition(const SnowflakeStore& flakes, size_t i, float alpha, float& x, float& y, float& z) {
+    x = flakes.prevX[i] + (flakes.x[i] - flakes.prevX[i]) * alpha;
+    y = flakes.prevY[i] + (flakes.y[i] - flakes.prevY[i]) * alpha;
+    z = flakes.prevZ[i] + (flakes.z[i] - flakes.prevZ[i]) * alpha;
+}
+
+void SnowflakeRenderer::draw(const SnowSim& sim, RenderQueue& queue, float alpha, size_t limit) {
+    RenderCommand flakes;
+    flakes.state.program = program;
+    flakes.state.lit = false;
+    if (program) {
+        flakes.drawBatch = [this, &sim, alpha, limit]() { drawInstanced(sim, alpha, limit); };
+    }
+    else {
+        flakes.drawBatch = [this, &sim, alpha, limit]() { drawImmediate(sim, alpha, limit); };
+    }
+    flakes.triangles = std::min(sim.snowflakes.count(), limit) * (snowShapeVertices / 3);
+    queue.submit(flakes);
+}
+
+void SnowflakeRenderer::drawInstanced(const SnowSim& sim, float alpha, size_t limit) {
+    const SnowflakeStore& flakes = sim.snowflakes;
+    size_t count = std::min(flakes.count(), limit);
+    lastDrawCalls = 0;
+    if (count == 0) return;
+
+    // Gather the raw particle arrays; interpolation and sparkle are done
+    // in the shader
+    instances.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        Instance& inst = instances[i];
+        inst.x = flakes.x[i];
+        inst.y = flakes.y[i];
+        inst.z = flakes.z[i];
+        inst.size = flakes.size[i];
+        inst.prevX = flakes.prevX[i];
+        inst.prevY = flakes.prevY[i];
+        inst.prevZ = flakes.prevZ[i];
+        inst.angle = flakes.angle[i];
+        inst.sparkleRate = flakes.sparkleRate[i];
+        inst.sparklePhase = flakes.sparklePhase[i];
+    }
+
+    // Orphan and refill the instance buffer so we never wait on the GPU
+    // still reading last frame's data
+    gl.BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    size_t bytes = count * sizeof(Instance);
+    if (count > instanceCapacity) instanceCapacity = count;
+    gl.BufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+    gl.BufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+
+    drawBuffer(sim, alpha, sizeof(Instance), offsetof(Instance, x), offsetof(Instance, prevX),
+        offsetof(Instance, sparkleRate), count);
+}
+
+void SnowflakeRenderer::draw(const SnowSim& sim, const SnowGpuSim& gpuSim, RenderQueue& queue, float alpha,
+    size_t limit) {
+    lastDrawCalls = 0;
+    if (!program || gpuSim.count() == 0) return;
+
+    RenderCommand flakes;
+    flakes.state.program = program;
+    flakes.state.lit = false;
+    flakes.drawBatch = [this, &sim, &gpuSim, alpha, limit]() { drawGpu(sim, gpuSim, alpha, limit); };
+    flakes.triangles = std::min(gpuSim.count(), limit) * (snowShapeVertices / 3);
+    queue.submit(flakes);
+}
+
+void SnowflakeRenderer::drawGpu(const SnowSim& sim, const SnowGpuSim& gpuSim, float alpha, size_t limit) {
+    gl.BindBuffer(GL_ARRAY_BUFFER, gpuSim.currentBuffer());
+    drawBuffer(sim, alpha, sizeof(SnowGpuSim::Flake), offsetof(SnowGpuSim::Flake, x),
+        offsetof(SnowGpuSim::Flake, prevX), offsetof(SnowGpuSim::Flake, sparkleRate),
+        std::min(gpuSim.count(), limit));
+}
+
+void SnowflakeRenderer::drawBuffer(const SnowSim& sim, float alpha, size_t stride, size_t posSize,
+    size_t prevAngle, size_t sparkle, size_t count) {
+    gl.VertexAttribPointer(ATTRIB_POS_SIZE, 4, GL_FLOAT, GL_FALSE, (GLsizei)stride, (const void*)posSize);
+    gl.VertexAttribPointer(ATTRIB_PREV_ANGLE, 4, GL_FLOAT, GL_FALSE, (GLsizei)stride, (const void*)prevAngle);
+    gl.VertexAttribPointer(ATTRIB_SPARKLE, 2, GL_FLOAT, GL_FALSE, (GLsizei)stride, (const void*)sparkle);
+    for (GLuint a = ATTRIB_POS_SIZE; a <= ATTRIB_SPARKLE; ++a) {
+        gl.EnableVertexAttribArray(a);
+        gl.VertexAttribDivisor(a, 1);
+    }
+
+    gl.BindBuffer(GL_ARRAY_BUFFER, shapeBuffer);
+    gl.VertexAttribPointer(ATTRIB_CORNER, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    gl.EnableVertexAttribArray(ATTRIB_CORNER);
+
+    // Time and day/night are all that change per frame
+    gl.Uniform1f(uAlpha, alpha);
+    gl.Uniform1f(uNight, sim.isNightMode ? 1.0f : 0.0f);
+    gl.Uniform1f(uTime, sim.totalTime);
+    gl.Uniform1f(uTransition, sim.dayNightTransition);
+    if (lighting) lighting->apply(clusterUniforms);
+    gl.DrawArraysInstanced(GL_TRIANGLES, 0, snowShapeVertices, (GLsizei)count);
+    lastDrawCalls = 1;
+
+    // Leave attribute state as the fixed-function code expects it
+    for (GLuint a = ATTRIB_CORNER; a <= ATTRIB_SPARKLE; ++a) {
+        gl.DisableVertexAttribArray(a);
+    }
+    for (GLuint a = ATTRIB_POS_SIZE; a <= ATTRIB_SPARKLE; ++a) {
+        gl.VertexAttribDivisor(a, 0);
+    }
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Fallback: one flake at a time, two quads each
+void SnowflakeRenderer::drawImmediate(const SnowSim& sim, float alpha, size_t limit) {
+    const SnowflakeStore& flakes = sim.snowflakes;
+    size_t count = std::min(flakes.count(), limit);
+    lastDrawCalls = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        float size = flakes.size[i];
+
+        float x, y, z;
+        flakePosition(flakes, i, alpha, x, y, z);
+
+        glPushMatrix();
+        glTranslatef(x, y, z);
+        glRotatef(flakes.angle[i], 0.0f, 1.0f, 0.0f);
+
+        float r, g, b;
+        snowflakeColor(sim, i, r, g, b);
+        glColor3f(r, g, b);
+
+        // Draw a small quad for each snowflake
+        glBegin(GL_QUADS);
+        glVertex3f(-size, -size, 0.0f);
+        glVertex3f(size, -size, 0.0f);
+        glVertex3f(size, size, 0.0f);
+        glVertex3f(-size, size, 0.0f);
+        glEnd();
+
+        // Draw a perpendicular quad for 3D effect
+        glBegin(GL_QUADS);
+        glVertex3f(0.0f, -size, -size);
+        glVertex3f(0.0f, size, -size);
+        glVertex3f(0.0f, size, size);
+        glVertex3f(0.0f, -size, size);
+        glEnd();
+        glPopMatrix();
+
+        lastDrawCalls += 2;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+    Draws the snowflakes of a SnowSim.
+
+    With GL 3.3 style instancing available, every flake's current and
+    previous position, size, angle and sparkle rate and phase go into one
+    instance buffer and all flakes are drawn with a single
+    glDrawArraysInstanced of the crossed-quad shape. The shader
+    interpolates between steps and works out the night sparkle from the
+    time and day/night uniforms, so the CPU only copies arrays. Without
+    instancing, flakes are drawn one at a time in immediate mode as before.
+    Either way they go into the render queue as one unlit command.
+
+    Flakes simulated on the GPU (SnowGpuSim) are drawn the same way,
+    straight from its state buffer. With lighting set, flakes near a
+    point light pick up its color (ClusteredLights).
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ClusteredLights.h"
+#include "SnowGL.h"
+
+class RenderQueue;
+class SnowSim;
+class SnowGpuSim;
+
+class SnowflakeRenderer {
+public:
+    // Build the shader and buffers; needs a current context and
+    // loadGLFunctions() done. Falls back to immediate mode on failure.
+    void init();
+    void destroy();
+
+    // Queue the flakes, at most limit of them; alpha places them between
+    // their previous and current step. sim must stay put until the queue
+    // is flushed.
+    void draw(const SnowSim& sim, RenderQueue& queue, float alpha = 1.0f, size_t limit = SIZE_MAX);
+
+    // Queue the flakes held by gpuSim; sim supplies time and day/night
+    void draw(const SnowSim& sim, const SnowGpuSim& gpuSim, RenderQueue& queue, float alpha = 1.0f,
+        size_t limit = SIZE_MAX);
+
+    bool isInstanced() const { return program != 0; }
+
+    // Draw calls issued for the last flushed draw()
+    int lastDrawCalls = 0;
+
+    // Point lights the flakes pick up; set before init(). May be null.
+    const ClusteredLights* lighting = nullptr;
+
+private:
+    void drawInstanced(const SnowSim& sim, float alpha, size_t limit);
+    void drawImmediate(const SnowSim& sim, float alpha, size_t limit);
+    void drawGpu(const SnowSim& sim, const SnowGpuSim& gpuSim, float alpha, size_t limit);
+
+    // Draw count flakes from the bound array buffer, fields at the given
+    // byte offsets in the same layout as SnowGpuSim::Flake
+    void drawBuffer(const SnowSim& sim, float alpha, size_t stride, size_t posSize, size_t prevAngle,
+        size_t sparkle, size_t count);
+
+    // Per-flake data streamed to the GPU each frame
+    struct Instance {
+        float x, y, z, size;
+        float prevX, prevY, prevZ, angle;
+        float sparkleRate, sparklePhase;
+    };
+
+    GLuint program = 0;
+    GLint uAlpha = -1, uNight = -1, uTime = -1, uTransition = -1;
+    ClusteredLights::Uniforms clusterUniforms;
+    GLuint shapeBuffer = 0;
+    GLuint instanceBuffer = 0;
+    size_t instanceCapacity = 0;
+    std::vector<Instance> instances;
+};
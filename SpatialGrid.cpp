@@ -0,0 +1,107 @@
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// Elements per work item for the build passes
+static const size_t GRID_CHUNK = 16384;
+
+static void forRange(ThreadPool* pool, size_t count, size_t grain, const ThreadPool::RangeFunc& fn) {
+    if (pool) {
+        pool->parallelFor(count, grain, fn);
+    }
+    else if (count > 0) {
+        fn(0, count);
+    }
+}
+
+void SpatialGrid::build(const float* x, const float* y, const float* z, size_t count,
+    float minCellSize, ThreadPool* pool) {
+    cellSize = minCellSize;
+    invCellSize = 1.0f / cellSize;
+
+    // About two buckets per flake keeps collisions rare
+    size_t buckets = 64;
+    while (buckets < count * 2) buckets *= 2;
+    bucketMask = (uint32_t)(buckets - 1);
+
+    if (bucketCursorSize != buckets) {
+        bucketCursor.reset(new std::atomic<uint32_t>[buckets]);
+        bucketCursorSize = buckets;
+    }
+    bucketStart.resize(buckets + 1);
+    flakeBucket.resize(count);
+    sortedIndex.resize(count);
+    sortedX.resize(count);
+    sortedY.resize(count);
+    sortedZ.resize(count);
+
+    // Clear the per-bucket counters
+    forRange(pool, buckets, GRID_CHUNK * 4, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            bucketCursor[b].store(0, std::memory_order_relaxed);
+        }
+    });
+
+    // Pass 1: find each flake's bucket and count flakes per bucket
+    forRange(pool, count, GRID_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t b = bucketOf(cellCoord(x[i]), cellCoord(y[i]), cellCoord(z[i]));
+            flakeBucket[i] = b;
+            bucketCursor[b].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // Pass 2: exclusive prefix sum of the counts. Each block sums its
+    // buckets, the block totals are scanned serially, then each block
+    // writes its offsets.
+    const size_t scanBlock = GRID_CHUNK * 4;
+    size_t blocks = (buckets + scanBlock - 1) / scanBlock;
+    std::vector<uint32_t> blockBase(blocks + 1, 0);
+    forRange(pool, buckets, scanBlock, [&](size_t begin, size_t end) {
+        uint32_t sum = 0;
+        for (size_t b = begin; b < end; ++b) {
+            sum += bucketCursor[b].load(std::memory_order_relaxed);
+        }
+        blockBase[begin / scanBlock + 1] = sum;
+    });
+    for (size_t i = 0; i < blocks; ++i) {
+        blockBase[i + 1] += blockBase[i];
+    }
+    forRange(pool, buckets, scanBlock, [&](size_t begin, size_t end) {
+        uint32_t offset = blockBase[begin / scanBlock];
+        for (size_t b = begin; b < end; ++b) {
+            uint32_t n = bucketCursor[b].load(std::memory_order_relaxed);
+            bucketStart[b] = offset;
+            bucketCursor[b].store(offset, std::memory_order_relaxed);
+            offset += n;
+        }
+    });
+    bucketStart[buckets] = (uint32_t)count;
+
+    // Pass 3: scatter flake indices into their bucket ranges
+    forRange(pool, count, GRID_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t slot = bucketCursor[flakeBucket[i]].fetch_add(1, std::memory_order_relaxed);
+            sortedIndex[slot] = (uint32_t)i;
+        }
+    });
+
+    // Pass 4: put each bucket back in index order (buckets hold a handful
+    // of flakes, so this is cheap) and copy positions into sorted order
+    forRange(pool, buckets, GRID_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            uint32_t first = bucketStart[b];
+            uint32_t last = bucketStart[b + 1];
+            if (last - first > 1) {
+                std::sort(sortedIndex.begin() + first, sortedIndex.begin() + last);
+            }
+            for (uint32_t k = first; k < last; ++k) {
+                uint32_t i = sortedIndex[k];
+                sortedX[k] = x[i];
+                sortedY[k] = y[i];
+                sortedZ[k] = z[i];
+            }
+        }
+    });
+}
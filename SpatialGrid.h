@@ -0,0 +1,90 @@
+/*
+    Spatial hash over a uniform grid inside the globe, rebuilt every step
+    so flakes can find their neighbours without an O(N^2) pass.
+
+    Space is cut into cubic cells of twice the interaction radius and each
+    cell is hashed into a table of buckets sized to the flake count, so
+    memory and build time follow the number of flakes, not the volume.
+    With cells that size, everything within the radius of a point lies in
+    the 2x2x2 block of cells nearest to it: 8 bucket lookups per query
+    instead of 27, which matters once the table no longer fits in cache.
+    build() is a counting sort of flake indices by bucket: count flakes
+    per bucket, prefix-sum the counts into bucket offsets, then scatter
+    each index into its bucket's range. Every pass is linear and runs
+    across the thread pool. Indices inside a bucket are sorted afterwards
+    so neighbour order, and therefore the simulation, does not depend on
+    thread timing. Positions are copied into bucket order so neighbour
+    loops read contiguous memory.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+class SpatialGrid {
+public:
+    // Bucket count points (x[i], y[i], z[i]) into cells of cellSize. pool may be null.
+    void build(const float* x, const float* y, const float* z, size_t count,
+        float cellSize, ThreadPool* pool);
+
+    int cellCoord(float v) const {
+        return (int)std::floor(v * invCellSize);
+    }
+
+    uint32_t bucketOf(int cx, int cy, int cz) const {
+        uint32_t h = ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u) ^ ((uint32_t)cz * 83492791u);
+        return h & bucketMask;
+    }
+
+    // Call f(k) for every sorted slot k in the buckets of the 2x2x2 cells
+    // nearest (px, py, pz), which hold every flake within cellSize / 2.
+    // Buckets may also hold flakes from other cells, so the caller checks
+    // the actual distance using sortedX/Y/Z[k].
+    template <typename F>
+    void forEachNear(float px, float py, float pz, F&& f) const {
+        // Lower corner of the block: step back a cell on each axis where
+        // the point is in the lower half of its cell
+        int cx = cellCoord(px - 0.5f * cellSize);
+        int cy = cellCoord(py - 0.5f * cellSize);
+        int cz = cellCoord(pz - 0.5f * cellSize);
+
+        // Two neighbour cells can hash to the same bucket; visit it once
+        uint32_t seen[8];
+        int seenCount = 0;
+        for (int z = cz; z <= cz + 1; ++z) {
+            for (int y = cy; y <= cy + 1; ++y) {
+                for (int x = cx; x <= cx + 1; ++x) {
+                    uint32_t b = bucketOf(x, y, z);
+                    bool duplicate = false;
+                    for (int s = 0; s < seenCount; ++s) {
+                        if (seen[s] == b) { duplicate = true; break; }
+                    }
+                    if (duplicate) continue;
+                    seen[seenCount++] = b;
+
+                    for (uint32_t k = bucketStart[b]; k < bucketStart[b + 1]; ++k) f(k);
+                }
+            }
+        }
+    }
+
+    float cellSize = 0.0f;
+    float invCellSize = 0.0f;
+    uint32_t bucketMask = 0;
+
+    std::vector<uint32_t> bucketStart;  // First sorted slot of each bucket, plus an end sentinel
+    std::vector<uint32_t> sortedIndex;  // Flake index in each sorted slot
+    std::vector<float> sortedX, sortedY, sortedZ;
+
+private:
+    std::vector<uint32_t> flakeBucket;  // Bucket of each flake
+    std::unique_ptr<std::atomic<uint32_t>[]> bucketCursor;
+    size_t bucketCursorSize = 0;
+};
@@ -0,0 +1,53 @@
+/*
+    Lock-free bounded queue for exactly one producer thread and one
+    consumer thread.
+
+    A ring of CAPACITY slots (a power of two) with a head the consumer
+    advances and a tail the producer advances, each on its own cache line
+    so the two threads do not fight over it. push() and pop() never block:
+    push() fails when the ring is full and pop() when it is empty. Each
+    side keeps a cached copy of the other's index and only reloads it when
+    the ring looks full or empty, so most calls touch no shared line at all.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+    // Producer: false when full
+    bool push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == CAPACITY) {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == CAPACITY) return false;
+        }
+        items[t & (CAPACITY - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false when empty
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache) return false;
+        }
+        item = items[h & (CAPACITY - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head { 0 };    // Next slot to pop
+    size_t tailCache = 0;                           // Consumer's view of tail
+    alignas(64) std::atomic<size_t> tail { 0 };    // Next slot to push
+    size_t headCache = 0;                           // Producer's view of head
+    alignas(64) T items[CAPACITY];
+};
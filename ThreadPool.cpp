@@ -0,0 +1,136 @@
+#include "ThreadPool.h"
+
+static uint64_t packRange(uint32_t lo, uint32_t hi) {
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t rangeLo(uint64_t r) { return (uint32_t)r; }
+static uint32_t rangeHi(uint64_t r) { return (uint32_t)(r >> 32); }
+
+static unsigned resolveThreadCount(unsigned threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+    }
+    return threads;
+}
+
+ThreadPool::ThreadPool(unsigned threads) : runs(resolveThreadCount(threads)), busyWorkers(0) {
+    for (unsigned i = 1; i < runs.size(); ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const RangeFunc& fn) {
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+
+    size_t chunks = (count + grain - 1) / grain;
+    if (workers.empty() || chunks == 1) {
+        // Not worth waking anyone
+        for (size_t begin = 0; begin < count; begin += grain) {
+            fn(begin, begin + grain < count ? begin + grain : count);
+        }
+        return;
+    }
+
+    // Deal each participant an equal contiguous run of chunks
+    unsigned participants = size();
+    for (unsigned i = 0; i < participants; ++i) {
+        uint32_t lo = (uint32_t)(chunks * i / participants);
+        uint32_t hi = (uint32_t)(chunks * (i + 1) / participants);
+        runs[i].range.store(packRange(lo, hi), std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobFunc = &fn;
+        jobCount = count;
+        jobGrain = grain;
+        busyWorkers.store((unsigned)workers.size(), std::memory_order_relaxed);
+        ++generation;
+    }
+    wake.notify_all();
+
+    // The caller works too, then waits for workers still finishing a chunk
+    runChunks(0);
+    while (busyWorkers.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        runChunks(index);
+        busyWorkers.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::runChunks(unsigned self) {
+    uint32_t chunk;
+    while (popFront(self, chunk) || stealBack(self, chunk)) {
+        size_t begin = chunk * jobGrain;
+        size_t end = begin + jobGrain < jobCount ? begin + jobGrain : jobCount;
+        (*jobFunc)(begin, end);
+    }
+}
+
+// Take the next chunk from the front of our own run
+bool ThreadPool::popFront(unsigned slot, uint32_t& chunk) {
+    std::atomic<uint64_t>& range = runs[slot].range;
+    uint64_t r = range.load(std::memory_order_acquire);
+    while (rangeLo(r) < rangeHi(r)) {
+        if (range.compare_exchange_weak(r, packRange(rangeLo(r) + 1, rangeHi(r)), std::memory_order_acq_rel)) {
+            chunk = rangeLo(r);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Take one chunk from the back of the fullest other run
+bool ThreadPool::stealBack(unsigned self, uint32_t& chunk) {
+    unsigned participants = (unsigned)runs.size();
+    for (;;) {
+        unsigned victim = self;
+        uint32_t most = 0;
+        for (unsigned i = 1; i < participants; ++i) {
+            unsigned slot = (self + i) % participants;
+            uint64_t r = runs[slot].range.load(std::memory_order_relaxed);
+            uint32_t left = rangeHi(r) > rangeLo(r) ? rangeHi(r) - rangeLo(r) : 0;
+            if (left > most) {
+                most = left;
+                victim = slot;
+            }
+        }
+        if (victim == self) return false;
+
+        std::atomic<uint64_t>& range = runs[victim].range;
+        uint64_t r = range.load(std::memory_order_acquire);
+        if (rangeLo(r) < rangeHi(r) &&
+            range.compare_exchange_strong(r, packRange(rangeLo(r), rangeHi(r) - 1), std::memory_order_acq_rel)) {
+            chunk = rangeHi(r) - 1;
+            return true;
+        }
+        // Lost a race with the owner or another thief; look again
+    }
+}
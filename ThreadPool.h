@@ -0,0 +1,66 @@
+/*
+    Persistent work-stealing thread pool for data-parallel loops.
+
+    parallelFor() cuts [0, count) into chunks and deals each participant
+    (the workers plus the calling thread) a contiguous run of them. Every
+    participant works through its own run from the front; once it runs out
+    it steals single chunks from the back of whichever run has the most
+    left, so slow chunks (e.g. flakes bouncing off the glass) even out.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    typedef std::function<void(size_t begin, size_t end)> RangeFunc;
+
+    // threads is the total number of threads working on a loop, including
+    // the caller; 0 means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads working on a loop, including the caller
+    unsigned size() const { return (unsigned)workers.size() + 1; }
+
+    // Call fn(begin, end) over [0, count) in chunks of at most grain
+    // elements and return once every chunk has run. Not reentrant.
+    void parallelFor(size_t count, size_t grain, const RangeFunc& fn);
+
+private:
+    // Remaining chunk indices [lo, hi) of one participant, packed in one
+    // word so owner pops and thief steals are a single compare-exchange
+    struct alignas(64) ChunkRun {
+        std::atomic<uint64_t> range;
+    };
+
+    void workerLoop(unsigned index);
+    void runChunks(unsigned self);
+    bool popFront(unsigned slot, uint32_t& chunk);
+    bool stealBack(unsigned self, uint32_t& chunk);
+
+    std::vector<std::thread> workers;
+    std::vector<ChunkRun> runs;
+
+    // Current job
+    const RangeFunc* jobFunc = nullptr;
+    size_t jobCount = 0;
+    size_t jobGrain = 0;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t generation = 0;
+    bool stopping = false;
+    std::atomic<unsigned> busyWorkers;
+};
@@ -0,0 +1,57 @@
+/*
+    Lock-free triple buffer: one writer hands whole states to one reader
+    without either ever waiting for the other.
+
+    There are three slots. The writer owns one (back()), the reader owns
+    one (front()), and the third sits in the middle holding the newest
+    state published and not yet taken. publish() swaps the back slot into
+    the middle; acquire() swaps the middle slot out to the reader when it
+    holds something newer than what the reader has. Each is one atomic
+    exchange, so a slow reader only ever skips states and a slow writer
+    only ever delays them; neither blocks.
+
+    A state the reader holds stays put until its next acquire(), and the
+    writer finds in back() whatever that slot last held, so it can update
+    it in place rather than build it from scratch.
+*/
+
+#pragma once
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer: the slot to fill next
+    T& back() { return slots[backIndex]; }
+
+    // Writer: make back() the newest state and take another slot to fill
+    void publish() {
+        int previous = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+        backIndex = previous & INDEX;
+    }
+
+    // Reader: move to the newest published state, if there is one newer
+    // than front(); true when front() changed
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX;
+        return true;
+    }
+
+    // Reader: the state it holds
+    T& front() { return slots[frontIndex]; }
+
+    // Every slot, for setting them up before the writer and reader start
+    T& slot(int i) { return slots[i]; }
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4;     // Set in middle when it holds an untaken state
+
+    T slots[3];
+    std::atomic<int> middle { 1 };
+    int backIndex = 0;              // Writer only
+    int frontIndex = 2;             // Reader only
+};